@@ -60,21 +60,44 @@
 #define ONEMEG (1024 * 1024)
 #define MAX_PWD_LEN 64
 #define JSON_BUFF_LEN (32 * 1024) // set big enough to hold all file names in a folder
-#define MAX_CONFIGS 115 // > number of entries in configs.txt
+#define MAX_CONFIGS 130 // > number of entries in configs.txt
 #define GITHUB_URL "https://raw.githubusercontent.com/s60sc/ESP32-CAM_MJPEG2SD/master"
 
 #define FILE_EXT "avi"
+#define MP4_EXT "mp4"
 #define BOUNDARY_VAL "123456789000000000000987654321"
 #define AVI_HEADER_LEN 310 // AVI header length
 #define CHUNK_HDR 8 // bytes per jpeg hdr in AVI 
-#define WAVTEMP "/current.wav"
+#define AVIX_HDR 24 // bytes per OpenDML RIFF AVIX hdr
+#define AES_NONCE_LEN 8 // nonce part of AES-CTR counter block
+#define TIME_CHUNK_LEN 24 // JUNK chunk holding frame sequence number and capture time
+#define WRITE_STALL_MS 1000 // SD write stall absorbed by write ring and audio buffers
 #define AVITEMP "/current.avi"
 #define TLTEMP "/current.tl"
+#define MP4TEMP "/current.mp4"
+#define IDXTEMP "/current.idx"
+#define TLIDXTEMP "/current.tlx"
+#define SEGTEMP "/segment.avi" // alternate name for recording while previous one finalized
+#define SEGIDXTEMP "/segment.idx"
+#define NAMETEMP "/current.nam" // holds final name of recording made without temporary name, until finalized
+#define SEGNAMETEMP "/segment.nam" // alternate for NAMETEMP while previous recording finalized
+#define CRYPTTEMP "/pending.enc" // unfinished encrypted recording awaiting passphrase for recovery
+#define SEG_MANIFEST "segments.csv" // per day list of segments
+#define CRC_MANIFEST "checksums.csv" // per day list of recording checksums
+#define EDITTEMP "/edit.avi" // avi being built by background edit
+#define POOL_DIR "/.pool" // hidden folder for pre-allocated recording files
+#define POOL_FILES 2
 
 #define FILLSTAR "****************************************************************"
 #define DELIM ':'
 #define STORAGE SD_MMC // one of: SPIFFS LittleFS SD_MMC 
 #define RAMSIZE (1024 * 8) // set this to multiple of SD card sector size (512 or 1024 bytes)
+#define SECTOR_SIZE 512 // SD card sector size
+#define CAPTURE_MOTION 1 // recording trigger sources in avi metadata
+#define CAPTURE_PIR 2
+#define CAPTURE_BUTTON 4
+#define CAPTURE_SEGMENT 8
+#define JPEG_TABLES_MAX 1024 // max length of Huffman tables stored once per recording
 #define CHUNKSIZE (1024 * 4)
 #define INCLUDE_FTP 
 #define INCLUDE_SMTP
@@ -97,6 +120,7 @@
 /******************** Libraries *******************/
 
 #include "esp_camera.h"
+#include "mbedtls/aes.h"
 
 /******************** Function declarations *******************/
 
@@ -106,40 +130,131 @@ struct mjpegStruct {
   size_t jpegSize;
 };
 
+struct aviInfoStruct {
+  size_t hdrLen; // header length, movi data follows
+  size_t moviLen; // length of movi data, idx1 follows
+  uint32_t idxLen; // length of idx1 entries
+  uint32_t frameCnt;
+  uint32_t usecs; // usecs per frame
+  uint32_t audLen; // bytes of audio
+  uint32_t thumbCnt;
+  bool isAligned; // frames padded to start on sector boundary
+  time_t startTime; // from metadata, 0 if none
+};
+
+struct aviMetaStruct {
+  uint32_t startTime; // epoch secs of first frame
+  uint32_t duration; // ms
+  uint32_t frameCnt;
+  uint32_t sampleRate; // audio sample rate, 0 if no audio
+  uint8_t recFPS;
+  uint8_t frameType; // index to frameData[]
+  uint8_t trigger; // CAPTURE_ bits for what started recording
+  uint8_t motionPct; // percentage of motion checks during recording that detected motion
+  uint8_t sampleBits; // audio bits per sample
+  uint8_t channels; // audio channels
+  uint16_t encrypted; // 1 if movi content encrypted, with salt and nonce in JENC chunk at its start
+};
+
+struct aviCryptStruct {
+  mbedtls_aes_context aesCtx; // own key schedule for each user of recording
+  uint8_t nonce[AES_NONCE_LEN];
+  size_t cryptStart, cryptEnd; // file positions of encrypted content
+};
+
 struct fnameStruct {
   uint8_t recFPS;
   uint32_t recDuration;
-  uint16_t frameCnt;
+  uint32_t frameCnt;
 };
 
 
 // global app specific functions
-void buildAviHdr(uint8_t FPS, uint8_t frameType, uint16_t frameCnt, bool isTL = false);
+void addAviJunk(size_t chunkLen, bool isTL = false);
+size_t alignAviChunk(size_t filePos, uint8_t** junkPtr);
+void buildAviHdr(uint8_t FPS, uint8_t frameType, uint32_t frameCnt, bool isTL = false);
 void buildAviIdx(size_t dataSize, bool isVid = true, bool isTL = false);
+void buildThumbIdx(size_t dataSize);
 bool checkMotion(camera_fb_t* fb, bool motionStatus);
+bool checkRawSectors(bool useRaw);
 bool checkSDFiles();
+size_t findTablesChunk(File& df, size_t& chunkPos, aviCryptStruct* crypt = NULL);
+bool compileRecordings(const char* compileArgs);
+bool createRawFile(const char* fileName, size_t fileLen);
+void cryptAvi(aviCryptStruct& crypt, uint8_t* data, size_t dataLen, size_t filePos);
+void encryptAvi(uint8_t* data, size_t dataLen, size_t filePos, bool isTL = false);
 esp_err_t extractQueryKey(httpd_req_t *req, char* variable);
 bool fetchMoveMap(uint8_t **out, size_t *out_len);
-void finalizeAviIndex(uint16_t frameCnt, bool isTL = false);
+bool fetchThumb(uint8_t **out, size_t *out_len);
+void finalizeAviIndex(bool isTL = false);
+bool findChecksum(const char* csvBuff, const char* fileName, size_t fileLen, char* crcStr);
 void finishAudio(bool isValid);
+void freeAviCrypt(aviCryptStruct& crypt);
+size_t getAudioChunk(uint8_t** chunkPtr);
+bool getAviCrypt(File& df, aviCryptStruct& crypt);
+size_t getAviHdr(uint8_t** hdrPtr, bool isTL = false);
+void getAviIdxStats(uint32_t& entryNs, uint32_t& pages, uint32_t& pageMs);
+bool getAviMeta(File& df, aviMetaStruct& aviMeta);
+bool getAviInfo(File& df, uint8_t* hdrBuff, size_t buffSize, aviInfoStruct& aviInfo);
+size_t getAviThumb(File& df, uint8_t* thumbBuff, size_t buffSize);
+size_t getDupChunk(uint8_t** chunkPtr);
+bool getFrameTime(const uint8_t* chunk, uint32_t& seq, int64_t& capUs);
+void getGovernorStats(uint8_t& fps, uint8_t& quality, uint32_t& steps);
+size_t getJpegTables(uint8_t** tablesPtr, size_t& insertPos);
+size_t getMoviStart(File& df, bool& isMultiRiff);
+bool getMp4Crypt(File& df, aviCryptStruct& crypt);
+uint32_t getRawExtent(const char* fileName, size_t& extentLen, uint8_t& drv);
+size_t getTablesChunk(uint8_t** chunkPtr);
+size_t getTimeChunk(uint8_t** chunkPtr, uint32_t seq, int64_t capUs);
 mjpegStruct getNextFrame(bool firstCall = false);
 bool getPIRval();
-bool haveWavFile(bool isTL = false);
+void getWriteRingStats(uint32_t& usedPct, uint32_t& maxPct, uint32_t& dropped, uint32_t& skipped);
+bool isAlignedAvi(File& df);
+bool isCompactAvi(File& df);
+bool isDupChunk(const uint8_t* chunk);
+char* loadChecksums(const char* folder);
+void loadJpegTables(File& df);
+bool mergeRecordings(const char* folder);
+void mp4AddAudio(const uint8_t* pcmData, size_t pcmLen);
+void mp4AddFrame(size_t jpegSize, uint32_t frameTime);
+size_t mp4FragAudio(uint8_t** audPtr);
+bool mp4FragDue(uint32_t frameTime);
+size_t mp4FragHdr(uint8_t** hdrPtr);
+size_t mp4FragSpace(uint8_t** spacePtr);
+bool odmlClose();
+bool odmlDue(size_t chunkLen);
+bool odmlFull();
+size_t odmlRiffHdr(uint8_t riffNum, uint8_t* hdrBuff);
+size_t odmlStep(uint8_t** chunkPtr);
 void openSDfile(const char* streamFile);
+void prepAviCrypt();
 void prepAviIndex(bool isTL = false);
+size_t prepMp4(uint8_t** initPtr, uint8_t frameType, bool hasAudio);
 bool prepRecording();
+size_t readJpegTables(File& df, uint8_t* tables, size_t& insertPos);
+size_t recoverAviIdx(File& df, size_t fileSize, uint8_t* scanBuff, size_t buffSize, uint32_t& frameCnt, bool& noKey);
+void recoverAviHdr(File& df, uint8_t FPS, uint8_t frameType, uint32_t frameCnt);
+size_t recoverMp4(File& df, uint32_t& frameCnt, bool& noKey);
+void segmentAviIndex();
+size_t stripJpegTables(const uint8_t* jpeg, size_t jpegLen, size_t& cutPos);
 void prepMic();
 float readTemperature(bool isCelsius);
+void setAviInfo(uint8_t* hdrBuff, aviInfoStruct& aviInfo);
+void setAviMeta(time_t startTime, uint32_t durationMs, uint8_t trigger, uint8_t motionPct);
 void setCamPan(int panVal);
 void setCamTilt(int tiltVal);
 uint8_t setFPS(uint8_t val);
 uint8_t setFPSlookup(uint8_t val);
 void setLamp(uint8_t lampVal);
 void startAudio();
+size_t startAviCrypt(uint8_t** chunkPtr, size_t moviStart, bool isTL = false);
+size_t startMp4Crypt(uint8_t** boxPtr, size_t boxPos);
 void startStreamServer();
 void stopPlaying();
+bool trimRecording(const char* trimArgs);
 size_t writeAviIndex(byte* clientBuf, size_t buffSize, bool isTL = false);
-size_t writeWavFile(byte* clientBuf, size_t buffSize);
+bool writeRawSectors(uint8_t drv, uint32_t sector, const uint8_t* data, size_t dataLen);
+size_t writeSegIndex(byte* clientBuf, size_t buffSize);
 
 
 /******************** Global app declarations *******************/
@@ -148,6 +263,33 @@ size_t writeWavFile(byte* clientBuf, size_t buffSize);
 extern int moveStartChecks; // checks per second for start motion
 extern int moveStopSecs; // secs between each check for stop, also determines post motion time
 extern int maxFrames; // maximum number of frames in video before auto close 
+extern bool haveSound; // current recording includes audio
+extern bool haveThumbs; // current recording includes thumbnail stream
+extern int thumbSecs; // interval between thumbnails in recording, 0 for none
+extern int segmentMins; // continuous recording in segments of given minutes, 0 for off
+extern bool useOpenDML; // use OpenDML (AVI 2.0) for recordings beyond 1GB
+extern bool useMP4; // record fragmented MP4 instead of AVI
+extern int mergeGapSecs; // merge recordings less than this apart, 0 for off
+extern char editStatus[]; // progress of background edit
+extern bool alignFrames; // pad frames to start on SD sector boundary
+extern size_t alignPadding; // total padding in current recording
+extern bool statsInName; // include FPS, duration and frame count in recording file name
+extern bool compactJpeg; // store repeated Huffman tables once per recording
+extern bool dupFrames; // store near duplicate frames of static scene as index entries only
+extern bool fileChecksum; // calculate CRC32 of each recording while it is written
+extern bool frameTimes; // save sequence number and capture time of each frame
+extern size_t tablesStripped; // total bytes of Huffman tables omitted from current recording
+extern bool useFilePool; // record into pre-allocated files to avoid FAT allocation delays
+extern int poolFileMB; // size of each pre-allocated file
+extern char Enc_Pass[]; // passphrase for encrypting recordings, none if empty
+extern bool rawSectors; // write recording direct to sectors of contiguous pool file, bypassing FAT
+extern int writeRingKB; // max PSRAM ring holding frames for SD writer task, 0 to write on capture task
+extern int preRollSecs; // secs of frames before capture started to include in recording, 0 for off
+extern int preRollKB; // PSRAM ring holding pre-roll frames
+extern bool useGovernor; // lower FPS and jpeg quality while recording if SD cannot keep up
+extern uint32_t maxOpenTime; // worst case file opening time
+extern uint32_t maxCloseTime; // worst case file closing time
+extern uint32_t maxCloseStall; // worst case capture stall when file closed
 
 // motion recording parameters
 extern int detectMotionFrames; // min sequence of changed frames to confirm motion 
@@ -172,6 +314,7 @@ extern uint8_t FPS;
 extern uint8_t fsizePtr; // index to frameData[] for record
 extern bool isCapturing;
 extern uint8_t lightLevel;  
+extern bool sceneChanged; // whether last motion check found change above threshold
 extern uint8_t lampLevel;  
 extern int micGain;
 extern uint8_t minSeconds; // default min video length (includes moveStopSecs time)
@@ -181,6 +324,7 @@ extern bool nightTime;
 extern bool stopPlayback;
 extern bool useMotion; // whether to use camera for motion detection (with motionDetect.cpp)  
 extern bool timeLapseOn; // enable time lapse recording
+extern bool tlIndexBusy; // time lapse index in use by live time lapse or timelapse compilation
 extern int maxFrames;
 extern char inFileName[];
 extern uint8_t xclkMhz;
@@ -191,6 +335,7 @@ extern byte chunk[];
 extern uint8_t aviHeader[];
 extern const uint8_t dcBuf[]; // 00dc
 extern const uint8_t wbBuf[]; // 01wb
+extern const uint8_t thBuf[]; // 02dc
 extern byte* uartData;
 
 // peripherals
@@ -243,7 +388,6 @@ extern float currentVoltage;
 
 // audio
 extern const uint32_t SAMPLE_RATE; // audio sample rate
-extern const uint32_t WAV_HEADER_LEN;
 
 // task handling
 extern TaskHandle_t playbackHandle;
@@ -254,6 +398,7 @@ extern TaskHandle_t emailHandle;
 extern TaskHandle_t ftpHandle;
 extern SemaphoreHandle_t frameMutex;
 extern SemaphoreHandle_t motionMutex;
+extern SemaphoreHandle_t aviMutex;
 
 // Websocket server
 #ifdef USE_WEBSOCKET_SERVER
@@ -16,6 +16,27 @@ bool updateAppStatus(const char* variable, const char* value) {
   else if(!strcmp(variable, "moveStartChecks")) moveStartChecks = intVal;
   else if(!strcmp(variable, "moveStopSecs")) moveStopSecs = intVal;
   else if(!strcmp(variable, "maxFrames")) maxFrames = intVal;
+  else if(!strcmp(variable, "useOpenDML")) useOpenDML = (bool)intVal;
+  else if(!strcmp(variable, "useFilePool")) useFilePool = (bool)intVal;
+  else if(!strcmp(variable, "alignFrames")) alignFrames = (bool)intVal;
+  else if(!strcmp(variable, "compactJpeg")) compactJpeg = (bool)intVal;
+  else if(!strcmp(variable, "dupFrames")) dupFrames = (bool)intVal;
+  else if(!strcmp(variable, "statsInName")) statsInName = (bool)intVal;
+  else if(!strcmp(variable, "fileChecksum")) fileChecksum = (bool)intVal;
+  else if(!strcmp(variable, "frameTimes")) frameTimes = (bool)intVal;
+  else if(!strcmp(variable, "poolFileMB")) poolFileMB = intVal;
+  else if(!strcmp(variable, "rawSectors")) rawSectors = checkRawSectors((bool)intVal);
+  else if(!strcmp(variable, "writeRingKB")) writeRingKB = intVal;
+  else if(!strcmp(variable, "preRollSecs")) preRollSecs = intVal;
+  else if(!strcmp(variable, "preRollKB")) preRollKB = intVal;
+  else if(!strcmp(variable, "useGovernor")) useGovernor = (bool)intVal;
+  else if(!strcmp(variable, "thumbSecs")) thumbSecs = intVal;
+  else if(!strcmp(variable, "segmentMins")) segmentMins = intVal;
+  else if(!strcmp(variable, "useMP4")) useMP4 = (bool)intVal;
+  else if(!strcmp(variable, "mergeGapSecs")) mergeGapSecs = intVal;
+  else if(!strcmp(variable, "merge")) mergeRecordings(value);
+  else if(!strcmp(variable, "trim")) trimRecording(value);
+  else if(!strcmp(variable, "compile")) compileRecordings(value);
   else if(!strcmp(variable, "detectMotionFrames")) detectMotionFrames = intVal;
   else if(!strcmp(variable, "detectNightFrames")) detectNightFrames = intVal;
   else if(!strcmp(variable, "detectNumBands")) detectNumBands = intVal;
@@ -182,6 +203,17 @@ void buildAppJsonString(bool filter) {
   p += sprintf(p, "\"wifi_rssi\":\"%i dBm\",", WiFi.RSSI() );  
   p += sprintf(p, "\"refreshVal\":%u,", refreshVal);  
   p += sprintf(p, "\"progressBar\":%u,", percentLoaded);  
+  p += sprintf(p, "\"fileOpenClose\":\"%u / %u ms\",", maxOpenTime, maxCloseTime);  
+  p += sprintf(p, "\"closeStall\":\"%u ms\",", maxCloseStall);  
+  uint32_t ringPct, ringMaxPct, ringDropped, ticksSkipped;
+  getWriteRingStats(ringPct, ringMaxPct, ringDropped, ticksSkipped);
+  p += sprintf(p, "\"writeRing\":\"%u%% (max %u%%), dropped %u / %u\",", ringPct, ringMaxPct, ringDropped, ticksSkipped);  
+  uint8_t govFPS, govQuality;
+  uint32_t govSteps;
+  getGovernorStats(govFPS, govQuality, govSteps);
+  if (useGovernor) p += sprintf(p, "\"governor\":\"FPS %u, quality %u, %u changes\",", govFPS, govQuality, govSteps);
+  else p += sprintf(p, "\"governor\":\"Off\",");
+  p += sprintf(p, "\"editStatus\":\"%s\",", editStatus);  
   if (percentLoaded == 100) percentLoaded = 0;
   //p += sprintf(p, "\"vcc\":\"%i V\",", ESP.getVcc() / 1023.0F; ); 
   if (!filter) p += sprintf(p, "\"sfile\":%s,", "\"None\"");
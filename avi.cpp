@@ -13,11 +13,39 @@ per jpeg:
  4 byte jpeg size
  jpeg frame content
 0-3 bytes filler to align on DWORD boundary
-per PCM (audio file)
+if alignFrames selected, JUNK chunk before each jpeg so that it starts on a sector boundary
+ 4 byte JUNK marker
+ 4 byte padding size
+ padding content
+if compactJpeg selected, JUNK chunk before first jpeg holding its Huffman tables, 
+which are then omitted from each jpeg having the same tables,
+so only app playback and edits, which reinsert the tables, can decode them, not downloaded or uploaded copies
+ 4 byte JUNK marker
+ 4 byte chunk size
+ 4 byte JDHT tag
+ 2 byte offset of tables in jpeg, 2 byte tables length
+ tables content, padded to DWORD boundary
+if dupFrames selected, JUNK chunk in place of each jpeg that repeats the previous one,
+whose index entry points to the previous jpeg
+ 4 byte JUNK marker
+ 4 byte chunk size (4)
+ 4 byte JDUP tag
+if Enc_Pass set, plaintext JUNK chunk at start of movi, with rest of movi content encrypted,
+for motion capture and time lapse recordings. OpenDML recordings are encrypted to end of file,
+including idx1 and each subsequent RIFF. See extras/decryptRecording.py to decrypt off device
+ 4 byte JUNK marker
+ 4 byte chunk size (28)
+ 4 byte JENC tag
+ 16 byte salt for deriving key from passphrase
+ 8 byte nonce for AES-CTR counter blocks
+per PCM (audio received since previous jpeg, interleaved before it)
  4 byte 01wb marker
  4 byte pcm size
  pcm content
- 0-3 bytes filler to align on DWORD boundary
+per thumbnail (grayscale motion detection image every thumbSecs, before jpeg)
+ 4 byte 02dc marker
+ 4 byte thumbnail size
+ thumbnail jpeg content
 footer:
  4 byte idx1 marker
  4 byte index size
@@ -31,15 +59,44 @@ footer:
   4 byte 0000
   4 byte pcm location
   4 byte pcm size
+ per thumbnail:
+  4 byte 02dc marker
+  4 byte 0000
+  4 byte thumbnail location
+  4 byte thumbnail size
+if thumbnails recorded, header has a third stream list (116 bytes) after the audio stream list
+motion capture header has an info list (44 bytes) before the movi list, with an IMET chunk 
+holding recording metadata as aviMetaStruct, so that it can be read without parsing the file name
+
+OpenDML (AVI 2.0) format, if useOpenDML selected:
+header:
+ as above, plus super index (indx) in each stream header list, 
+ and odml list (dmlh) containing total frame count
+first RIFF (AVI ), up to 1GB:
+ jpeg and pcm chunks as above
+ standard index chunk (ix00 / ix01) inserted after each 4096 entries
+ idx1 legacy index for the frames in this RIFF
+subsequent RIFFs (AVIX), each up to 1GB:
+ 4 byte RIFF marker, 4 byte RIFF size, 4 byte AVIX marker
+ 4 byte LIST marker, 4 byte movi size, 4 byte movi marker
+ jpeg, pcm, and standard index chunks as above
 */
 
 #include "appGlobals.h"
+#include "mbedtls/md.h"
+#include "mbedtls/pkcs5.h"
 
 // avi header data
 const uint8_t dcBuf[4] = {0x30, 0x30, 0x64, 0x63};   // 00dc
 const uint8_t wbBuf[4] = {0x30, 0x31, 0x77, 0x62};   // 01wb
+const uint8_t thBuf[4] = {0x30, 0x32, 0x64, 0x63};   // 02dc
 static const uint8_t idx1Buf[4] = {0x69, 0x64, 0x78, 0x31}; // idx1
 static const uint8_t zeroBuf[4] = {0x00, 0x00, 0x00, 0x00}; // 0000
+static const uint8_t ix00Buf[4] = {0x69, 0x78, 0x30, 0x30}; // ix00
+static const uint8_t ix01Buf[4] = {0x69, 0x78, 0x30, 0x31}; // ix01
+static const uint8_t indxBuf[4] = {0x69, 0x6E, 0x64, 0x78}; // indx
+static const uint8_t junkBuf[4] = {0x4A, 0x55, 0x4E, 0x4B}; // JUNK
+static const uint8_t metaBuf[4] = {0x49, 0x4D, 0x45, 0x54}; // IMET
 static uint8_t* idxBuf[2] = {NULL, NULL};
 
 uint8_t aviHeader[AVI_HEADER_LEN] = { // AVI header template
@@ -89,43 +146,472 @@ static const frameSizeStruct frameSizeData[] = {
 };
 
 #define IDX_ENTRY 16 // bytes per index entry
+#define IDX_PAGE RAMSIZE // index entries buffered before being appended to index file
+
+// OpenDML extensions
+#define ODML_RIFF_MAX (1024 * ONEMEG) // max size of each RIFF, as expected by players
+#define ODML_MAX_RIFF 8 // max number of RIFFs in a file
+#define ODML_IX_ENTRIES 4096 // entries per standard index chunk 
+#define ODML_IX_ENTRY 8 // bytes per standard index entry
+#define ODML_IX_HDR 32 // standard index chunk header length
+#define ODML_SUPER_ENTRIES 256 // max entries in each super index
+#define ODML_INDX_LEN (32 + (ODML_SUPER_ENTRIES * 16)) // super index chunk length
+#define ODML_LIST_LEN (20 + 248) // odml list with dmlh chunk
+#define ODML_HEADER_LEN (AVI_HEADER_LEN + (2 * ODML_INDX_LEN) + ODML_LIST_LEN)
+#define VID_STRL_END 0xCC // end of video stream list in aviHeader
+#define AUD_STRL_END 0x12A // end of audio stream list in aviHeader
+#define VID_STRL_POS 0x58 // video stream list in aviHeader
+#define THUMB_STRL_LEN (VID_STRL_END - VID_STRL_POS) // thumbnail stream list, copied from video
+#define THUMB_HEADER_LEN (AVI_HEADER_LEN + THUMB_STRL_LEN)
+#define THUMB_SEARCH 16 // chunks checked for thumbnail at start of movi
+#define INFO_LIST_LEN (12 + CHUNK_HDR + sizeof(aviMetaStruct)) // info list with metadata chunk
+#define AUD_STRL_POS (VID_STRL_END + ODML_INDX_LEN) // audio stream list in odmlHeader
+#define AUD_INDX_POS (AUD_STRL_POS + AUD_STRL_END - VID_STRL_END) // audio super index in odmlHeader
+#define ODML_LIST_POS (AUD_INDX_POS + ODML_INDX_LEN) // odml list in odmlHeader
+
+static const uint8_t avixHeader[AVIX_HDR] = { // start of each subsequent RIFF
+  0x52, 0x49, 0x46, 0x46, 0x00, 0x00, 0x00, 0x00, 0x41, 0x56, 0x49, 0x58, 
+  0x4C, 0x49, 0x53, 0x54, 0x00, 0x00, 0x00, 0x00, 0x6D, 0x6F, 0x76, 0x69
+};
+static const uint8_t odmlList[20] = { // LIST odml dmlh
+  0x4C, 0x49, 0x53, 0x54, 0x04, 0x01, 0x00, 0x00, 0x6F, 0x64, 0x6D, 0x6C, 
+  0x64, 0x6D, 0x6C, 0x68, 0xF8, 0x00, 0x00, 0x00
+};
 
 // separate index for motion capture and timelapse
 static size_t idxPtr[2];
 static size_t idxOffset[2];
 static size_t moviSize[2];
 static size_t audSize;
-static size_t indexLen[2];
-static File wavFile;
-bool haveSoundFile = false;
+static uint32_t audChunks; // number of interleaved audio chunks
+static size_t indexLen[2]; // bytes of index entries, excluding header
+static File idxFile[2]; // index file, appended to avi when finalized
+static uint32_t idxBuildTime, idxBuildCnt; // recording index timing, in usecs
+static uint32_t idxPageTime, idxPages;
+static File segIdxFile; // index of finished segment, appended while next segment recorded
+static size_t segIdxLen;
+static size_t segIdxDone; // bytes of index appended to finished recording
+static bool segIdxHdr;
+bool haveSound = false;
+
+// low resolution thumbnail stream, motion capture only
+bool haveThumbs = false;
+static uint32_t thumbCnt;
+static uint8_t thumbHeader[THUMB_HEADER_LEN + INFO_LIST_LEN]; // aviHeader with thumbnail stream list inserted
+
+// recording metadata in info list, motion capture only
+static size_t infoLen; // length of info list in header, 0 if none
+static aviMetaStruct recMeta;
+static uint8_t recHeader[AVI_HEADER_LEN + INFO_LIST_LEN]; // aviHeader with info list inserted
+
+// sector alignment of frames, motion capture only
+static bool isAligned = false;
+static uint8_t junkChunk[SECTOR_SIZE + CHUNK_HDR]; // padding content is zero
+size_t alignPadding = 0; // total padding in current recording
+
+// Huffman tables held once per recording instead of in each frame, motion capture only
+static const uint8_t tablesTag[4] = {0x4A, 0x44, 0x48, 0x54}; // "JDHT"
+static uint8_t tablesChunk[CHUNK_HDR + 8 + JPEG_TABLES_MAX]; // JUNK chunk holding tables
+static size_t tablesLen, tablesPos; // tables length and offset in frame
+static bool tablesPending, isCompact;
+size_t tablesStripped = 0; // total bytes removed from current recording
+static uint8_t* playTables = NULL; // tables for reinsertion on playback
+static size_t playTablesLen, playTablesPos;
+
+// repeated frames stored as index entries only, motion capture only
+static const uint8_t dupTag[4] = {0x4A, 0x44, 0x55, 0x50}; // "JDUP"
+static uint8_t dupChunk[CHUNK_HDR + 4]; // JUNK chunk marking repeat
 
+// sequence number and capture time of each frame, motion capture only
+static const uint8_t timeTag[4] = {0x46, 0x54, 0x49, 0x4D}; // "FTIM"
+static uint8_t timeChunk[TIME_CHUNK_LEN]; // JUNK chunk preceding frame
+static size_t lastVidOffset, lastVidSize; // index details of previous frame
+static uint32_t dupCnt; // repeated frames in current recording
+
+// OpenDML state, motion capture only
+static bool isODML = false;
+static uint8_t* odmlHeader = NULL; // header including super indexes
+static uint8_t* ixBuf[2] = {NULL, NULL}; // standard index for video and audio
+static uint32_t ixCnt[2]; // entries in current standard index
+static uint32_t ixDuration[2]; // duration covered by current standard index
+static size_t ixBase[2]; // file position that standard index offsets are relative to
+static uint32_t superCnt[2]; // entries in super index
+static bool ixPending[2];
+static bool idx1Pending, idx1Reading, riffPending, odmlClosing;
+static size_t aviPos; // file position of next chunk
+static size_t riffPos[ODML_MAX_RIFF]; // file position of each RIFF
+static size_t moviEnd[ODML_MAX_RIFF]; // file position of end of each movi list
+static uint8_t riffCnt; // current RIFF 
+static uint32_t idx1Frames; // frames in legacy index
+static size_t recoverStart; // start of movi data in recovered avi
+
+
+static void prepOdml() {
+  // prep OpenDML header and standard index buffers for motion capture
+  if (odmlHeader == NULL) odmlHeader = (uint8_t*)ps_malloc(ODML_HEADER_LEN + INFO_LIST_LEN);
+  for (int i = 0; i < 2; i++) 
+    if (ixBuf[i] == NULL) ixBuf[i] = (uint8_t*)ps_malloc(ODML_IX_HDR + (ODML_IX_ENTRIES * ODML_IX_ENTRY));
+  if (odmlHeader == NULL || ixBuf[0] == NULL || ixBuf[1] == NULL) {
+    LOG_ERR("Insufficient memory for OpenDML, using legacy AVI");
+    isODML = false;
+    return;
+  }
+  memset(odmlHeader, 0, ODML_HEADER_LEN + INFO_LIST_LEN); // clears super indexes
+  ixCnt[0] = ixCnt[1] = ixDuration[0] = ixDuration[1] = superCnt[0] = superCnt[1] = 0;
+  ixPending[0] = ixPending[1] = idx1Pending = idx1Reading = riffPending = odmlClosing = false;
+  riffCnt = idx1Frames = 0;
+  riffPos[0] = moviEnd[0] = 0;
+  aviPos = ODML_HEADER_LEN + infoLen;
+}
 
 void prepAviIndex(bool isTL) {
   // prep buffer to store index data, gets appended to end of file
-  if (idxBuf[isTL] == NULL) idxBuf[isTL] = (uint8_t*)ps_malloc((maxFrames+1)*IDX_ENTRY); // include some space for audio index
-  memcpy(idxBuf[isTL], idx1Buf, 4); // index header
-  idxPtr[isTL] = CHUNK_HDR;  // leave 4 bytes for index size
-  moviSize[isTL] = indexLen[isTL] = 0;
+  // index is held in a page buffer, with full pages appended to index file
+  if (idxBuf[isTL] == NULL) idxBuf[isTL] = (uint8_t*)ps_malloc(IDX_PAGE);
+  const char* idxName = isTL ? TLIDXTEMP : IDXTEMP;
+  if (SD_MMC.exists(idxName)) SD_MMC.remove(idxName);
+  idxPtr[isTL] = moviSize[isTL] = indexLen[isTL] = 0;
+  if (!isTL) {
+    audSize = audChunks = alignPadding = tablesStripped = tablesLen = 0;
+    lastVidOffset = lastVidSize = dupCnt = 0;
+    idxBuildTime = idxBuildCnt = idxPageTime = idxPages = 0;
+    haveSound = false;
+    isAligned = alignFrames;
+    isCompact = compactJpeg;
+    infoLen = INFO_LIST_LEN;
+    memset(&recMeta, 0, sizeof(recMeta));
+    tablesPending = false;
+    isODML = useOpenDML && !segmentMins; // segments are rotated well before 1GB
+    if (isODML) prepOdml();
+    // thumbnail stream not indexed by OpenDML super indexes
+    haveThumbs = thumbSecs && useMotion && !isODML;
+    thumbCnt = 0;
+  }
+}
+
+size_t getAviHdr(uint8_t** hdrPtr, bool isTL) {
+  // provide header to be written at start of file, motion capture header includes info list
+  if (isTL) {
+    *hdrPtr = aviHeader;
+    return AVI_HEADER_LEN;
+  }
+  if (isODML) {
+    *hdrPtr = odmlHeader;
+    return ODML_HEADER_LEN + infoLen;
+  }
+  if (haveThumbs) {
+    *hdrPtr = thumbHeader;
+    return THUMB_HEADER_LEN + infoLen;
+  }
+  *hdrPtr = recHeader;
+  return AVI_HEADER_LEN + infoLen;
+}
+
+static void buildInfoList(uint8_t* infoPos) {
+  // info list holding recording metadata, inserted before movi list
+  if (!infoLen) return;
+  uint32_t listSize = INFO_LIST_LEN - CHUNK_HDR;
+  memcpy(infoPos, "LIST", 4);
+  memcpy(infoPos+4, &listSize, 4);
+  memcpy(infoPos+8, "INFO", 4);
+  memcpy(infoPos+12, metaBuf, 4);
+  uint32_t metaSize = sizeof(aviMetaStruct);
+  memcpy(infoPos+16, &metaSize, 4);
+  memcpy(infoPos+20, &recMeta, sizeof(aviMetaStruct));
+}
+
+void setAviMeta(time_t startTime, uint32_t durationMs, uint8_t trigger, uint8_t motionPct) {
+  // recording details held in info list, called before buildAviHdr()
+  recMeta.startTime = startTime;
+  recMeta.duration = durationMs;
+  recMeta.trigger = trigger;
+  recMeta.motionPct = motionPct;
+}
+
+/************** encryption ***************/
+
+// movi content of recordings encrypted with AES-256-CTR when passphrase set,
+// keystream derived from file position so any part of file can be decrypted independently,
+// and content patched after written is encrypted at its position.
+// Key is derived from passphrase and a random salt with PBKDF2, salt and a random nonce are held 
+// in a plaintext JENC chunk at start of movi, written when recording opened so that it can be recovered.
+// MP4 recordings hold the same in a free box after the init segment, with the rest of file encrypted
+#define CRYPT_SALT_LEN 16
+#define CRYPT_CHUNK_LEN (CHUNK_HDR + 4 + CRYPT_SALT_LEN + AES_NONCE_LEN)
+#define CRYPT_KDF_ITERATIONS 10000 // PBKDF2-HMAC-SHA256 rounds, only repeated when salt changes
+char Enc_Pass[MAX_PWD_LEN] = ""; // recordings encryption passphrase, encryption off if empty
+static const uint8_t cryptTag[4] = {0x4A, 0x45, 0x4E, 0x43}; // "JENC"
+static uint8_t cryptChunk[CRYPT_CHUNK_LEN];
+static aviCryptStruct recCrypt; // used by writer of current recording only
+static aviCryptStruct tlCrypt; // used by writer of current time lapse only
+static uint8_t tlCryptChunk[CRYPT_CHUNK_LEN];
+static char recKeyPass[MAX_PWD_LEN] = ""; // passphrase that recording key was derived from
+static uint8_t recSalt[CRYPT_SALT_LEN];
+// last key derived, shared by recording and readers of recordings
+static SemaphoreHandle_t keyMutex = NULL;
+static char keyPass[MAX_PWD_LEN] = ""; 
+static uint8_t keySalt[CRYPT_SALT_LEN];
+static uint8_t aviKey[32];
+
+static bool setAviKey(const uint8_t* salt, mbedtls_aes_context& aesCtx) {
+  // load key for passphrase and salt into context, deriving it if not the last key used
+  if (!strlen(Enc_Pass) || keyMutex == NULL) return false;
+  xSemaphoreTake(keyMutex, portMAX_DELAY);
+  if (strcmp(keyPass, Enc_Pass) || memcmp(keySalt, salt, CRYPT_SALT_LEN)) {
+    uint32_t kTime = millis();
+    mbedtls_md_context_t mdCtx;
+    mbedtls_md_init(&mdCtx);
+    mbedtls_md_setup(&mdCtx, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 1);
+    mbedtls_pkcs5_pbkdf2_hmac(&mdCtx, (const uint8_t*)Enc_Pass, strlen(Enc_Pass), salt, CRYPT_SALT_LEN, 
+      CRYPT_KDF_ITERATIONS, sizeof(aviKey), aviKey);
+    mbedtls_md_free(&mdCtx);
+    strcpy(keyPass, Enc_Pass);
+    memcpy(keySalt, salt, CRYPT_SALT_LEN);
+    LOG_INF("Derived recording key in %lu ms", millis() - kTime);
+  }
+  mbedtls_aes_setkey_enc(&aesCtx, aviKey, 256);
+  xSemaphoreGive(keyMutex);
+  return true;
+}
+
+static bool prepRecKey() {
+  // key for recordings, with new salt when passphrase changed or after restart
+  if (!strlen(Enc_Pass)) return false;
+  if (strcmp(recKeyPass, Enc_Pass)) {
+    esp_fill_random(recSalt, CRYPT_SALT_LEN);
+    if (!setAviKey(recSalt, recCrypt.aesCtx)) return false;
+    strcpy(recKeyPass, Enc_Pass);
+  }
+  return true;
+}
+
+void prepAviCrypt() {
+  // derive recording key at startup, rather than when first recording started
+  keyMutex = xSemaphoreCreateMutex();
+  mbedtls_aes_init(&recCrypt.aesCtx);
+  mbedtls_aes_init(&tlCrypt.aesCtx);
+  prepRecKey();
+}
+
+static void buildCryptChunk(uint8_t* chunk, aviCryptStruct& crypt, size_t chunkPos) {
+  // JENC chunk or box with new nonce, content following it is encrypted
+  // random nonce per recording, as start times can repeat if clock not set
+  esp_fill_random(crypt.nonce, AES_NONCE_LEN);
+  crypt.cryptStart = chunkPos + CRYPT_CHUNK_LEN;
+  crypt.cryptEnd = SIZE_MAX;
+  memcpy(chunk+8, cryptTag, 4);
+  memcpy(chunk+12, recSalt, CRYPT_SALT_LEN);
+  memcpy(chunk+12+CRYPT_SALT_LEN, crypt.nonce, AES_NONCE_LEN);
+}
+
+size_t startAviCrypt(uint8_t** chunkPtr, size_t moviStart, bool isTL) {
+  // set up encryption of recording, called after prepAviIndex() with file position of movi content
+  // provides JENC chunk to be written at moviStart, or returns 0 if recording not to be encrypted
+  if (!isTL) recMeta.encrypted = 0;
+  if (!prepRecKey()) return 0;
+  // time lapse keeps key of its start, as it spans recordings
+  if (isTL && !setAviKey(recSalt, tlCrypt.aesCtx)) return 0;
+  uint8_t* chunk = isTL ? tlCryptChunk : cryptChunk;
+  uint32_t junkSize = CRYPT_CHUNK_LEN - CHUNK_HDR;
+  memcpy(chunk, junkBuf, 4);
+  memcpy(chunk+4, &junkSize, 4);
+  buildCryptChunk(chunk, isTL ? tlCrypt : recCrypt, moviStart);
+  // include in avi sizes and index offsets
+  moviSize[isTL] += CRYPT_CHUNK_LEN;
+  idxOffset[isTL] += CRYPT_CHUNK_LEN;
+  if (!isTL) {
+    aviPos += CRYPT_CHUNK_LEN;
+    recMeta.encrypted = 1;
+  }
+  *chunkPtr = chunk;
+  return CRYPT_CHUNK_LEN;
+}
+
+size_t startMp4Crypt(uint8_t** boxPtr, size_t boxPos) {
+  // set up encryption of MP4 recording, called with file position after init segment
+  // provides free box holding JENC details to be written at boxPos, or returns 0 if not to be encrypted
+  if (!prepRecKey()) return 0;
+  uint32_t boxSize = __builtin_bswap32(CRYPT_CHUNK_LEN);
+  memcpy(cryptChunk, &boxSize, 4);
+  memcpy(cryptChunk+4, "free", 4);
+  buildCryptChunk(cryptChunk, recCrypt, boxPos);
+  *boxPtr = cryptChunk;
+  return CRYPT_CHUNK_LEN;
+}
+
+static bool loadAviCrypt(const uint8_t* chunk, size_t chunkPos, aviCryptStruct& crypt) {
+  // set up decryption from JENC chunk or box at chunkPos, false if not present or no passphrase
+  if (memcmp(chunk+CHUNK_HDR, cryptTag, 4)) return false;
+  mbedtls_aes_init(&crypt.aesCtx);
+  if (!setAviKey(chunk+12, crypt.aesCtx)) {
+    mbedtls_aes_free(&crypt.aesCtx);
+    LOG_ERR("Recording is encrypted, but no passphrase set");
+    return false;
+  }
+  memcpy(crypt.nonce, chunk+12+CRYPT_SALT_LEN, AES_NONCE_LEN);
+  crypt.cryptStart = chunkPos + CRYPT_CHUNK_LEN;
+  crypt.cryptEnd = SIZE_MAX;
+  return true;
+}
+
+bool getAviCrypt(File& df, aviCryptStruct& crypt) {
+  // set up decryption of stored recording, false if not encrypted or no passphrase
+  // if true, freeAviCrypt() to be called when finished, file position is changed
+  bool isMultiRiff;
+  uint8_t chunk[CRYPT_CHUNK_LEN];
+  uint32_t chunkSize;
+  size_t moviStart = getMoviStart(df, isMultiRiff);
+  df.seek(moviStart, SeekSet);
+  if (df.read(chunk, CRYPT_CHUNK_LEN) != CRYPT_CHUNK_LEN || memcmp(chunk, junkBuf, 4)) return false;
+  memcpy(&chunkSize, chunk+4, 4);
+  if (chunkSize != CRYPT_CHUNK_LEN - CHUNK_HDR || !loadAviCrypt(chunk, moviStart, crypt)) return false;
+  // OpenDML recording is encrypted to end of file, legacy idx1 is not encrypted
+  uint8_t indxTag[4] = {0};
+  df.seek(VID_STRL_END, SeekSet);
+  df.read(indxTag, 4);
+  if (!memcmp(indxTag, indxBuf, 4)) return true;
+  uint32_t moviListSize = 0;
+  df.seek(moviStart - 8, SeekSet);
+  df.read((uint8_t*)&moviListSize, 4);
+  if (moviListSize > 4) crypt.cryptEnd = moviStart + moviListSize - 4; // not set if unfinished
+  return true;
+}
+
+bool getMp4Crypt(File& df, aviCryptStruct& crypt) {
+  // set up decryption of stored MP4 recording from free box following init segment,
+  // false if not encrypted or no passphrase, if true, freeAviCrypt() to be called when finished
+  uint8_t box[CRYPT_CHUNK_LEN];
+  size_t boxPos = 0;
+  for (int i = 0; i < 3; i++) {
+    // ftyp, moov, then free box if encrypted
+    df.seek(boxPos, SeekSet);
+    if (df.read(box, CRYPT_CHUNK_LEN) != CRYPT_CHUNK_LEN) return false;
+    uint32_t boxLen = (box[0] << 24) | (box[1] << 16) | (box[2] << 8) | box[3];
+    if (!memcmp(box+4, "free", 4)) return boxLen == CRYPT_CHUNK_LEN && loadAviCrypt(box, boxPos, crypt);
+    if (boxLen < CHUNK_HDR) return false;
+    boxPos += boxLen;
+  }
+  return false;
 }
 
-void buildAviHdr(uint8_t FPS, uint8_t frameType, uint16_t frameCnt, bool isTL) {
+void freeAviCrypt(aviCryptStruct& crypt) {
+  mbedtls_aes_free(&crypt.aesCtx);
+}
+
+void cryptAvi(aviCryptStruct& crypt, uint8_t* data, size_t dataLen, size_t filePos) {
+  // encrypt or decrypt part of data at filePos that lies within encrypted range, in place,
+  // using counter block for its position in file
+  size_t fromPos = std::max(filePos, crypt.cryptStart);
+  size_t toPos = std::min(filePos + dataLen, crypt.cryptEnd);
+  if (fromPos >= toPos) return;
+  uint8_t ctrBlock[16], streamBlock[16];
+  uint64_t blockNum = fromPos / 16;
+  memcpy(ctrBlock, crypt.nonce, AES_NONCE_LEN);
+  for (int i = 0; i < 8; i++) ctrBlock[15 - i] = (blockNum >> (i * 8)) & 0xFF;
+  size_t streamOffset = fromPos % 16;
+  if (streamOffset) {
+    // start part way through keystream block, so generate it and advance counter
+    mbedtls_aes_crypt_ecb(&crypt.aesCtx, MBEDTLS_AES_ENCRYPT, ctrBlock, streamBlock);
+    for (int i = 15; i >= AES_NONCE_LEN && !++ctrBlock[i]; i--);
+  }
+  uint8_t* cryptData = data + fromPos - filePos;
+  mbedtls_aes_crypt_ctr(&crypt.aesCtx, toPos - fromPos, &streamOffset, ctrBlock, streamBlock, cryptData, cryptData);
+}
+
+void encryptAvi(uint8_t* data, size_t dataLen, size_t filePos, bool isTL) {
+  // encrypt recording or time lapse content before it is written at given file position
+  cryptAvi(isTL ? tlCrypt : recCrypt, data, dataLen, filePos);
+}
+
+static size_t readAvi(File& df, uint8_t* buff, size_t buffLen, aviCryptStruct* crypt) {
+  // read from current file position, decrypting if crypt provided
+  size_t filePos = df.position();
+  size_t readLen = df.read(buff, buffLen);
+  if (crypt != NULL) cryptAvi(*crypt, buff, readLen, filePos);
+  return readLen;
+}
+
+static void buildOdmlHdr(uint32_t frameCnt) {
+  // compose OpenDML header from updated aviHeader template, around super indexes 
+  memcpy(odmlHeader, aviHeader, VID_STRL_END);
+  memcpy(odmlHeader+AUD_STRL_POS, aviHeader+VID_STRL_END, AUD_STRL_END-VID_STRL_END);
+  memcpy(odmlHeader+ODML_LIST_POS, odmlList, sizeof(odmlList));
+  memcpy(odmlHeader+ODML_LIST_POS+sizeof(odmlList), &frameCnt, 4); // total frames in all RIFFs
+  buildInfoList(odmlHeader+ODML_HEADER_LEN-12);
+  memcpy(odmlHeader+ODML_HEADER_LEN+infoLen-12, aviHeader+AUD_STRL_END, 12); // movi list
+  // increase list sizes for inserted chunks
+  uint32_t listSize = 0x116 + (2 * ODML_INDX_LEN) + ODML_LIST_LEN;
+  memcpy(odmlHeader+0x10, &listSize, 4); // hdrl
+  listSize = 0x6C + ODML_INDX_LEN;
+  memcpy(odmlHeader+0x5C, &listSize, 4); // video strl
+  listSize = 0x56 + ODML_INDX_LEN;
+  memcpy(odmlHeader+AUD_STRL_POS+4, &listSize, 4); // audio strl
+  // super index headers
+  for (int i = 0; i < 2; i++) {
+    uint8_t* indx = odmlHeader + (i ? AUD_INDX_POS : VID_STRL_END);
+    memcpy(indx, indxBuf, 4);
+    uint32_t indxSize = ODML_INDX_LEN - CHUNK_HDR;
+    memcpy(indx+4, &indxSize, 4);
+    indx[8] = 4; // longs per entry
+    indx[9] = indx[10] = indx[11] = 0; // index of indexes
+    memcpy(indx+12, &superCnt[i], 4);
+    memcpy(indx+16, i ? wbBuf : dcBuf, 4);
+  }
+  // first RIFF only has frames in legacy index
+  size_t riffEnd = riffCnt ? riffPos[1] : aviPos; 
+  uint32_t riffSize = riffEnd - CHUNK_HDR;
+  memcpy(odmlHeader+4, &riffSize, 4);
+  memcpy(odmlHeader+0x30, &idx1Frames, 4);
+  uint32_t moviLen = moviEnd[0] - ODML_HEADER_LEN - infoLen + 4; 
+  memcpy(odmlHeader+ODML_HEADER_LEN+infoLen-8, &moviLen, 4);
+}
+
+static void buildThumbHdr(uint8_t frameType) {
+  // compose header with thumbnail stream list inserted after audio stream list
+  memcpy(thumbHeader, aviHeader, AUD_STRL_END);
+  uint8_t* strl = thumbHeader + AUD_STRL_END;
+  memcpy(strl, aviHeader+VID_STRL_POS, THUMB_STRL_LEN);
+  buildInfoList(thumbHeader+THUMB_HEADER_LEN-12);
+  memcpy(thumbHeader+THUMB_HEADER_LEN+infoLen-12, aviHeader+AUD_STRL_END, 12); // movi list
+  uint32_t listSize = 0x116 + THUMB_STRL_LEN;
+  memcpy(thumbHeader+0x10, &listSize, 4); // hdrl
+  // thumbnail rate is 1 per thumbSecs
+  uint32_t thumbScale = thumbSecs;
+  uint32_t thumbRate = 1;
+  memcpy(strl+0x28, &thumbScale, 4);
+  memcpy(strl+0x2C, &thumbRate, 4);
+  memcpy(strl+0x34, &thumbCnt, 4);
+  // thumbnail is downscaled motion detection image
+  uint8_t downsize = pow(2, frameData[frameType].scaleFactor) * frameData[frameType].sampleRate;
+  uint32_t thumbWidth = frameData[frameType].frameWidth / downsize;
+  uint32_t thumbHeight = frameData[frameType].frameHeight / downsize;
+  memcpy(strl+0x50, &thumbWidth, 4);
+  memcpy(strl+0x54, &thumbHeight, 4);
+}
+
+void buildAviHdr(uint8_t FPS, uint8_t frameType, uint32_t frameCnt, bool isTL) {
   // update AVI header template with file specific details
-  size_t aviSize = moviSize[isTL] + AVI_HEADER_LEN + ((CHUNK_HDR+IDX_ENTRY) * (frameCnt+(haveSoundFile?1:0))); // AVI content size 
+  bool withThumbs = haveThumbs && !isTL;
+  uint32_t chunkCnt = frameCnt + (isTL ? 0 : audChunks + thumbCnt);
+  uint32_t dupFrames = isTL ? 0 : dupCnt; // indexed without chunk
+  size_t hdrLen = (withThumbs ? THUMB_HEADER_LEN : AVI_HEADER_LEN) + (isTL ? 0 : infoLen);
+  size_t aviSize = moviSize[isTL] + hdrLen + (CHUNK_HDR * (chunkCnt - dupFrames)) + (IDX_ENTRY * chunkCnt); // AVI content size 
   // update aviHeader with relevant stats
   memcpy(aviHeader+4, &aviSize, 4);
   uint32_t usecs = (uint32_t)round(1000000.0f / FPS); // usecs_per_frame 
   memcpy(aviHeader+0x20, &usecs, 4); 
-  memcpy(aviHeader+0x30, &frameCnt, 2);
-  memcpy(aviHeader+0x8C, &frameCnt, 2);
+  uint32_t padGranularity = (isAligned && !isTL) ? SECTOR_SIZE : 0;
+  memcpy(aviHeader+0x28, &padGranularity, 4); 
+  memcpy(aviHeader+0x30, &frameCnt, 4);
+  memcpy(aviHeader+0x8C, &frameCnt, 4);
   memcpy(aviHeader+0x84, &FPS, 1);
-  uint32_t dataSize = moviSize[isTL] + ((frameCnt+(haveSoundFile?1:0)) * CHUNK_HDR) + 4; 
+  uint32_t dataSize = moviSize[isTL] + ((chunkCnt - dupFrames) * CHUNK_HDR) + 4; 
   memcpy(aviHeader+0x12E, &dataSize, 4); // data size 
-  uint8_t withAudio = 2; // increase number of streams for audio
+  // increase number of streams for audio, and for thumbnails which follow audio stream
+  uint8_t streamCnt = withThumbs ? 3 : (haveSound && !isTL ? 2 : 1);
+  memcpy(aviHeader+0x38, &streamCnt, 1); 
   if (isTL) memcpy(aviHeader+0x100, zeroBuf, 4); // no audio for timelapse
-  else {
-    if (haveSoundFile) memcpy(aviHeader+0x38, &withAudio, 1); 
-    memcpy(aviHeader+0x100, &audSize, 4); // audio data size
-  }
+  else memcpy(aviHeader+0x100, &audSize, 4); // audio data size
   // apply video framesize to avi header
   memcpy(aviHeader+0x40, frameSizeData[frameType].frameWidth, 2);
   memcpy(aviHeader+0xA8, frameSizeData[frameType].frameWidth, 2);
@@ -137,85 +623,730 @@ void buildAviHdr(uint8_t FPS, uint8_t frameType, uint16_t frameCnt, bool isTL) {
   memcpy(aviHeader+0x104, &bytesPerSec, 4); // suggested buffer size
   memcpy(aviHeader+0x11C, &SAMPLE_RATE, 4);
   memcpy(aviHeader+0x120, &bytesPerSec, 4); // bytes per sec
+  if (!isTL) {
+    // recording metadata for info list
+    recMeta.frameCnt = frameCnt;
+    recMeta.recFPS = FPS;
+    recMeta.frameType = frameType;
+    recMeta.sampleRate = haveSound ? SAMPLE_RATE : 0;
+    recMeta.sampleBits = haveSound ? 16 : 0;
+    recMeta.channels = haveSound ? 1 : 0;
+    if (isODML) buildOdmlHdr(frameCnt);
+    else if (withThumbs) buildThumbHdr(frameType);
+    else {
+      memcpy(recHeader, aviHeader, AUD_STRL_END);
+      buildInfoList(recHeader+AUD_STRL_END);
+      memcpy(recHeader+AUD_STRL_END+infoLen, aviHeader+AUD_STRL_END, 12); // movi list
+    }
+  }
 
-  // reset state for next recording
-  moviSize[isTL] = idxOffset[isTL] = idxPtr[isTL] = 0;
+  // reset state for next recording, index page is only reset when flushed
+  // so header can be built before index is finalized
+  moviSize[isTL] = idxOffset[isTL] = 0;
 }
 
-void buildAviIdx(size_t dataSize, bool isVid, bool isTL) {
-  // build AVI video index into buffer - 16 bytes per frame
-  // called from saveFrame() for each frame
-  moviSize[isTL] += dataSize;
-  if (isVid) memcpy(idxBuf[isTL]+idxPtr[isTL], dcBuf, 4);
-  else memcpy(idxBuf[isTL]+idxPtr[isTL], wbBuf, 4);
+static void flushIdxPage(bool isTL) {
+  // append index page to index file, opened each time to avoid holding file handle
+  if (!idxPtr[isTL]) return;
+  File pageFile = SD_MMC.open(isTL ? TLIDXTEMP : IDXTEMP, FILE_APPEND);
+  if (!pageFile || pageFile.write(idxBuf[isTL], idxPtr[isTL]) != idxPtr[isTL]) 
+    LOG_ERR("Failed to write AVI index page");
+  pageFile.close();
+  idxPtr[isTL] = 0;
+}
+
+static void writeIdxEntry(const uint8_t* chunkId, uint32_t chunkOffset, size_t dataSize, bool isTL) {
+  // add idx1 entry to index page, appending full page to index file
+  memcpy(idxBuf[isTL]+idxPtr[isTL], chunkId, 4);
   memcpy(idxBuf[isTL]+idxPtr[isTL]+4, zeroBuf, 4);
-  memcpy(idxBuf[isTL]+idxPtr[isTL]+8, &idxOffset[isTL], 4); 
+  memcpy(idxBuf[isTL]+idxPtr[isTL]+8, &chunkOffset, 4); 
   memcpy(idxBuf[isTL]+idxPtr[isTL]+12, &dataSize, 4); 
-  idxOffset[isTL] += dataSize + CHUNK_HDR;
   idxPtr[isTL] += IDX_ENTRY; 
+  indexLen[isTL] += IDX_ENTRY;
+  if (idxPtr[isTL] >= IDX_PAGE) {
+    uint32_t pTime = micros();
+    flushIdxPage(isTL);
+    if (!isTL) {
+      idxPageTime += micros() - pTime;
+      idxPages++;
+    }
+  }
+}
+
+static void addIdxEntry(size_t dataSize, const uint8_t* chunkId, bool isTL) {
+  bool isVid = chunkId == dcBuf;
+  moviSize[isTL] += dataSize;
+  if (chunkId == wbBuf) {
+    audSize += dataSize;
+    audChunks++;
+    haveSound = true;
+  }
+  if (isODML && !isTL) {
+    // add entry to OpenDML standard index, with offset to chunk data
+    int s = isVid ? 0 : 1;
+    if (ixCnt[s] < ODML_IX_ENTRIES) {
+      if (!ixCnt[s]) ixBase[s] = aviPos;
+      uint32_t ixOffset = aviPos + CHUNK_HDR - ixBase[s];
+      uint8_t* ixEntry = ixBuf[s] + ODML_IX_HDR + (ixCnt[s] * ODML_IX_ENTRY);
+      memcpy(ixEntry, &ixOffset, 4);
+      memcpy(ixEntry+4, &dataSize, 4); // all frames are key frames
+      ixCnt[s]++;
+      ixDuration[s] += isVid ? 1 : dataSize / 2; // audio duration in samples
+    } else LOG_ERR("OpenDML standard index full");
+    idxOffset[isTL] = aviPos - ODML_HEADER_LEN - infoLen; 
+    aviPos += dataSize + CHUNK_HDR;
+    // legacy index only covers first RIFF
+    if (riffCnt) return;
+    if (isVid) idx1Frames++;
+  }
+  if (isVid && !isTL) {
+    lastVidOffset = idxOffset[isTL];
+    lastVidSize = dataSize;
+  }
+  writeIdxEntry(chunkId, idxOffset[isTL], dataSize, isTL);
+  idxOffset[isTL] += dataSize + CHUNK_HDR;
+}
+
+void buildAviIdx(size_t dataSize, bool isVid, bool isTL) {
+  // build AVI video index into buffer - 16 bytes per frame
+  // called from saveFrame() for each frame and audio chunk
+  uint32_t bTime = micros();
+  addIdxEntry(dataSize, isVid ? dcBuf : wbBuf, isTL);
+  if (!isTL) {
+    idxBuildTime += micros() - bTime;
+    idxBuildCnt++;
+  }
+}
+
+void buildThumbIdx(size_t dataSize) {
+  // add thumbnail chunk to motion capture index
+  addIdxEntry(dataSize, thBuf, false);
+  thumbCnt++;
+}
+
+size_t getDupChunk(uint8_t** chunkPtr) {
+  // repeat previous frame via an index entry pointing to its chunk, instead of storing it again
+  // provides JUNK chunk marking the repeat for playback, or returns 0 if frame has to be stored
+  if (isODML || !lastVidSize) return 0;
+  uint32_t bTime = micros();
+  writeIdxEntry(dcBuf, lastVidOffset, lastVidSize, false);
+  uint32_t junkSize = sizeof(dupTag);
+  memcpy(dupChunk, junkBuf, 4);
+  memcpy(dupChunk+4, &junkSize, 4);
+  memcpy(dupChunk+8, dupTag, 4);
+  // include in avi sizes and index offsets
+  moviSize[0] += sizeof(dupChunk);
+  idxOffset[0] += sizeof(dupChunk);
+  aviPos += sizeof(dupChunk);
+  dupCnt++;
+  idxBuildTime += micros() - bTime;
+  idxBuildCnt++;
+  *chunkPtr = dupChunk;
+  return sizeof(dupChunk);
+}
+
+size_t getTimeChunk(uint8_t** chunkPtr, uint32_t seq, int64_t capUs) {
+  // provide JUNK chunk holding sequence number and capture time in usecs of following frame
+  uint32_t junkSize = TIME_CHUNK_LEN - CHUNK_HDR;
+  memcpy(timeChunk, junkBuf, 4);
+  memcpy(timeChunk+4, &junkSize, 4);
+  memcpy(timeChunk+8, timeTag, 4);
+  memcpy(timeChunk+12, &seq, 4);
+  memcpy(timeChunk+16, &capUs, 8);
+  // include in avi sizes and index offsets
+  moviSize[0] += TIME_CHUNK_LEN;
+  idxOffset[0] += TIME_CHUNK_LEN;
+  aviPos += TIME_CHUNK_LEN;
+  *chunkPtr = timeChunk;
+  return TIME_CHUNK_LEN;
+}
+
+bool getFrameTime(const uint8_t* chunk, uint32_t& seq, int64_t& capUs) {
+  // extract sequence number and capture time if chunk holds them
+  uint32_t chunkSize;
+  memcpy(&chunkSize, chunk+4, 4);
+  if (memcmp(chunk, junkBuf, 4) || chunkSize != TIME_CHUNK_LEN - CHUNK_HDR || memcmp(chunk+CHUNK_HDR, timeTag, 4)) return false;
+  memcpy(&seq, chunk+12, 4);
+  memcpy(&capUs, chunk+16, 8);
+  return true;
+}
+
+bool isDupChunk(const uint8_t* chunk) {
+  // whether chunk marks a repeat of previous frame
+  uint32_t chunkSize;
+  memcpy(&chunkSize, chunk+4, 4);
+  return !memcmp(chunk, junkBuf, 4) && chunkSize == sizeof(dupTag) && !memcmp(chunk+CHUNK_HDR, dupTag, 4);
+}
+
+size_t getAviThumb(File& df, uint8_t* thumbBuff, size_t buffSize) {
+  // read first thumbnail in avi, which precedes first frame, by hopping between chunk headers
+  // returns thumbnail length, or 0 if none
+  bool isMultiRiff;
+  uint32_t chunkHdr[2];
+  size_t thumbLen = 0;
+  aviCryptStruct crypt;
+  aviCryptStruct* cryptPtr = getAviCrypt(df, crypt) ? &crypt : NULL;
+  size_t chunkPos = getMoviStart(df, isMultiRiff);
+  for (int i = 0; i < THUMB_SEARCH; i++) {
+    df.seek(chunkPos, SeekSet);
+    if (readAvi(df, (uint8_t*)chunkHdr, CHUNK_HDR, cryptPtr) != CHUNK_HDR) break;
+    if (!memcmp(chunkHdr, thBuf, 4)) {
+      if (chunkHdr[1] <= buffSize) thumbLen = readAvi(df, thumbBuff, chunkHdr[1], cryptPtr);
+      break;
+    }
+    chunkPos += CHUNK_HDR + chunkHdr[1] + (chunkHdr[1] & 1);
+  }
+  if (cryptPtr != NULL) freeAviCrypt(crypt);
+  return thumbLen;
+}
+
+void getAviIdxStats(uint32_t& entryNs, uint32_t& pages, uint32_t& pageMs) {
+  // index build cost per entry, excluding time to append pages to index file
+  entryNs = idxBuildCnt ? ((idxBuildTime - idxPageTime) * 1000) / idxBuildCnt : 0;
+  pages = idxPages;
+  pageMs = idxPages ? idxPageTime / idxPages / 1000 : 0;
+}
+
+void addAviJunk(size_t chunkLen, bool isTL) {
+  // include JUNK chunk copied into avi in its sizes and index offsets
+  moviSize[isTL] += chunkLen;
+  idxOffset[isTL] += chunkLen;
+}
+
+size_t alignAviChunk(size_t filePos, uint8_t** junkPtr) {
+  // provide JUNK chunk to pad next chunk to start of a sector, if aligning
+  // called from saveFrame() with file position of next frame
+  if (!isAligned) return 0;
+  size_t padLen = (SECTOR_SIZE - (filePos % SECTOR_SIZE)) % SECTOR_SIZE;
+  if (!padLen) return 0;
+  if (padLen < CHUNK_HDR) padLen += SECTOR_SIZE; // room for JUNK header
+  uint32_t junkSize = padLen - CHUNK_HDR;
+  memcpy(junkChunk, junkBuf, 4);
+  memcpy(junkChunk+4, &junkSize, 4);
+  // include in avi sizes and index offsets
+  moviSize[0] += padLen;
+  idxOffset[0] += padLen;
+  aviPos += padLen;
+  alignPadding += padLen;
+  *junkPtr = junkChunk;
+  return padLen;
+}
+
+static size_t findJpegTables(const uint8_t* jpeg, size_t jpegLen, size_t& dhtPos) {
+  // locate consecutive run of DHT segments in jpeg header, returns length of run or 0 if none
+  size_t pos = 2; // skip SOI
+  size_t dhtLen = 0;
+  while (pos + 4 <= jpegLen && jpeg[pos] == 0xFF) {
+    uint8_t marker = jpeg[pos+1];
+    if (marker == 0xDA) break; // start of scan
+    size_t segLen = 2 + ((jpeg[pos+2] << 8) | jpeg[pos+3]);
+    if (marker == 0xC4) {
+      if (!dhtLen) dhtPos = pos;
+      else if (dhtPos + dhtLen != pos) break; // only strip first run 
+      dhtLen += segLen;
+    } else if (dhtLen) break;
+    pos += segLen;
+  }
+  return pos + 2 <= jpegLen ? dhtLen : 0;
+}
+
+size_t stripJpegTables(const uint8_t* jpeg, size_t jpegLen, size_t& cutPos) {
+  // identify Huffman tables to be omitted when frame saved, if same as those stored for recording
+  // tables from first frame are stored in a JUNK chunk written before it
+  // returns length of tables to be omitted at cutPos, or 0 if frame saved whole
+  if (!isCompact) return 0;
+  size_t dhtPos = 0;
+  size_t dhtLen = findJpegTables(jpeg, jpegLen, dhtPos);
+  if (!dhtLen) return 0;
+  uint8_t* tables = tablesChunk + CHUNK_HDR + 8;
+  if (!tablesLen) {
+    if (dhtLen > JPEG_TABLES_MAX) return 0;
+    tablesLen = dhtLen;
+    tablesPos = dhtPos;
+    memcpy(tables, jpeg + dhtPos, dhtLen);
+    tablesPending = true;
+  }
+  // frames with different tables are saved whole
+  if (dhtPos != tablesPos || dhtLen != tablesLen || memcmp(jpeg + dhtPos, tables, dhtLen)) return 0;
+  tablesStripped += dhtLen;
+  cutPos = dhtPos;
+  return dhtLen;
+}
+
+size_t getTablesChunk(uint8_t** chunkPtr) {
+  // provide JUNK chunk holding stored Huffman tables, once only, to precede first stripped frame
+  if (!tablesPending) return 0;
+  tablesPending = false;
+  uint32_t junkSize = 8 + ((tablesLen + 3) & ~3);
+  memcpy(tablesChunk, junkBuf, 4);
+  memcpy(tablesChunk+4, &junkSize, 4);
+  memcpy(tablesChunk+8, tablesTag, 4);
+  uint16_t val = tablesPos;
+  memcpy(tablesChunk+12, &val, 2);
+  val = tablesLen;
+  memcpy(tablesChunk+14, &val, 2);
+  memset(tablesChunk + CHUNK_HDR + 8 + tablesLen, 0, junkSize - 8 - tablesLen);
+  size_t chunkLen = CHUNK_HDR + junkSize;
+  // include in avi sizes and index offsets
+  moviSize[0] += chunkLen;
+  idxOffset[0] += chunkLen;
+  aviPos += chunkLen;
+  *chunkPtr = tablesChunk;
+  return chunkLen;
+}
+
+size_t findTablesChunk(File& df, size_t& chunkPos, aviCryptStruct* crypt) {
+  // find JUNK chunk holding Huffman tables, which precedes first frame, by hopping between chunk headers
+  // returns chunk length including header, or 0 if none
+  bool isMultiRiff;
+  uint32_t chunkHdr[3];
+  chunkPos = getMoviStart(df, isMultiRiff);
+  for (int i = 0; i < THUMB_SEARCH; i++) {
+    df.seek(chunkPos, SeekSet);
+    if (readAvi(df, (uint8_t*)chunkHdr, sizeof(chunkHdr), crypt) != sizeof(chunkHdr)) break;
+    if (!memcmp(chunkHdr, junkBuf, 4) && !memcmp(chunkHdr+2, tablesTag, 4)) 
+      return chunkHdr[1] <= CHUNK_HDR + JPEG_TABLES_MAX ? CHUNK_HDR + chunkHdr[1] : 0;
+    chunkPos += CHUNK_HDR + chunkHdr[1] + (chunkHdr[1] & 1);
+  }
+  return 0;
+}
+
+size_t readJpegTables(File& df, uint8_t* tables, size_t& insertPos) {
+  // read Huffman tables stored in avi, with their position in frames stored without them
+  // returns tables length, or 0 if none
+  size_t chunkPos;
+  uint16_t tablesHdr[2];
+  size_t tablesLen = 0;
+  aviCryptStruct crypt;
+  aviCryptStruct* cryptPtr = getAviCrypt(df, crypt) ? &crypt : NULL;
+  if (findTablesChunk(df, chunkPos, cryptPtr)) {
+    df.seek(chunkPos + CHUNK_HDR + 4, SeekSet);
+    if (readAvi(df, (uint8_t*)tablesHdr, 4, cryptPtr) == 4 && tablesHdr[1] <= JPEG_TABLES_MAX
+      && readAvi(df, tables, tablesHdr[1], cryptPtr) == tablesHdr[1]) {
+      insertPos = tablesHdr[0];
+      tablesLen = tablesHdr[1];
+    }
+  }
+  if (cryptPtr != NULL) freeAviCrypt(crypt);
+  return tablesLen;
+}
+
+bool isCompactAvi(File& df) {
+  // whether frames are stored without their Huffman tables, so only decode in app playback
+  size_t chunkPos;
+  aviCryptStruct crypt;
+  aviCryptStruct* cryptPtr = getAviCrypt(df, crypt) ? &crypt : NULL;
+  bool isCompact = findTablesChunk(df, chunkPos, cryptPtr) > 0;
+  if (cryptPtr != NULL) freeAviCrypt(crypt);
+  df.seek(0, SeekSet);
+  return isCompact;
+}
+
+void loadJpegTables(File& df) {
+  // load stored Huffman tables from avi, for reinsertion into stripped frames on playback
+  playTablesLen = 0;
+  if (playTables == NULL) playTables = (uint8_t*)ps_malloc(JPEG_TABLES_MAX);
+  if (playTables != NULL) playTablesLen = readJpegTables(df, playTables, playTablesPos);
+}
+
+size_t getJpegTables(uint8_t** tablesPtr, size_t& insertPos) {
+  // provide Huffman tables loaded for playback, returns 0 if none
+  *tablesPtr = playTables;
+  insertPos = playTablesPos;
+  return playTablesLen;
+}
+
+bool isAlignedAvi(File& df) {
+  // check avi header padding granularity for sector aligned frames
+  uint32_t padGranularity = 0;
+  df.seek(0x28, SeekSet);
+  df.read((uint8_t*)&padGranularity, 4);
+  return padGranularity == SECTOR_SIZE;
 }
 
 size_t writeAviIndex(byte* clientBuf, size_t buffSize, bool isTL) {
-  // write completed index to avi file
+  // write completed index to avi file, read back from index file
   // called repeatedly from closeAvi() until return 0
-  if (idxPtr[isTL] < indexLen[isTL]) {
-    if (indexLen[isTL]-idxPtr[isTL] > buffSize) {
-      memcpy(clientBuf, idxBuf[isTL]+idxPtr[isTL], buffSize);
-      idxPtr[isTL] += buffSize;
-      return buffSize;
-    } else {
-      // final part of index
-      size_t final = indexLen[isTL]-idxPtr[isTL];
-      memcpy(clientBuf, idxBuf[isTL]+idxPtr[isTL], final);
-      idxPtr[isTL] = indexLen[isTL];
-      return final;    
-    }
+  size_t readLen = 0;
+  if (!idxPtr[isTL]) {
+    // index header
+    memcpy(clientBuf, idx1Buf, 4);
+    memcpy(clientBuf+4, &indexLen[isTL], 4);
+    readLen = idxPtr[isTL] = CHUNK_HDR;
   }
+  if (idxFile[isTL]) readLen += idxFile[isTL].read(clientBuf+readLen, buffSize-readLen);
+  if (readLen) return readLen;
+  // get here if finished
+  idxFile[isTL].close();
+  SD_MMC.remove(isTL ? TLIDXTEMP : IDXTEMP);
   return idxPtr[isTL] = 0;
 }
   
-void finalizeAviIndex(uint16_t frameCnt, bool isTL) {
-  // update index with size
-  uint32_t sizeOfIndex = (frameCnt+(haveSoundFile?1:0))*IDX_ENTRY;
-  memcpy(idxBuf[isTL]+4, &sizeOfIndex, 4); // size of index 
-  indexLen[isTL] = sizeOfIndex + CHUNK_HDR;
-  idxPtr[isTL] = 0; // pointer to index buffer
-}
-
-bool haveWavFile(bool isTL) {
-  haveSoundFile = false;
-  if (isTL) return false;
-  // check if wave file exists
-  if (!SD_MMC.exists(WAVTEMP)) return 0; 
-  // open it and get its size
-  audSize = 0;
-  wavFile = SD_MMC.open(WAVTEMP, FILE_READ);
-  if (wavFile) {
-    // add sound file index
-    audSize = wavFile.size() - WAV_HEADER_LEN;
-    buildAviIdx(audSize, false); 
-    // add sound file header    
-    wavFile.seek(WAV_HEADER_LEN, SeekSet); // skip over header
-    haveSoundFile = true;
-  } 
-  return haveSoundFile;
-}
-
-size_t writeWavFile(byte* clientBuf, size_t buffSize) {
-  // read in wav file and write to avi file
-  // called repeatedly from closeAvi() until return 0
-  static size_t offsetWav = CHUNK_HDR;
-  if (offsetWav) {
-    // add sound file header         
-    memcpy(clientBuf, wbBuf, 4);     
-    memcpy(clientBuf+4, &audSize, 4); 
-  } 
-  size_t readLen = wavFile.read(clientBuf+offsetWav, buffSize-offsetWav) + offsetWav; 
-  offsetWav = 0;
-  if (readLen) return readLen; 
+void finalizeAviIndex(bool isTL) {
+  // append final partial page, then reopen index file to be read back
+  flushIdxPage(isTL);
+  const char* idxName = isTL ? TLIDXTEMP : IDXTEMP;
+  if (SD_MMC.exists(idxName)) idxFile[isTL] = SD_MMC.open(idxName, FILE_READ);
+  size_t idxFileLen = idxFile[isTL] ? idxFile[isTL].size() : 0;
+  if (idxFileLen != indexLen[isTL]) LOG_ERR("AVI index file has %u bytes, expected %u", idxFileLen, indexLen[isTL]);
+  idxPtr[isTL] = 0; // header not yet written
+}
+
+void segmentAviIndex() {
+  // hand over motion capture index to finished recording, so next recording can be indexed
+  flushIdxPage(false);
+  if (SD_MMC.exists(SEGIDXTEMP)) SD_MMC.remove(SEGIDXTEMP);
+  SD_MMC.rename(IDXTEMP, SEGIDXTEMP);
+  segIdxFile = SD_MMC.open(SEGIDXTEMP, FILE_READ);
+  segIdxLen = indexLen[0];
+  if (segIdxFile.size() != segIdxLen) LOG_ERR("AVI index file has %u bytes, expected %u", segIdxFile.size(), segIdxLen);
+  segIdxHdr = false;
+}
+
+size_t writeSegIndex(byte* clientBuf, size_t buffSize) {
+  // write index of finished recording, read back from index file
+  // called repeatedly by finalize task until return 0
+  size_t readLen = 0;
+  if (!segIdxHdr) {
+    // index header
+    memcpy(clientBuf, idx1Buf, 4);
+    memcpy(clientBuf+4, &segIdxLen, 4);
+    readLen = CHUNK_HDR;
+    segIdxHdr = true;
+    segIdxDone = 0;
+  }
+  if (segIdxFile) readLen += segIdxFile.read(clientBuf+readLen, buffSize-readLen);
+  segIdxDone += readLen;
+  if (readLen) return readLen;
   // get here if finished
-  wavFile.close();
-  SD_MMC.remove(WAVTEMP);
-  offsetWav = CHUNK_HDR;
+  if (segIdxDone != segIdxLen + CHUNK_HDR) LOG_ERR("Appended AVI index of %u bytes, expected %u", segIdxDone, segIdxLen + CHUNK_HDR);
+  segIdxFile.close();
+  SD_MMC.remove(SEGIDXTEMP);
   return 0;
 }
+
+/************** OpenDML ***************/
+
+bool odmlDue(size_t chunkLen) {
+  // check if OpenDML structures need to be inserted before next chunk
+  if (!isODML) return false;
+  for (int i = 0; i < 2; i++) if (ixCnt[i] >= ODML_IX_ENTRIES) ixPending[i] = true;
+  // allow for index content still to be written to this RIFF
+  size_t pendingLen = (2 * ODML_IX_HDR) + ((ixCnt[0] + ixCnt[1] + 1) * ODML_IX_ENTRY) + (riffCnt ? 0 : indexLen[0] + IDX_ENTRY + CHUNK_HDR);
+  if (aviPos + chunkLen + pendingLen - riffPos[riffCnt] > ODML_RIFF_MAX && riffCnt < ODML_MAX_RIFF - 1) {
+    // start new RIFF
+    ixPending[0] = ixCnt[0] > 0;
+    ixPending[1] = ixCnt[1] > 0;
+    idx1Pending = !riffCnt;
+    riffPending = true;
+  }
+  return ixPending[0] || ixPending[1] || riffPending;
+}
+
+bool odmlFull() {
+  // true if no more standard indexes can be added to super index 
+  return isODML && (superCnt[0] >= ODML_SUPER_ENTRIES - 1 || superCnt[1] >= ODML_SUPER_ENTRIES - 1);
+}
+
+bool odmlClose() {
+  // flush remaining OpenDML index content at end of recording
+  // returns false if current recording is not OpenDML
+  if (!isODML) return false;
+  ixPending[0] = ixCnt[0] > 0;
+  ixPending[1] = ixCnt[1] > 0;
+  idx1Pending = !riffCnt;
+  odmlClosing = true;
+  return true;
+}
+
+static void finalizeIx(int s) {
+  // complete standard index chunk and add its location to super index
+  uint8_t* ix = ixBuf[s];
+  uint32_t ixSize = (ODML_IX_HDR - CHUNK_HDR) + (ixCnt[s] * ODML_IX_ENTRY);
+  memcpy(ix, s ? ix01Buf : ix00Buf, 4);
+  memcpy(ix+4, &ixSize, 4);
+  ix[8] = 2; // longs per entry
+  ix[9] = ix[10] = 0;
+  ix[11] = 1; // index of chunks
+  memcpy(ix+12, &ixCnt[s], 4);
+  memcpy(ix+16, s ? wbBuf : dcBuf, 4);
+  uint64_t qwVal = ixBase[s];
+  memcpy(ix+20, &qwVal, 8);
+  memcpy(ix+28, zeroBuf, 4);
+  if (superCnt[s] < ODML_SUPER_ENTRIES) {
+    uint8_t* superEntry = odmlHeader + (s ? AUD_INDX_POS : VID_STRL_END) + 32 + (superCnt[s] * 16);
+    qwVal = aviPos;
+    memcpy(superEntry, &qwVal, 8);
+    ixSize += CHUNK_HDR;
+    memcpy(superEntry+8, &ixSize, 4);
+    memcpy(superEntry+12, &ixDuration[s], 4);
+    superCnt[s]++;
+  } else LOG_ERR("OpenDML super index full");
+  ixCnt[s] = ixDuration[s] = 0;
+}
+
+size_t odmlStep(uint8_t** chunkPtr) {
+  // provide next pending OpenDML structure to be written to file
+  // called repeatedly from saveFrame() or closeAvi() until return 0
+  size_t chunkLen = 0;
+  for (int i = 0; i < 2 && !chunkLen; i++) {
+    if (ixPending[i]) {
+      // standard index chunk
+      ixPending[i] = false;
+      uint32_t entries = ixCnt[i];
+      finalizeIx(i);
+      chunkLen = ODML_IX_HDR + (entries * ODML_IX_ENTRY);
+      *chunkPtr = ixBuf[i];
+    }
+  }
+  if (!chunkLen && (riffPending || odmlClosing) && !moviEnd[riffCnt]) moviEnd[riffCnt] = aviPos;
+  if (!chunkLen && idx1Pending) {
+    // legacy index at end of first RIFF, read back a page at a time
+    if (!idx1Reading) finalizeAviIndex();
+    idx1Reading = true;
+    chunkLen = writeAviIndex(idxBuf[0], IDX_PAGE);
+    if (chunkLen) *chunkPtr = idxBuf[0];
+    else idx1Pending = idx1Reading = false;
+  }
+  if (!chunkLen && riffPending) {
+    // start next RIFF 
+    riffPending = false;
+    riffPos[++riffCnt] = aviPos;
+    moviEnd[riffCnt] = 0;
+    chunkLen = AVIX_HDR;
+    *chunkPtr = (uint8_t*)avixHeader;
+    LOG_INF("Started OpenDML RIFF %u at %uMB", riffCnt, aviPos / ONEMEG);
+  }
+  if (!chunkLen) odmlClosing = false;
+  aviPos += chunkLen;
+  return chunkLen;
+}
+
+size_t odmlRiffHdr(uint8_t riffNum, uint8_t* hdrBuff) {
+  // complete the header of given subsequent RIFF, returns its file position or 0 if none
+  if (!isODML || !riffNum || riffNum > riffCnt) return 0;
+  size_t riffEnd = (riffNum < riffCnt) ? riffPos[riffNum + 1] : aviPos;
+  uint32_t riffSize = riffEnd - riffPos[riffNum] - CHUNK_HDR;
+  uint32_t moviLen = moviEnd[riffNum] - riffPos[riffNum] - 20; 
+  memcpy(hdrBuff, avixHeader, AVIX_HDR);
+  memcpy(hdrBuff+4, &riffSize, 4);
+  memcpy(hdrBuff+16, &moviLen, 4);
+  return riffPos[riffNum];
+}
+
+size_t getMoviStart(File& df, bool& isMultiRiff) {
+  // find start of movi data by skipping over header chunks, as header length can vary
+  uint32_t chunkHdr[3];
+  size_t moviPos = 12; // after RIFF AVI
+  df.seek(0, SeekSet);
+  df.read((uint8_t*)chunkHdr, 12);
+  isMultiRiff = chunkHdr[1] + CHUNK_HDR < df.size(); // further OpenDML RIFFs follow first RIFF
+  while (moviPos < df.size()) {
+    df.seek(moviPos, SeekSet);
+    if (df.read((uint8_t*)chunkHdr, 12) != 12) break;
+    if (!memcmp(chunkHdr, "LIST", 4) && !memcmp(chunkHdr + 2, "movi", 4)) return moviPos + 12;
+    moviPos += CHUNK_HDR + chunkHdr[1] + (chunkHdr[1] & 1);
+  }
+  LOG_ERR("Failed to find movi list");
+  return AVI_HEADER_LEN;
+}
+
+bool getAviMeta(File& df, aviMetaStruct& aviMeta) {
+  // read recording metadata from info list following header list, false if none
+  uint32_t hdrlSize;
+  uint8_t infoList[INFO_LIST_LEN];
+  df.seek(0x10, SeekSet);
+  if (df.read((uint8_t*)&hdrlSize, 4) != 4) return false;
+  df.seek(0x14 + hdrlSize, SeekSet);
+  if (df.read(infoList, INFO_LIST_LEN) != INFO_LIST_LEN || memcmp(infoList, "LIST", 4) 
+    || memcmp(infoList+8, "INFO", 4) || memcmp(infoList+12, metaBuf, 4)) return false;
+  memcpy(&aviMeta, infoList+20, sizeof(aviMetaStruct));
+  return true;
+}
+
+/************** editing ***************/
+
+static uint8_t* findAviMeta(uint8_t* hdrBuff, size_t hdrLen) {
+  // locate recording metadata in header read by getAviInfo(), NULL if none
+  uint32_t hdrlSize;
+  memcpy(&hdrlSize, hdrBuff+0x10, 4);
+  uint8_t* infoPos = hdrBuff + 0x14 + hdrlSize;
+  if (0x14 + hdrlSize + INFO_LIST_LEN > hdrLen || memcmp(infoPos, "LIST", 4) 
+    || memcmp(infoPos+8, "INFO", 4) || memcmp(infoPos+12, metaBuf, 4)) return NULL;
+  return infoPos + 20;
+}
+
+bool getAviInfo(File& df, uint8_t* hdrBuff, size_t buffSize, aviInfoStruct& aviInfo) {
+  // read header of legacy avi and locate its idx1 index, so that avi can be edited using index only
+  bool isMultiRiff;
+  aviInfo.hdrLen = getMoviStart(df, isMultiRiff);
+  if (isMultiRiff || aviInfo.hdrLen > buffSize) return false; // OpenDML not supported
+  df.seek(0, SeekSet);
+  if (df.read(hdrBuff, aviInfo.hdrLen) != aviInfo.hdrLen) return false;
+  uint32_t moviSize;
+  memcpy(&moviSize, hdrBuff+aviInfo.hdrLen-8, 4);
+  aviInfo.moviLen = moviSize - 4;
+  uint32_t chunkHdr[2];
+  df.seek(aviInfo.hdrLen + aviInfo.moviLen, SeekSet);
+  if (df.read((uint8_t*)chunkHdr, CHUNK_HDR) != CHUNK_HDR || memcmp(chunkHdr, idx1Buf, 4)) return false;
+  aviInfo.idxLen = chunkHdr[1];
+  memcpy(&aviInfo.frameCnt, hdrBuff+0x30, 4);
+  memcpy(&aviInfo.usecs, hdrBuff+0x20, 4);
+  uint32_t padGranularity;
+  memcpy(&padGranularity, hdrBuff+0x28, 4);
+  aviInfo.isAligned = padGranularity == SECTOR_SIZE;
+  aviInfo.audLen = aviInfo.thumbCnt = 0;
+  if (hdrBuff[0x38] > 1) memcpy(&aviInfo.audLen, hdrBuff+0x100, 4);
+  if (hdrBuff[0x38] > 2) memcpy(&aviInfo.thumbCnt, hdrBuff+AUD_STRL_END+0x34, 4);
+  aviMetaStruct aviMeta;
+  uint8_t* metaPos = findAviMeta(hdrBuff, aviInfo.hdrLen);
+  if (metaPos != NULL) memcpy(&aviMeta, metaPos, sizeof(aviMetaStruct));
+  if (metaPos != NULL && aviMeta.encrypted) {
+    LOG_WRN("Encrypted recording cannot be edited");
+    return false;
+  }
+  aviInfo.startTime = metaPos != NULL ? aviMeta.startTime : 0;
+  return true;
+}
+
+void setAviInfo(uint8_t* hdrBuff, aviInfoStruct& aviInfo) {
+  // update header obtained from getAviInfo() with details of edited avi
+  uint32_t riffSize = aviInfo.hdrLen + aviInfo.moviLen + aviInfo.idxLen; // excludes RIFF chunk header
+  memcpy(hdrBuff+4, &riffSize, 4);
+  memcpy(hdrBuff+0x20, &aviInfo.usecs, 4);
+  uint32_t padGranularity = aviInfo.isAligned ? SECTOR_SIZE : 0;
+  memcpy(hdrBuff+0x28, &padGranularity, 4);
+  memcpy(hdrBuff+0x30, &aviInfo.frameCnt, 4);
+  memcpy(hdrBuff+0x8C, &aviInfo.frameCnt, 4);
+  uint8_t aviFPS = aviInfo.usecs ? max(lround(1000000.0f / aviInfo.usecs), 1L) : 1;
+  memcpy(hdrBuff+0x84, &aviFPS, 1);
+  if (hdrBuff[0x38] > 1) memcpy(hdrBuff+0x100, &aviInfo.audLen, 4);
+  if (hdrBuff[0x38] > 2) memcpy(hdrBuff+AUD_STRL_END+0x34, &aviInfo.thumbCnt, 4);
+  uint32_t moviSize = aviInfo.moviLen + 4;
+  memcpy(hdrBuff+aviInfo.hdrLen-8, &moviSize, 4);
+  uint8_t* metaPos = findAviMeta(hdrBuff, aviInfo.hdrLen);
+  if (metaPos != NULL) {
+    // keep recording metadata consistent with edited content
+    aviMetaStruct aviMeta;
+    memcpy(&aviMeta, metaPos, sizeof(aviMetaStruct));
+    aviMeta.startTime = aviInfo.startTime;
+    aviMeta.frameCnt = aviInfo.frameCnt;
+    aviMeta.duration = (uint64_t)aviInfo.frameCnt * aviInfo.usecs / 1000;
+    aviMeta.recFPS = aviFPS;
+    if (!aviInfo.audLen) aviMeta.sampleRate = aviMeta.sampleBits = aviMeta.channels = 0;
+    memcpy(metaPos, &aviMeta, sizeof(aviMetaStruct));
+  }
+}
+
+/************** recovery ***************/
+
+size_t recoverAviIdx(File& df, size_t fileSize, uint8_t* scanBuff, size_t buffSize, uint32_t& frameCnt, bool& noKey) {
+  // rebuild index of avi file left unfinished by power loss, by hopping between chunk headers
+  // up to fileSize, which is less than file size if rest of file has stale content
+  // returns file position after last complete chunk, or 0 if no frames found,
+  // noKey set if recording is encrypted but cannot be decrypted
+  uint32_t chunkHdr[2];
+  size_t winPos = 0, winLen = 0; // file position and length of data in scanBuff
+  size_t chunkLen = 0;
+  frameCnt = recoverStart = 0;
+  // header not written yet, so locate first chunk after any header type, with or without info list
+  const size_t hdrLens[] = {AVI_HEADER_LEN, THUMB_HEADER_LEN, ODML_HEADER_LEN};
+  size_t foundInfo = 0;
+  for (size_t hdrLen : hdrLens) {
+    for (size_t withInfo : {(size_t)INFO_LIST_LEN, (size_t)0}) {
+      df.seek(hdrLen + withInfo, SeekSet);
+      if (df.read((uint8_t*)chunkHdr, CHUNK_HDR) == CHUNK_HDR 
+        && (!memcmp(chunkHdr, dcBuf, 4) || !memcmp(chunkHdr, wbBuf, 4) || !memcmp(chunkHdr, thBuf, 4)
+        || !memcmp(chunkHdr, junkBuf, 4))) {
+        recoverStart = hdrLen + withInfo;
+        foundInfo = withInfo;
+        break;
+      }
+    }
+    if (recoverStart) break;
+  }
+  noKey = false;
+  if (!recoverStart) return 0;
+  // encrypted recording starts with plaintext JENC chunk
+  uint8_t cryptHdr[CRYPT_CHUNK_LEN];
+  aviCryptStruct crypt;
+  df.seek(recoverStart, SeekSet);
+  bool isEnc = recoverStart + CRYPT_CHUNK_LEN <= fileSize && df.read(cryptHdr, CRYPT_CHUNK_LEN) == CRYPT_CHUNK_LEN 
+    && !memcmp(cryptHdr, junkBuf, 4) && !memcmp(cryptHdr+CHUNK_HDR, cryptTag, 4);
+  if (isEnc && !loadAviCrypt(cryptHdr, recoverStart, crypt)) {
+    noKey = true;
+    return 0;
+  }
+  prepAviIndex();
+  isODML = isAligned = false; // rebuilt as legacy avi
+  recMeta.encrypted = isEnc;
+  infoLen = foundInfo;
+  haveThumbs = recoverStart - infoLen == THUMB_HEADER_LEN;
+  size_t chunkPos = recoverStart;
+  while (chunkPos + CHUNK_HDR <= fileSize) {
+    if (chunkPos < winPos || chunkPos + CHUNK_HDR > winPos + winLen) {
+      // read sector aligned block containing next chunk header, 
+      // only a couple of sectors if chunks are larger than buffer
+      winPos = chunkPos & ~(size_t)(SECTOR_SIZE - 1);
+      df.seek(winPos, SeekSet);
+      winLen = df.read(scanBuff, chunkLen > buffSize ? SECTOR_SIZE * 2 : buffSize);
+      if (isEnc) cryptAvi(crypt, scanBuff, winLen, winPos);
+      if (chunkPos + CHUNK_HDR > winPos + winLen) break;
+    }
+    memcpy(chunkHdr, scanBuff + chunkPos - winPos, CHUNK_HDR);
+    if (chunkHdr[1] > fileSize) break; // invalid size
+    chunkLen = CHUNK_HDR + chunkHdr[1] + (chunkHdr[1] & 1);
+    bool isRiff = !memcmp(chunkHdr, "RIFF", 4);
+    if (isRiff) chunkLen = AVIX_HDR; // start of OpenDML AVIX 
+    if (chunkPos + chunkLen > fileSize) break; // torn final chunk
+    if (!memcmp(chunkHdr, dcBuf, 4) || !memcmp(chunkHdr, wbBuf, 4)) {
+      idxOffset[0] = chunkPos - recoverStart;
+      bool isVid = !memcmp(chunkHdr, dcBuf, 4);
+      buildAviIdx(chunkHdr[1], isVid);
+      if (isVid) frameCnt++;
+    } else if (!memcmp(chunkHdr, thBuf, 4) && haveThumbs) {
+      idxOffset[0] = chunkPos - recoverStart;
+      buildThumbIdx(chunkHdr[1]);
+    } else if (chunkPos + CHUNK_HDR + 4 <= winPos + winLen && isDupChunk(scanBuff + chunkPos - winPos)) {
+      // repeat of previous frame
+      uint8_t* dupPtr;
+      idxOffset[0] = chunkPos - recoverStart;
+      if (getDupChunk(&dupPtr)) frameCnt++;
+    } else if (isRiff || !memcmp(chunkHdr, idx1Buf, 4)) {
+      // hide OpenDML structures inside movi from legacy players
+      uint32_t junkHdr[2];
+      memcpy(junkHdr, junkBuf, 4);
+      junkHdr[1] = chunkLen - CHUNK_HDR;
+      if (isEnc) cryptAvi(crypt, (uint8_t*)junkHdr, CHUNK_HDR, chunkPos);
+      df.seek(chunkPos, SeekSet);
+      df.write((uint8_t*)junkHdr, CHUNK_HDR);
+    } else if (memcmp(chunkHdr, "ix", 2) && memcmp(chunkHdr, junkBuf, 4)) break; // not a valid chunk
+    chunkPos += chunkLen;
+  }
+  if (isEnc) freeAviCrypt(crypt);
+  if (!frameCnt) return 0;
+  // so that buildAviHdr() derives movi size, allowing for skipped chunks
+  moviSize[0] = chunkPos - recoverStart - ((frameCnt - dupCnt + audChunks + thumbCnt) * CHUNK_HDR); 
+  return chunkPos;
+}
+
+void recoverAviHdr(File& df, uint8_t FPS, uint8_t frameType, uint32_t frameCnt) {
+  // write rebuilt header to recovered avi, padded with JUNK if originally OpenDML
+  buildAviHdr(FPS, frameType, frameCnt);
+  uint8_t* hdrPtr;
+  size_t hdrLen = getAviHdr(&hdrPtr);
+  size_t hdrPad = recoverStart - hdrLen;
+  df.seek(0, SeekSet);
+  if (hdrPad) {
+    uint32_t riffSize;
+    memcpy(&riffSize, hdrPtr+4, 4);
+    riffSize += hdrPad;
+    memcpy(hdrPtr+4, &riffSize, 4);
+    df.write(hdrPtr, hdrLen - 12);
+    uint32_t junkSize = hdrPad - CHUNK_HDR;
+    df.write(junkBuf, 4);
+    df.write((uint8_t*)&junkSize, 4);
+    df.seek(recoverStart - 12, SeekSet);
+    df.write(hdrPtr+hdrLen-12, 12); // movi list
+  } else df.write(hdrPtr, hdrLen);
+}
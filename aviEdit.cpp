@@ -0,0 +1,684 @@
+/*
+Edit recorded AVI files in the background, using only their idx1 index.
+Frames are copied as is, without being decoded or parsed,
+and a new header and idx1 index are built from the source indexes.
+
+Merge: recordings in a day folder that follow each other within mergeGapSecs
+are concatenated into a single avi, then the source files are deleted.
+
+Trim: the frames of a recording within a given time range, with their
+interleaved audio, thumbnails and capture times, are copied to a new avi.
+The range is of capture times where recorded, as frames may have been skipped,
+found by hopping between the chunk headers.
+
+Timelapse: every Nth frame of each recording in a day folder is copied
+to a timelapse avi, built using the time lapse header and index.
+
+Recording metadata in the header info list is updated for the edited content.
+Sector aligned sources are kept aligned by inserting a JUNK chunk
+before each source's movi data where needed.
+The edit functions only use File, so merge and trim are also built and tested on a host, see test/host.
+
+s60sc 2022
+*/
+
+#include "appGlobals.h"
+
+#define EDIT_BUFF (RAMSIZE * 2) // copy buffer for sequential reads and writes
+#define EDIT_IDX_PAGE (64 * 16) // idx1 entries read at a time while copying frames
+#define EDIT_HDR_MAX SECTOR_SIZE // max header length of legacy avi
+#define IDX_ENTRY 16 // bytes per idx1 entry
+#define COMPILE_EVERY 10 // default frames between each timelapse frame
+#define MAX_MERGE 64 // max recordings merged into one avi
+#define MERGE_MAX_SIZE (1024 * ONEMEG) // keep merged avi within RIFF size expected by players
+#define SIDE_CHUNKS_MAX 16 // chunks checked for side chunks before first frame
+#define EDIT_THROTTLE_MS 20 // pause after each copy buffer while recording, to leave SD bandwidth for it
+
+int mergeGapSecs = 0; // merge recordings less than this apart, 0 for off
+
+struct editFile {
+  std::string fileName;
+  size_t fileSize;
+  time_t startTime;
+  uint32_t duration; // secs
+};
+
+enum editType {EDIT_MERGE, EDIT_TRIM, EDIT_TIMELAPSE};
+
+static TaskHandle_t editHandle = NULL;
+static bool editInProgress = false;
+static editType editAction;
+static char editPath[FILE_NAME_LEN];
+static uint32_t trimFrom, trimTo; // secs
+static uint32_t compileEvery; // frames between each timelapse frame
+char editStatus[FILE_NAME_LEN] = "None"; // progress of edit, reported in status
+static uint8_t* editBuff = NULL;
+static uint8_t editTables[JPEG_TABLES_MAX]; // Huffman tables of recording being compiled
+static uint8_t tlTables[JPEG_TABLES_MAX]; // Huffman tables stored once in compiled timelapse
+
+/************** edit functions ***************/
+
+static bool getEditFile(File& df, editFile& ef) {
+  // get start time and duration from recording metadata, else from recording file name
+  // eg /20221231/20221231_235959_SVGA_20_30_600_S.avi
+  aviMetaStruct aviMeta;
+  if (getAviMeta(df, aviMeta)) {
+    ef.startTime = aviMeta.startTime;
+    ef.duration = lround(aviMeta.duration / 1000.0);
+  } else {
+    char fnameStr[FILE_NAME_LEN];
+    strcpy(fnameStr, df.path());
+    for (int i = 0; i <= strlen(fnameStr); i++)
+      if (fnameStr[i] == '_') fnameStr[i] = ' ';
+    struct tm tm = {};
+    const char* datePtr = strrchr(fnameStr, '/');
+    if (datePtr == NULL || sscanf(datePtr + 1, "%4d%2d%2d %2d%2d%2d %*s %*u %u", &tm.tm_year, &tm.tm_mon,
+      &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &ef.duration) != 7) return false;
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    ef.startTime = mktime(&tm);
+  }
+  ef.fileName = df.path();
+  ef.fileSize = df.size();
+  return true;
+}
+
+static void editFileName(char* outName, editFile& ef, uint32_t frameCnt, uint64_t totalUsecs, bool hasAudio) {
+  // name edited avi in same format as recording, with frame size from source name
+  char partName[FILE_NAME_LEN];
+  char frameSizeStr[10] = "";
+  sscanf(strrchr(ef.fileName.c_str(), '/') + 17, "%9[^_.]", frameSizeStr);
+  strftime(partName, sizeof(partName), "/%Y%m%d/%Y%m%d_%H%M%S", localtime(&ef.startTime));
+  uint8_t editFPS = totalUsecs ? max(lround(1000000.0 * frameCnt / totalUsecs), 1L) : 1;
+  int alen = statsInName 
+    ? snprintf(outName, FILE_NAME_LEN - 1, "%s_%s_%u_%u_%u%s.%s", partName, frameSizeStr,
+      editFPS, (uint32_t)lround(totalUsecs / 1000000.0), frameCnt, hasAudio ? "_S" : "", FILE_EXT)
+    : snprintf(outName, FILE_NAME_LEN - 1, "%s_%s%s.%s", partName, frameSizeStr, hasAudio ? "_S" : "", FILE_EXT);
+  if (alen > FILE_NAME_LEN - 1) LOG_WRN("file name truncated");
+}
+
+static size_t alignEdit(File& outFile, size_t alignPos) {
+  // insert JUNK chunk so that next chunk has same sector offset as in source
+  size_t padLen = (alignPos - outFile.position()) % SECTOR_SIZE;
+  if (!padLen) return 0;
+  if (padLen < CHUNK_HDR) padLen += SECTOR_SIZE; // room for JUNK header
+  uint32_t junkSize = padLen - CHUNK_HDR;
+  memset(editBuff, 0, padLen);
+  memcpy(editBuff, "JUNK", 4);
+  memcpy(editBuff+4, &junkSize, 4);
+  return outFile.write(editBuff, padLen);
+}
+
+static size_t copyEdit(File& srcFile, File& outFile, size_t srcPos, size_t copyLen) {
+  // copy block of file content using large sequential reads
+  size_t copied = 0;
+  srcFile.seek(srcPos, SeekSet);
+  while (copied < copyLen) {
+    if (isCapturing) delay(EDIT_THROTTLE_MS); // give way to recording, edits only read closed files
+    size_t readLen = srcFile.read(editBuff, std::min((size_t)EDIT_BUFF, copyLen - copied));
+    if (!readLen || outFile.write(editBuff, readLen) != readLen) break;
+    copied += readLen;
+  }
+  return copied;
+}
+
+static uint32_t copyFrame(File& srcFile, File& outFile, size_t chunkPos, uint32_t chunkSize, size_t tablesLen, size_t insertPos) {
+  // copy frame with its chunk header, reinserting Huffman tables if frame stored without them
+  // returns size of frame as written, or 0 if failed
+  if (tablesLen && insertPos + 2 <= chunkSize) {
+    srcFile.seek(chunkPos + CHUNK_HDR, SeekSet);
+    if (srcFile.read(editBuff, insertPos + 2) != insertPos + 2) return 0;
+    if (editBuff[insertPos] != 0xFF || editBuff[insertPos+1] != 0xC4) {
+      // keep frame on 4 byte boundary
+      uint32_t filler = (4 - (tablesLen & 0x00000003)) & 0x00000003;
+      uint32_t outSize = chunkSize + tablesLen + filler;
+      outFile.write(dcBuf, 4);
+      outFile.write((uint8_t*)&outSize, 4);
+      outFile.write(editBuff, insertPos);
+      outFile.write(editTables, tablesLen);
+      size_t restLen = chunkSize - insertPos;
+      if (copyEdit(srcFile, outFile, chunkPos + CHUNK_HDR + insertPos, restLen) != restLen) return 0;
+      memset(editBuff, 0, filler);
+      return outFile.write(editBuff, filler) == filler ? outSize : 0;
+    }
+  }
+  return copyEdit(srcFile, outFile, chunkPos, chunkSize + CHUNK_HDR) == chunkSize + CHUNK_HDR ? chunkSize : 0;
+}
+
+static size_t copySideChunks(File& srcFile, File& outFile, size_t chunkPos, size_t framePos, bool& hasTables) {
+  // copy capture time and Huffman tables JUNK chunks which precede first frame of recording, 
+  // passing over audio, thumbnail and padding chunks
+  // returns length copied
+  uint32_t chunkHdr[3];
+  size_t copiedLen = 0;
+  hasTables = false;
+  for (int i = 0; i < SIDE_CHUNKS_MAX && chunkPos + sizeof(chunkHdr) <= framePos; i++) {
+    srcFile.seek(chunkPos, SeekSet);
+    if (srcFile.read((uint8_t*)chunkHdr, sizeof(chunkHdr)) != sizeof(chunkHdr)) break;
+    size_t chunkLen = CHUNK_HDR + chunkHdr[1] + (chunkHdr[1] & 1);
+    bool isTables = !memcmp(chunkHdr+2, "JDHT", 4);
+    if (!memcmp(chunkHdr, "JUNK", 4) && (isTables || !memcmp(chunkHdr+2, "FTIM", 4)) && chunkPos + chunkLen <= framePos) {
+      if (copyEdit(srcFile, outFile, chunkPos, chunkLen) != chunkLen) break;
+      copiedLen += chunkLen;
+      hasTables |= isTables;
+    }
+    chunkPos += chunkLen;
+  }
+  return copiedLen;
+}
+
+static bool copyIndex(File& srcFile, File& outFile, size_t idxPos, size_t idxLen, int32_t offsetAdj) {
+  // copy idx1 entries of source avi, adjusting offsets for new position of their chunks
+  size_t idxRemain = idxLen;
+  srcFile.seek(idxPos, SeekSet);
+  while (idxRemain) {
+    size_t readLen = srcFile.read(editBuff, std::min((size_t)EDIT_BUFF, idxRemain));
+    if (!readLen || readLen % IDX_ENTRY) return false;
+    for (size_t i = 0; i < readLen; i += IDX_ENTRY) {
+      uint32_t chunkOffset;
+      memcpy(&chunkOffset, editBuff+i+8, 4);
+      chunkOffset += offsetAdj;
+      memcpy(editBuff+i+8, &chunkOffset, 4);
+    }
+    if (outFile.write(editBuff, readLen) != readLen) return false;
+    idxRemain -= readLen;
+  }
+  return true;
+}
+
+static bool verifyMerge(aviInfoStruct& expInfo) {
+  // check merged avi reads back with expected movi, idx1 and frame count before its sources are removed
+  uint8_t hdrBuff[EDIT_HDR_MAX];
+  aviInfoStruct chkInfo;
+  File chkFile = SD_MMC.open(EDITTEMP, FILE_READ);
+  bool ok = chkFile && getAviInfo(chkFile, hdrBuff, EDIT_HDR_MAX, chkInfo)
+    && chkInfo.moviLen == expInfo.moviLen && chkInfo.idxLen == expInfo.idxLen && chkInfo.frameCnt == expInfo.frameCnt
+    && chkFile.size() == chkInfo.hdrLen + chkInfo.moviLen + CHUNK_HDR + chkInfo.idxLen && !(chkInfo.idxLen % IDX_ENTRY);
+  // every video entry must lie within movi, and last must locate a video chunk
+  uint32_t vidEntries = 0, lastOffset = 0;
+  size_t idxRemain = 0;
+  if (ok) {
+    idxRemain = chkInfo.idxLen;
+    chkFile.seek(chkInfo.hdrLen + chkInfo.moviLen + CHUNK_HDR, SeekSet);
+  }
+  while (idxRemain && ok) {
+    size_t readLen = chkFile.read(editBuff, std::min((size_t)EDIT_BUFF, idxRemain));
+    ok = readLen && !(readLen % IDX_ENTRY);
+    for (size_t i = 0; i < readLen && ok; i += IDX_ENTRY) {
+      if (memcmp(editBuff+i, dcBuf, 4)) continue;
+      uint32_t chunkOffset, chunkSize;
+      memcpy(&chunkOffset, editBuff+i+8, 4);
+      memcpy(&chunkSize, editBuff+i+12, 4);
+      ok = (size_t)chunkOffset + CHUNK_HDR + chunkSize <= chkInfo.moviLen;
+      lastOffset = chunkOffset;
+      vidEntries++;
+    }
+    idxRemain -= readLen;
+  }
+  uint8_t chunkId[4];
+  if (ok && vidEntries) {
+    chkFile.seek(chkInfo.hdrLen + lastOffset, SeekSet);
+    ok = chkFile.read(chunkId, 4) == 4 && !memcmp(chunkId, dcBuf, 4);
+  }
+  chkFile.close();
+  return ok && vidEntries == expInfo.frameCnt;
+}
+
+static bool mergeAvis(std::vector<editFile>& editFiles, size_t first, size_t last) {
+  // concatenate movi data of consecutive avis, then build header and idx1 from their indexes
+  uint32_t mTime = millis();
+  uint8_t outHdr[EDIT_HDR_MAX], srcHdr[EDIT_HDR_MAX];
+  aviInfoStruct outInfo, srcInfo;
+  size_t srcOffset[MAX_MERGE];
+  uint64_t totalUsecs = 0;
+  File outFile = SD_MMC.open(EDITTEMP, FILE_WRITE);
+  bool ok = (bool)outFile;
+  for (size_t i = first; i < last && ok; i++) {
+    File srcFile = SD_MMC.open(editFiles[i].fileName.c_str(), FILE_READ);
+    ok = srcFile && getAviInfo(srcFile, i == first ? outHdr : srcHdr, EDIT_HDR_MAX, srcInfo);
+    if (ok && i == first) {
+      // header of first avi is template for merged avi
+      outInfo = srcInfo;
+      outInfo.moviLen = outInfo.idxLen = outInfo.frameCnt = outInfo.audLen = outInfo.thumbCnt = 0;
+      ok = outFile.write(outHdr, outInfo.hdrLen) == outInfo.hdrLen;
+    } else if (ok) {
+      // must have same streams and frame size
+      ok = srcInfo.hdrLen == outInfo.hdrLen && srcHdr[0x38] == outHdr[0x38] && !memcmp(srcHdr+0x40, outHdr+0x40, 8);
+      if (!ok) LOG_WRN("%s has different format", editFiles[i].fileName.c_str());
+    }
+    if (ok) {
+      if (srcInfo.isAligned) alignEdit(outFile, srcInfo.hdrLen);
+      outInfo.isAligned &= srcInfo.isAligned;
+      srcOffset[i - first] = outFile.position() - outInfo.hdrLen;
+      ok = copyEdit(srcFile, outFile, srcInfo.hdrLen, srcInfo.moviLen) == srcInfo.moviLen;
+      outInfo.idxLen += srcInfo.idxLen;
+      outInfo.frameCnt += srcInfo.frameCnt;
+      outInfo.audLen += srcInfo.audLen;
+      outInfo.thumbCnt += srcInfo.thumbCnt;
+      totalUsecs += (uint64_t)srcInfo.frameCnt * srcInfo.usecs;
+    }
+    srcFile.close();
+  }
+  if (ok) {
+    // idx1 follows movi data, each source index adjusted for its position
+    outInfo.moviLen = outFile.position() - outInfo.hdrLen;
+    outFile.write((const uint8_t*)"idx1", 4);
+    outFile.write((uint8_t*)&outInfo.idxLen, 4);
+    for (size_t i = first; i < last && ok; i++) {
+      File srcFile = SD_MMC.open(editFiles[i].fileName.c_str(), FILE_READ);
+      ok = srcFile && getAviInfo(srcFile, srcHdr, EDIT_HDR_MAX, srcInfo) 
+        && copyIndex(srcFile, outFile, srcInfo.hdrLen + srcInfo.moviLen + CHUNK_HDR, srcInfo.idxLen, srcOffset[i - first]);
+      srcFile.close();
+    }
+  }
+  if (ok) {
+    outInfo.usecs = outInfo.frameCnt ? totalUsecs / outInfo.frameCnt : 0;
+    setAviInfo(outHdr, outInfo);
+    outFile.seek(0, SeekSet);
+    ok = outFile.write(outHdr, outInfo.hdrLen) == outInfo.hdrLen;
+  }
+  outFile.close();
+  if (ok && !verifyMerge(outInfo)) {
+    ok = false;
+    LOG_WRN("Merged avi failed verification, source recordings kept");
+  }
+  if (!ok) {
+    SD_MMC.remove(EDITTEMP);
+    LOG_ERR("Failed to merge %s", editFiles[first].fileName.c_str());
+    return false;
+  }
+  char mergeName[FILE_NAME_LEN];
+  editFileName(mergeName, editFiles[first], outInfo.frameCnt, totalUsecs, outInfo.audLen > 0);
+  for (size_t i = first; i < last; i++) SD_MMC.remove(editFiles[i].fileName.c_str());
+  SD_MMC.rename(EDITTEMP, mergeName);
+  LOG_INF("Merged %u recordings into %s in %lu ms", last - first, mergeName, millis() - mTime);
+  return true;
+}
+
+static bool findTimedRange(File& srcFile, aviInfoStruct& srcInfo, uint32_t fromSecs, uint32_t toSecs,
+  uint32_t& fromFrame, uint32_t& toFrame, size_t& fromOffset) {
+  // locate frames captured in time range from capture time chunks, by hopping between chunk headers,
+  // with movi offset of capture time chunk of first frame in range
+  // returns false if recording has no capture times
+  uint8_t chunk[TIME_CHUNK_LEN];
+  size_t chunkPos = srcInfo.hdrLen;
+  size_t moviEnd = srcInfo.hdrLen + srcInfo.moviLen;
+  uint32_t frameNum = 0, seq;
+  int64_t capUs, firstUs = -1;
+  fromFrame = toFrame = srcInfo.frameCnt;
+  while (chunkPos + CHUNK_HDR + 4 <= moviEnd) {
+    srcFile.seek(chunkPos, SeekSet);
+    size_t readLen = srcFile.read(chunk, sizeof(chunk));
+    if (readLen < CHUNK_HDR + 4) break;
+    uint32_t chunkSize;
+    memcpy(&chunkSize, chunk+4, 4);
+    if (readLen == sizeof(chunk) && getFrameTime(chunk, seq, capUs)) {
+      if (firstUs < 0) firstUs = capUs;
+      int64_t elapsedUs = capUs - firstUs;
+      if (fromFrame == srcInfo.frameCnt && elapsedUs >= (int64_t)fromSecs * 1000000) {
+        fromFrame = frameNum;
+        fromOffset = chunkPos - srcInfo.hdrLen;
+      }
+      if (elapsedUs >= (int64_t)toSecs * 1000000) {
+        toFrame = frameNum;
+        break;
+      }
+    } else if (!memcmp(chunk, dcBuf, 4) || isDupChunk(chunk)) {
+      if (firstUs < 0) return false; // first frame has no capture time
+      frameNum++;
+    }
+    chunkPos += CHUNK_HDR + chunkSize + (chunkSize & 1);
+  }
+  return firstUs >= 0;
+}
+
+static bool trimAvi(const char* srcName, uint32_t fromSecs, uint32_t toSecs) {
+  // copy chunks of frames in time range to new avi, located using source idx1
+  // each frame is preceded by any audio and thumbnail chunks interleaved before it
+  // time range is of capture times if recorded, else of frame rate
+  uint32_t tTime = millis();
+  uint8_t outHdr[EDIT_HDR_MAX];
+  aviInfoStruct srcInfo, outInfo;
+  editFile ef;
+  File srcFile = SD_MMC.open(srcName, FILE_READ);
+  if (!srcFile || !getEditFile(srcFile, ef) || !getAviInfo(srcFile, outHdr, EDIT_HDR_MAX, srcInfo) || !srcInfo.usecs) {
+    LOG_ERR("Unable to trim %s", srcName);
+    srcFile.close();
+    return false;
+  }
+  uint32_t fromFrame, toFrame;
+  size_t timeOffset = 0;
+  bool isTimed = findTimedRange(srcFile, srcInfo, fromSecs, toSecs, fromFrame, toFrame, timeOffset);
+  if (!isTimed) {
+    fromFrame = (uint64_t)fromSecs * 1000000 / srcInfo.usecs;
+    toFrame = std::min((uint32_t)((uint64_t)toSecs * 1000000 / srcInfo.usecs), srcInfo.frameCnt);
+  }
+  if (fromFrame >= toFrame || (!fromFrame && toFrame == srcInfo.frameCnt)) {
+    LOG_WRN("Trim range %u - %u secs not within %s", fromSecs, toSecs, srcName);
+    srcFile.close();
+    return false;
+  }
+  // find range of index entries for required frames
+  size_t idxPos = srcInfo.hdrLen + srcInfo.moviLen + CHUNK_HDR;
+  uint32_t entryCnt = srcInfo.idxLen / IDX_ENTRY;
+  uint32_t firstEntry = entryCnt, lastEntry = 0, frameNum = 0;
+  uint32_t startOffset = 0, endOffset = 0;
+  outInfo = srcInfo;
+  outInfo.frameCnt = outInfo.audLen = outInfo.thumbCnt = 0;
+  if (outInfo.startTime) outInfo.startTime += fromSecs;
+  srcFile.seek(idxPos, SeekSet);
+  for (uint32_t e = 0; e < entryCnt; e++) {
+    if (!(e % (EDIT_BUFF / IDX_ENTRY))) srcFile.read(editBuff, EDIT_BUFF);
+    uint8_t* entry = editBuff + (e % (EDIT_BUFF / IDX_ENTRY)) * IDX_ENTRY;
+    bool isVid = !memcmp(entry, dcBuf, 4);
+    // trailing audio after last frame only included if range extends to end
+    if (frameNum >= fromFrame && (frameNum < toFrame || toFrame == srcInfo.frameCnt)) {
+      uint32_t chunkOffset, chunkSize;
+      memcpy(&chunkOffset, entry+8, 4);
+      memcpy(&chunkSize, entry+12, 4);
+      // repeated frame points back to an earlier chunk, which must also be copied
+      if (firstEntry == entryCnt) {
+        firstEntry = e;
+        startOffset = chunkOffset;
+      } else startOffset = std::min(startOffset, chunkOffset);
+      lastEntry = e;
+      endOffset = std::max(endOffset, chunkOffset + CHUNK_HDR + chunkSize + (chunkSize & 1));
+      if (isVid) outInfo.frameCnt++;
+      else if (!memcmp(entry, wbBuf, 4)) outInfo.audLen += chunkSize;
+      else if (!memcmp(entry, thBuf, 4)) outInfo.thumbCnt++;
+    }
+    if (isVid) frameNum++;
+  }
+  if (firstEntry == entryCnt) {
+    LOG_ERR("Frames not found in index of %s", srcName);
+    srcFile.close();
+    return false;
+  }
+  // include capture time of first frame, which is not indexed
+  if (isTimed) startOffset = std::min(startOffset, (uint32_t)timeOffset);
+  // copy required chunks as a single block
+  File outFile = SD_MMC.open(EDITTEMP, FILE_WRITE);
+  bool ok = outFile && outFile.write(outHdr, srcInfo.hdrLen) == srcInfo.hdrLen;
+  // carry over stored Huffman tables if range starts after them
+  size_t tablesPos;
+  size_t tablesLen = findTablesChunk(srcFile, tablesPos);
+  if (ok && tablesLen && tablesPos < srcInfo.hdrLen + startOffset) 
+    ok = copyEdit(srcFile, outFile, tablesPos, tablesLen) == tablesLen;
+  if (ok && srcInfo.isAligned) alignEdit(outFile, srcInfo.hdrLen + startOffset);
+  size_t outOffset = outFile.position() - srcInfo.hdrLen;
+  if (ok) ok = copyEdit(srcFile, outFile, srcInfo.hdrLen + startOffset, endOffset - startOffset) == endOffset - startOffset;
+  if (ok) {
+    outInfo.moviLen = outFile.position() - srcInfo.hdrLen;
+    outInfo.idxLen = (lastEntry - firstEntry + 1) * IDX_ENTRY;
+    outFile.write((const uint8_t*)"idx1", 4);
+    outFile.write((uint8_t*)&outInfo.idxLen, 4);
+    ok = copyIndex(srcFile, outFile, idxPos + firstEntry * IDX_ENTRY, outInfo.idxLen, outOffset - startOffset);
+  }
+  if (ok) {
+    setAviInfo(outHdr, outInfo);
+    outFile.seek(0, SeekSet);
+    ok = outFile.write(outHdr, outInfo.hdrLen) == outInfo.hdrLen;
+  }
+  outFile.close();
+  srcFile.close();
+  if (!ok) {
+    SD_MMC.remove(EDITTEMP);
+    LOG_ERR("Failed to trim %s", srcName);
+    return false;
+  }
+  // name with start time of first frame in range
+  char trimName[FILE_NAME_LEN];
+  ef.startTime += fromSecs;
+  editFileName(trimName, ef, outInfo.frameCnt, (uint64_t)outInfo.frameCnt * outInfo.usecs, outInfo.audLen > 0);
+  if (SD_MMC.exists(trimName)) {
+    // name without stats same as source, so distinguish by start time
+    ef.startTime++;
+    editFileName(trimName, ef, outInfo.frameCnt, (uint64_t)outInfo.frameCnt * outInfo.usecs, outInfo.audLen > 0);
+  }
+  SD_MMC.rename(EDITTEMP, trimName);
+  uint32_t copyTime = std::max(millis() - tTime, 1UL);
+  LOG_INF("Trimmed %s to %s, %u frames in %lu ms, %u kB/s", srcName, trimName, outInfo.frameCnt, copyTime, 
+    (uint32_t)((endOffset - startOffset) / copyTime * 1000 / 1024));
+  return true;
+}
+
+static bool listRecordings(const char* folder, std::vector<editFile>& editFiles) {
+  // list recordings in day folder, oldest first
+  File root = SD_MMC.open(folder);
+  if (!root || !root.isDirectory()) {
+    LOG_ERR("Failed to open directory %s", folder);
+    return false;
+  }
+  File file = root.openNextFile();
+  while (file) {
+    // ignore timelapse and other formats
+    editFile ef;
+    if (!file.isDirectory() && strstr(file.name(), "." FILE_EXT) != NULL && strstr(file.name(), "_T.") == NULL
+      && getEditFile(file, ef)) editFiles.push_back(ef);
+    file = root.openNextFile();
+  }
+  root.close();
+  sort(editFiles.begin(), editFiles.end(), [](const editFile& a, const editFile& b) {return a.fileName < b.fileName;});
+  return true;
+}
+
+static bool compileTimelapse(const char* folder, uint32_t everyN) {
+  // build timelapse avi from every Nth frame of each recording in day folder, 
+  // reading only those frames as located by each recording's idx1
+  std::vector<editFile> editFiles;
+  if (!listRecordings(folder, editFiles) || editFiles.empty()) return false;
+  // claim time lapse index, which live time lapse then waits for
+  xSemaphoreTake(aviMutex, portMAX_DELAY);
+  bool tlLive = timeLapseOn || tlIndexBusy;
+  if (!tlLive) tlIndexBusy = true;
+  xSemaphoreGive(aviMutex);
+  if (tlLive) {
+    LOG_WRN("Timelapse compilation not available while time lapse recording is on");
+    strcpy(editStatus, "Timelapse failed");
+    return false;
+  }
+  uint32_t cTime = millis();
+  uint8_t srcHdr[EDIT_HDR_MAX];
+  aviInfoStruct srcInfo;
+  uint8_t* idxPage = editBuff + EDIT_BUFF;
+  int frameType = -1;
+  uint32_t frameCntTL = 0, frameNum = 0;
+  size_t copiedLen = 0, tlTablesLen = 0, tlTablesPos = 0;
+  File outFile = SD_MMC.open(EDITTEMP, FILE_WRITE);
+  // space for header, from shared header buffer which recordings also build
+  xSemaphoreTake(aviMutex, portMAX_DELAY);
+  bool ok = outFile && outFile.write(aviHeader, AVI_HEADER_LEN) == AVI_HEADER_LEN;
+  xSemaphoreGive(aviMutex);
+  prepAviIndex(true);
+  for (size_t i = 0; i < editFiles.size() && ok; i++) {
+    File srcFile = SD_MMC.open(editFiles[i].fileName.c_str(), FILE_READ);
+    if (!srcFile || !getAviInfo(srcFile, srcHdr, EDIT_HDR_MAX, srcInfo)) {
+      LOG_WRN("Skipped %s", editFiles[i].fileName.c_str());
+      continue;
+    }
+    // frame size of first recording used for timelapse
+    uint16_t frameWidth, frameHeight;
+    memcpy(&frameWidth, srcHdr+0x40, 2);
+    memcpy(&frameHeight, srcHdr+0x44, 2);
+    for (int f = 0; frameType < 0 && f < sizeof(frameData) / sizeof(frameData[0]); f++) 
+      if (frameData[f].frameWidth == frameWidth && frameData[f].frameHeight == frameHeight) frameType = f;
+    if (frameType < 0 || frameData[frameType].frameWidth != frameWidth || frameData[frameType].frameHeight != frameHeight) {
+      LOG_WRN("Skipped %s with different frame size", editFiles[i].fileName.c_str());
+      continue;
+    }
+    // frames stripped of tables held once in timelapse are copied as is, others are saved whole
+    size_t insertPos = 0;
+    size_t tablesLen = readJpegTables(srcFile, editTables, insertPos);
+    bool sameTables = tablesLen == tlTablesLen && insertPos == tlTablesPos && !memcmp(editTables, tlTables, tablesLen);
+    size_t idxPos = srcInfo.hdrLen + srcInfo.moviLen + CHUNK_HDR;
+    uint32_t entryCnt = srcInfo.idxLen / IDX_ENTRY;
+    for (uint32_t e = 0; e < entryCnt && ok; e++) {
+      uint32_t pageEntry = e % (EDIT_IDX_PAGE / IDX_ENTRY);
+      if (!pageEntry) {
+        srcFile.seek(idxPos + e * IDX_ENTRY, SeekSet);
+        srcFile.read(idxPage, EDIT_IDX_PAGE);
+        // report progress through day's recordings
+        uint32_t elapsed = std::max(millis() - cTime, 1UL);
+        snprintf(editStatus, sizeof(editStatus), "Timelapse %u%%, %u kB/s", 
+          (uint32_t)((i * 100 + (uint64_t)e * 100 / entryCnt) / editFiles.size()), (uint32_t)(copiedLen / elapsed * 1000 / 1024));
+      }
+      uint8_t* entry = idxPage + pageEntry * IDX_ENTRY;
+      if (memcmp(entry, dcBuf, 4)) continue; // not a frame
+      if (!(frameNum++ % everyN)) {
+        // copy frame with its chunk header
+        uint32_t chunkOffset, chunkSize;
+        memcpy(&chunkOffset, entry+8, 4);
+        memcpy(&chunkSize, entry+12, 4);
+        if (!frameCntTL) {
+          // first frame keeps its capture time and the recording's Huffman tables
+          bool hasTables;
+          size_t sideLen = copySideChunks(srcFile, outFile, srcInfo.hdrLen, srcInfo.hdrLen + chunkOffset, hasTables);
+          addAviJunk(sideLen, true);
+          copiedLen += sideLen;
+          if (hasTables) {
+            memcpy(tlTables, editTables, tablesLen);
+            tlTablesLen = tablesLen;
+            tlTablesPos = insertPos;
+            sameTables = true;
+          } else sameTables = !tablesLen;
+        }
+        uint32_t frameSize = sameTables ? copyFrame(srcFile, outFile, srcInfo.hdrLen + chunkOffset, chunkSize, 0, 0)
+          : copyFrame(srcFile, outFile, srcInfo.hdrLen + chunkOffset, chunkSize, tablesLen, insertPos);
+        ok = frameSize > 0;
+        if (ok) {
+          buildAviIdx(frameSize, true, true);
+          copiedLen += frameSize + CHUNK_HDR;
+          frameCntTL++;
+        }
+      }
+    }
+    srcFile.close();
+  }
+  if (ok && frameCntTL) {
+    // add index and header
+    finalizeAviIndex(true);
+    size_t idxLen = 0;
+    do {
+      idxLen = writeAviIndex(editBuff, EDIT_BUFF, true);
+      outFile.write(editBuff, idxLen);
+    } while (idxLen > 0);
+    xSemaphoreTake(aviMutex, portMAX_DELAY);
+    buildAviHdr(tlPlaybackFPS, frameType, frameCntTL, true);
+    outFile.seek(0, SeekSet);
+    outFile.write(aviHeader, AVI_HEADER_LEN);
+    xSemaphoreGive(aviMutex);
+  }
+  outFile.close();
+  tlIndexBusy = false;
+  if (!ok || !frameCntTL) {
+    SD_MMC.remove(EDITTEMP);
+    LOG_ERR("Failed to compile timelapse for %s", folder);
+    strcpy(editStatus, "Timelapse failed");
+    return false;
+  }
+  // name in same format as time lapse recording
+  char partName[FILE_NAME_LEN];
+  char tlName[FILE_NAME_LEN];
+  uint8_t playbackFPS = tlPlaybackFPS ? tlPlaybackFPS : 1;
+  strftime(partName, sizeof(partName), "/%Y%m%d/%Y%m%d_%H%M%S", localtime(&editFiles[0].startTime));
+  int tlen = snprintf(tlName, FILE_NAME_LEN - 1, "%s_%s_%u_%u_%u_T.%s", 
+    partName, frameData[frameType].frameSizeStr, playbackFPS, frameCntTL / playbackFPS, frameCntTL, FILE_EXT);
+  if (tlen > FILE_NAME_LEN - 1) LOG_WRN("file name truncated");
+  SD_MMC.rename(EDITTEMP, tlName);
+  uint32_t elapsed = std::max(millis() - cTime, 1UL);
+  snprintf(editStatus, sizeof(editStatus), "Timelapse done, %u frames", frameCntTL);
+  LOG_INF("Compiled %s from %u recordings, %u frames in %lu ms, %u kB/s", tlName, editFiles.size(), 
+    frameCntTL, elapsed, (uint32_t)(copiedLen / elapsed * 1000 / 1024));
+  return true;
+}
+
+static void mergeFolder(const char* folder) {
+  // merge each run of consecutive recordings in day folder
+  std::vector<editFile> editFiles;
+  if (!listRecordings(folder, editFiles)) return;
+  size_t runStart = 0;
+  size_t runSize = 0;
+  for (size_t i = 0; i <= editFiles.size(); i++) {
+    bool inRun = false;
+    if (i > runStart && i < editFiles.size()) {
+      // start of recording is within gap after end of previous recording
+      time_t prevEnd = editFiles[i - 1].startTime + editFiles[i - 1].duration;
+      inRun = editFiles[i].startTime >= prevEnd - 1 && editFiles[i].startTime <= prevEnd + mergeGapSecs
+        && runSize + editFiles[i].fileSize < MERGE_MAX_SIZE && i - runStart < MAX_MERGE;
+    }
+    if (!inRun) {
+      if (i - runStart > 1) mergeAvis(editFiles, runStart, i);
+      runStart = i;
+      runSize = 0;
+    }
+    if (i < editFiles.size()) runSize += editFiles[i].fileSize;
+  }
+}
+
+/************** background task ***************/
+
+static void editTask(void* parameter) {
+  // perform edit alongside any recording, at low priority with throttled SD access
+  editBuff = (uint8_t*)malloc(EDIT_BUFF + EDIT_IDX_PAGE);
+  if (editBuff == NULL) LOG_ERR("Insufficient memory for edit buffer");
+  else {
+    if (editAction == EDIT_MERGE) mergeFolder(editPath);
+    else if (editAction == EDIT_TRIM) trimAvi(editPath, trimFrom, trimTo);
+    else compileTimelapse(editPath, compileEvery);
+    free(editBuff);
+    editBuff = NULL;
+  }
+  editInProgress = false;
+  vTaskDelete(NULL);
+}
+
+static bool startEdit(editType action, const char* path) {
+  // start background edit task, one edit at a time
+  if (!editInProgress) {
+    editInProgress = true;
+    editAction = action;
+    strcpy(editPath, path);
+    xTaskCreate(&editTask, "editTask", 1024 * 4, NULL, 1, &editHandle);
+    return true;
+  } else LOG_WRN("Unable to edit %s as another edit in progress", path);
+  return false;
+}
+
+bool mergeRecordings(const char* folder) {
+  // called from other functions to commence background merge of recordings in day folder
+  return startEdit(EDIT_MERGE, folder);
+}
+
+bool compileRecordings(const char* compileArgs) {
+  // commence timelapse of day folder, from web request: compile=<folder>&every=<N>
+  char compileFolder[FILE_NAME_LEN];
+  const char* everyPtr = strstr(compileArgs, "&every=");
+  size_t folderLen = everyPtr == NULL ? strlen(compileArgs) : everyPtr - compileArgs;
+  if (folderLen >= FILE_NAME_LEN || editInProgress) {
+    LOG_ERR("Invalid timelapse request %s", compileArgs);
+    return false;
+  }
+  strncpy(compileFolder, compileArgs, folderLen);
+  compileFolder[folderLen] = 0;
+  compileEvery = everyPtr == NULL ? 0 : atoi(everyPtr + 7);
+  if (!compileEvery) compileEvery = COMPILE_EVERY;
+  strcpy(editStatus, "Timelapse pending");
+  return startEdit(EDIT_TIMELAPSE, compileFolder);
+}
+
+bool trimRecording(const char* trimArgs) {
+  // commence trim of recording, from web request: trim=<file>&from=<secs>&to=<secs>
+  char trimFile[FILE_NAME_LEN];
+  const char* fromPtr = strstr(trimArgs, "&from=");
+  const char* toPtr = strstr(trimArgs, "&to=");
+  if (fromPtr == NULL || toPtr == NULL || fromPtr - trimArgs >= FILE_NAME_LEN || editInProgress) {
+    LOG_ERR("Invalid trim request %s", trimArgs);
+    return false;
+  }
+  strncpy(trimFile, trimArgs, fromPtr - trimArgs);
+  trimFile[fromPtr - trimArgs] = 0;
+  trimFrom = atoi(fromPtr + 6);
+  trimTo = atoi(toPtr + 4);
+  return startEdit(EDIT_TRIM, trimFile);
+}
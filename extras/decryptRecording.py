@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+# Decrypt AVI or MP4 recordings made with Enc_Pass set, so that they play on a media application.
+# Content after the plaintext JENC details is AES-256-CTR, keyed by PBKDF2-HMAC-SHA256 of the
+# passphrase and the salt, with counter block of the nonce and the file position / 16, see avi.cpp.
+# AVI: JENC JUNK chunk at start of movi, movi content encrypted, or rest of file if OpenDML.
+# MP4: JENC free box after init segment, rest of file encrypted.
+# The JENC details are cleared in the decrypted copy, so that it is not taken as encrypted.
+# Needs the cryptography package: pip install cryptography
+#
+# usage: decryptRecording.py [-p passphrase] recording [output]
+#   output defaults to recording name with _dec added, passphrase is prompted for if not given
+#
+# s60sc 2022
+
+import argparse
+import getpass
+import hashlib
+import os
+import struct
+import sys
+from cryptography.hazmat.primitives.ciphers import Cipher, algorithms, modes
+
+SALT_LEN = 16
+NONCE_LEN = 8
+JENC_LEN = 8 + 4 + SALT_LEN + NONCE_LEN
+KDF_ITERATIONS = 10000
+VID_STRL_END = 0xCC  # position of video super index in OpenDML header
+SCAN_LEN = 64 * 1024  # header and init segment are within this
+COPY_LEN = 1024 * 1024
+
+
+def findJenc(head):
+  # locate JENC details, returning file position of chunk or box, and end of encrypted content
+  if head[0:4] == b"RIFF" and head[8:12] == b"AVI ":
+    jencPos = head.find(b"JUNK" + struct.pack("<I", JENC_LEN - 8) + b"JENC")
+    if jencPos < 0: return None
+    if head[VID_STRL_END:VID_STRL_END+4] == b"indx": return jencPos, None  # OpenDML
+    moviListSize = struct.unpack_from("<I", head, jencPos - 8)[0]
+    # header is empty if recording was not finished
+    return jencPos, jencPos + moviListSize - 4 if moviListSize > 4 else None
+  if head[4:8] == b"ftyp":
+    jencPos = head.find(struct.pack(">I", JENC_LEN) + b"free" + b"JENC")
+    return (jencPos, None) if jencPos >= 0 else None
+  return None
+
+
+def decrypt(inName, outName, passphrase):
+  with open(inName, "rb") as inFile:
+    head = inFile.read(SCAN_LEN)
+    found = findJenc(head)
+    if found is None:
+      sys.exit(inName + " is not an encrypted recording")
+    jencPos, cryptEnd = found
+    salt = head[jencPos+12:jencPos+12+SALT_LEN]
+    nonce = head[jencPos+12+SALT_LEN:jencPos+JENC_LEN]
+    key = hashlib.pbkdf2_hmac("sha256", passphrase.encode(), salt, KDF_ITERATIONS, 32)
+    cryptStart = jencPos + JENC_LEN
+    fileSize = os.path.getsize(inName)
+    cryptEnd = fileSize if cryptEnd is None else min(cryptEnd, fileSize)
+    counter = nonce + struct.pack(">Q", cryptStart // 16)
+    decryptor = Cipher(algorithms.AES(key), modes.CTR(counter)).decryptor()
+    decryptor.update(bytes(cryptStart % 16))  # start part way through keystream block
+    # first chunk or box after JENC has a 4 character id
+    checker = Cipher(algorithms.AES(key), modes.CTR(counter)).decryptor()
+    firstId = checker.update(bytes(cryptStart % 16) + head[cryptStart:cryptStart+4])[-4:]
+    if cryptStart + 4 <= cryptEnd and not all(chr(c).isalnum() or c == 0x20 for c in firstId):
+      sys.exit("Wrong passphrase for " + inName)
+    with open(outName, "wb") as outFile:
+      inFile.seek(0)
+      outFile.write(inFile.read(jencPos + 12))
+      outFile.write(bytes(SALT_LEN + NONCE_LEN))
+      inFile.seek(cryptStart)
+      filePos = cryptStart
+      while filePos < cryptEnd:
+        data = inFile.read(min(COPY_LEN, cryptEnd - filePos))
+        if not data: break
+        outFile.write(decryptor.update(data))
+        filePos += len(data)
+      # plaintext index of legacy avi
+      while True:
+        data = inFile.read(COPY_LEN)
+        if not data: break
+        outFile.write(data)
+  return outName
+
+
+def main():
+  parser = argparse.ArgumentParser(description="Decrypt recording made with Enc_Pass set")
+  parser.add_argument("-p", "--passphrase", help="recording passphrase, prompted for if not given")
+  parser.add_argument("recording")
+  parser.add_argument("output", nargs="?")
+  args = parser.parse_args()
+  root, ext = os.path.splitext(args.recording)
+  outName = args.output or root + "_dec" + ext
+  passphrase = args.passphrase if args.passphrase is not None else getpass.getpass("Passphrase: ")
+  print("Decrypted to", decrypt(args.recording, outName, passphrase))
+
+
+if __name__ == "__main__":
+  main()
@@ -17,6 +17,7 @@ static char rspBuf[256]; // Ftp response buffer
 static char respCodeRx[4]; // ftp response code                        
 TaskHandle_t ftpHandle = NULL;
 static char storedPathName[FILE_NAME_LEN];
+static char* crcBuff = NULL; // checksum manifest of folder being uploaded
 static bool uploadInProgress = false;
 static fs::FS fp = STORAGE;
 #define NO_CHECK "999"
@@ -123,13 +124,33 @@ static bool openDataPort() {
   return true;
 }
 
+static void ftpStoreChecksum(const char* fileName, const char* crcStr) {
+  // store checksum alongside uploaded file, then verify upload if server supports XCRC
+  char crcName[FILE_NAME_LEN];
+  char crcLine[FILE_NAME_LEN + 12];
+  snprintf(crcName, sizeof(crcName), "%s.crc32", fileName);
+  int crcLen = snprintf(crcLine, sizeof(crcLine), "%s  %s\n", crcStr, fileName);
+  openDataPort();
+  if (sendFtpCommand("STOR ", crcName, "150", "125")) {
+    dclient.write((const uint8_t*)crcLine, crcLen);
+    dclient.stop();
+    sendFtpCommand("", "", "226");
+  }
+  if (!sendFtpCommand("XCRC ", fileName, NO_CHECK)) return;
+  if (strcmp(respCodeRx, "250") != 0) {
+    LOG_DBG("Server does not support XCRC: %s %s", respCodeRx, rspBuf);
+  } else if (strcasestr(rspBuf, crcStr) != NULL) LOG_INF("Upload verified, crc32: %s", crcStr);
+  else LOG_ERR("Upload checksum mismatch, expected %s, got %s", crcStr, rspBuf);
+}
+
 static bool ftpStoreFile(File &fh) {
   // Upload individual file to current folder, overwrite any existing file  
-  if (strstr(fh.name(), FILE_EXT) == NULL) return false; // folder, or not valid file type    
+  if (strstr(fh.name(), FILE_EXT) == NULL && strstr(fh.name(), MP4_EXT) == NULL) return false; // folder, or not valid file type    
   char ftpSaveName[FILE_NAME_LEN];
   strcpy(ftpSaveName, fh.name());
   size_t fileSize = fh.size();
   LOG_INF("Upload file: %s, size: %0.1fMB", ftpSaveName, (float)(fileSize)/ONEMEG);    
+  if (strstr(fh.name(), FILE_EXT) != NULL && isCompactAvi(fh)) LOG_WRN("%s stored with compactJpeg, only plays in app", ftpSaveName);
 
   // open data connection
   openDataPort();
@@ -159,6 +180,8 @@ static bool ftpStoreFile(File &fh) {
   refreshVal = saveRefreshVal;
   if (sendFtpCommand("", "", "226")) LOG_INF("Uploaded %0.1fMB in %u sec", (float)(writeBytes) / ONEMEG, (millis() - uploadStart) / 1000); 
   else LOG_ERR("File transfer not successful");
+  char crcStr[9];
+  if (findChecksum(crcBuff, ftpSaveName, fileSize, crcStr)) ftpStoreChecksum(ftpSaveName, crcStr);
   return true;
 }
 
@@ -181,11 +204,16 @@ static void uploadFolderOrFileFtp() {
    
   if (!root.isDirectory()) {
     // Upload a single file 
+    char folder[FILE_NAME_LEN];
+    strcpy(folder, root.path());
+    *strrchr(folder, '/') = 0;
+    crcBuff = loadChecksums(folder);
     if (getFolderName(root.path())) ftpStoreFile(root); 
   } else {  
     // Upload a whole folder, file by file
     LOG_INF("Uploading folder: ", root.name()); 
     if (!createFtpFolder(root.name())) return;
+    crcBuff = loadChecksums(root.path());
     File fh = root.openNextFile();            
     while (fh) {
       if (!ftpStoreFile(fh)) break; // abandon rest of files
@@ -201,6 +229,8 @@ static void FTPtask(void* parameter) {
   // process an FTP request
   doPlayback = false; // close any current playback
   uploadFolderOrFileFtp();
+  free(crcBuff);
+  crcBuff = NULL;
   // Disconnect from ftp server
   client.println("QUIT");
   dclient.stop();
@@ -60,7 +60,7 @@ void getOldestDir(char* oldestDir);
 void goToSleep(int wakeupPin, bool deepSleep);
 void initStatus(int cfgGroup, int delayVal);
 void listBuff(const uint8_t* b, size_t len); 
-bool listDir(const char* fname, char* jsonBuff, size_t jsonBuffLen, const char* extension);
+bool listDir(const char* fname, char* jsonBuff, size_t jsonBuffLen, const char* extension, const char* altExtension = NULL);
 bool loadConfig();
 void logPrint(const char *fmtStr, ...);
 void logSetup();
@@ -0,0 +1,61 @@
+/*
+Capture governor policy, deciding FPS and jpeg quality for next sample window 
+from writer load, write ring occupancy and lost frames in last window.
+Pure arithmetic on given state, with no Arduino or ESP-IDF dependencies.
+
+s60sc 2020, 2022
+*/
+
+#include "governor.h"
+#include <algorithm>
+
+#define GOV_HIGH_LOAD 80 // writer busy % at or above which load is reduced
+#define GOV_LOW_LOAD 50 // writer busy % at or below which load can be restored
+#define GOV_HIGH_RING 50 // write ring % at or above which load is reduced
+#define GOV_LOW_RING 10 // write ring % at or below which load can be restored
+#define GOV_SETTLE_WINDOWS 2 // windows after a change before next change, unless frames lost
+#define GOV_CALM_WINDOWS 5 // consecutive windows with headroom before load restored
+#define GOV_QUALITY_STEP 5 // change in quality number per step
+
+// per frameData entry
+static const govPolicy govPolicies[] = {
+  {10, 30}, {10, 30}, {10, 30}, {10, 30}, {10, 30}, // 96X96 to 240X240
+  {8, 30}, {8, 30}, {6, 30}, // QVGA, CIF, HVGA
+  {5, 25}, {5, 25}, // VGA, SVGA
+  {2, 20}, {2, 20}, {1, 20}, {1, 20} // XGA, HD, SXGA, UXGA
+};
+
+const govPolicy& getGovPolicy(uint8_t frameType) {
+  // policy for frame size, larger frame sizes use policy of largest
+  return govPolicies[std::min((size_t)frameType, sizeof(govPolicies) / sizeof(govPolicies[0]) - 1)];
+}
+
+bool govDecide(govState& gs, const govSample& sample, const govPolicy& policy) {
+  // decide settings for next window from load sample, returns true if changed
+  // only updates given state, so can be replayed against recorded load samples
+  bool pressure = sample.lost || sample.loadPct >= GOV_HIGH_LOAD || sample.ringPct >= GOV_HIGH_RING;
+  bool headroom = !sample.lost && sample.loadPct <= GOV_LOW_LOAD && sample.ringPct <= GOV_LOW_RING;
+  gs.calm = headroom ? std::min(gs.calm + 1, 255) : 0;
+  if (gs.settle && !sample.lost) {
+    // allow previous change to take effect
+    gs.settle--;
+    return false;
+  }
+  // user settings already beyond policy limits are left as is
+  int minFPS = std::min(policy.minFPS, gs.userFPS);
+  int maxQuality = std::max(policy.maxQuality, gs.userQuality);
+  if (pressure) {
+    // lower jpeg quality (raise quality number) before frame rate
+    if (gs.quality < maxQuality) gs.quality = std::min(gs.quality + GOV_QUALITY_STEP, maxQuality);
+    else if (gs.fps > minFPS) gs.fps = std::max(gs.fps * 3 / 4, minFPS);
+    else return false;
+  } else if (gs.calm >= GOV_CALM_WINDOWS) {
+    // restore frame rate before jpeg quality
+    if (gs.fps < gs.userFPS) gs.fps = std::min(gs.fps + std::max(gs.fps / 4, 1), (int)gs.userFPS);
+    else if (gs.quality > gs.userQuality) gs.quality = std::max(gs.quality - GOV_QUALITY_STEP, (int)gs.userQuality);
+    else return false;
+  } else return false;
+  gs.settle = GOV_SETTLE_WINDOWS;
+  gs.calm = 0;
+  return true;
+}
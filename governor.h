@@ -0,0 +1,32 @@
+// Capture governor policy declarations
+// Only uses standard headers, so that policy can be built on host
+// and replayed against load samples recorded on device
+//
+// s60sc 2021, 2022
+
+#pragma once
+#include <stdint.h>
+
+#define GOV_WINDOW_MS 1000 // period over which recording load sampled
+
+// lowest FPS and highest quality number (ie lowest jpeg quality) governor can use for a frame size
+struct govPolicy {
+  uint8_t minFPS;
+  uint8_t maxQuality;
+};
+
+struct govSample {
+  uint8_t loadPct; // writer busy time as % of window
+  uint8_t ringPct; // write ring occupancy at end of window
+  uint32_t lost; // frames skipped, dropped or not captured in window
+};
+
+struct govState {
+  uint8_t userFPS, userQuality; // settings when recording started, not exceeded
+  uint8_t fps, quality; // settings currently applied
+  uint8_t settle; // windows remaining before next change
+  uint8_t calm; // consecutive windows with headroom
+};
+
+const govPolicy& getGovPolicy(uint8_t frameType);
+bool govDecide(govState& gs, const govSample& sample, const govPolicy& policy);
@@ -1,5 +1,6 @@
 
-// Creates 16 bit single channel PCM WAV file from microphone input.
+// Captures 16 bit single channel PCM from microphone input,
+// which is interleaved into the AVI file as it is recorded.
 // Default sample rate is 16kHz
 // Audio is not replayed on streaming, only via AVI file
 
@@ -24,24 +25,23 @@ const uint32_t SAMPLE_RATE = 16000; // sample rate used
 static const uint8_t sampleWidth = sizeof(int32_t); 
 static const uint8_t audWidth = sizeof(int16_t);
 static const size_t sampleBytes = DMA_BUFF_LEN * sampleWidth;
-static File wavFile;
+// up to 1 sec of audio between frames, plus any SD write stall delaying collection by writer task
+static const size_t audChunkSize = SAMPLE_RATE * audWidth * (1000 + WRITE_STALL_MS) / 1000;
 static int totalSamples = 0;
+static uint32_t droppedSamples = 0;
 static TaskHandle_t micHandle = NULL;
 static bool doMicCapture = false;
 static bool captureRunning = false;
 static int32_t* sampleBuffer = NULL;
-static int16_t* audBuffer = NULL;
 static QueueHandle_t i2s_queue = NULL;
 static i2s_event_t event;
 static i2s_pin_config_t i2s_mic_pins;
 
-
-const uint32_t WAV_HEADER_LEN = 44; // WAV header length
-static uint8_t wavHeader[WAV_HEADER_LEN] = { // WAV header template
-  0x52, 0x49, 0x46, 0x46, 0x00, 0x00, 0x00, 0x00, 0x57, 0x41, 0x56, 0x45, 0x66, 0x6D, 0x74, 0x20,
-  0x10, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x11, 0x2B, 0x00, 0x00, 0x11, 0x2B, 0x00, 0x00,
-  0x02, 0x00, 0x10, 0x00, 0x64, 0x61, 0x74, 0x61, 0x00, 0x00, 0x00, 0x00,
-};
+// double buffered pcm, one filled by mic while other is written to AVI
+static uint8_t* audChunk[2] = {NULL, NULL};
+static size_t audChunkLen[2];
+static uint8_t audActive = 0;
+static SemaphoreHandle_t audMutex = NULL;
 
 /**********************************/
 
@@ -91,7 +91,7 @@ static void stopMic() {
 }
 
 static void getRecording() {
-  // copy I2S data to SD
+  // copy I2S data to buffer for inclusion in AVI
   size_t bytesRead = totalSamples = 0;
   const uint8_t gainFactor = 16 + 1 - micGain; 
   captureRunning = true;
@@ -101,11 +101,16 @@ static void getRecording() {
        if (event.type == I2S_EVENT_RX_DONE) {
          i2s_read(I2S_MIC, sampleBuffer, sampleBytes, &bytesRead, portMAX_DELAY);
          int samplesRead = bytesRead / sampleWidth;
-         // process each sample, convert to amplified 16 bit 
-         for (int i = 0; i < samplesRead; i++) {
-          audBuffer[i] = constrain(sampleBuffer[i] >> gainFactor, SHRT_MIN, SHRT_MAX);
-         }
-         wavFile.write((uint8_t*)audBuffer, samplesRead * audWidth);
+         xSemaphoreTake(audMutex, portMAX_DELAY);
+         if (audChunkLen[audActive] + (samplesRead * audWidth) <= audChunkSize) {
+           // process each sample, convert to amplified 16 bit 
+           int16_t* audBuffer = (int16_t*)(audChunk[audActive] + audChunkLen[audActive]);
+           for (int i = 0; i < samplesRead; i++) {
+            audBuffer[i] = constrain(sampleBuffer[i] >> gainFactor, SHRT_MIN, SHRT_MAX);
+           }
+           audChunkLen[audActive] += samplesRead * audWidth;
+         } else droppedSamples += samplesRead; // not collected in time by task saving frames
+         xSemaphoreGive(audMutex);
          totalSamples += samplesRead;
        }
      }  
@@ -116,7 +121,8 @@ static void getRecording() {
 static void micTask(void* parameter) {
   startMic();
   if (sampleBuffer == NULL) sampleBuffer = (int32_t*)malloc(DMA_BUFF_LEN * sampleWidth);
-  if (audBuffer == NULL) audBuffer = (int16_t*)malloc(DMA_BUFF_LEN * audWidth);
+  for (int i = 0; i < 2; i++) 
+    if (audChunk[i] == NULL) audChunk[i] = (uint8_t*)ps_malloc(audChunkSize);
   while (true) {
     // wait for recording request
     ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
@@ -128,36 +134,37 @@ static void micTask(void* parameter) {
 }
 
 void startAudio() {
-  // start audio recording and write recorded audio to SD card as WAV file 
-  // combined into AVI file as PCM channel on FTP upload or browser download
-  // so can be read by media players
+  // start audio recording, which is collected by getAudioChunk() 
+  // and interleaved into AVI file as PCM channel so can be read by media players
   if (micUse && micGain) {
-    wavFile = SD_MMC.open(WAVTEMP, FILE_WRITE);
-    wavFile.write(wavHeader, WAV_HEADER_LEN); 
+    audChunkLen[0] = audChunkLen[1] = droppedSamples = 0;
     wakeTask(micHandle);
   } 
 }
 
+size_t getAudioChunk(uint8_t** chunkPtr) {
+  // swap buffers, returning audio captured since previous call
+  // called for each frame as it is saved, by writer task if write ring used, else capture task,
+  // and when recording finished
+  if (audMutex == NULL) return 0;
+  xSemaphoreTake(audMutex, portMAX_DELAY);
+  uint8_t filled = audActive;
+  audActive = 1 - audActive;
+  audChunkLen[audActive] = 0;
+  xSemaphoreGive(audMutex);
+  *chunkPtr = audChunk[filled];
+  return audChunkLen[filled];
+}
+
 void finishAudio(bool isValid) {
   if (doMicCapture) {
-    // finish a recording and save if valid
+    // finish a recording, remaining audio then collected by getAudioChunk()
     doMicCapture = false; 
     while (captureRunning) delay(100); // wait for getRecording() to complete
     if (isValid) {
-      // update wav header
-      uint32_t dataBytes = totalSamples * audWidth;
-      uint32_t wavFileSize = dataBytes + WAV_HEADER_LEN - 8; // wav file size excluding chunk header
-      memcpy(wavHeader+4, &wavFileSize, 4);
-      memcpy(wavHeader+24, &SAMPLE_RATE, 4); // sample rate
-      uint32_t byteRate = SAMPLE_RATE * audWidth; // byte rate (SampleRate * NumChannels * BitsPerSample/8)
-      memcpy(wavHeader+28, &byteRate, 4); 
-      memcpy(wavHeader+WAV_HEADER_LEN-4, &dataBytes, 4); // wav data size
-      wavFile.seek(0, SeekSet); // start of file
-      wavFile.write(wavHeader, WAV_HEADER_LEN); // overwrite default header
-      wavFile.close();  
       LOG_INF("Captured %d audio samples with gain factor %i", totalSamples, micGain);
-      LOG_INF("Saved %ukB to SD for %s", (dataBytes + WAV_HEADER_LEN) / 1024, WAVTEMP);
-    }
+      if (droppedSamples) LOG_WRN("Dropped %u audio samples", droppedSamples);
+    } else audChunkLen[0] = audChunkLen[1] = 0;
   }
 }
 
@@ -165,6 +172,7 @@ void prepMic() {
   if (micUse) { 
     if (micSckPin && micWsPin && micSdPin) {
       LOG_INF("Sound recording is available");
+      audMutex = xSemaphoreCreateMutex();
       xTaskCreate(micTask, "micTask", 1024 * 4, NULL, 1, &micHandle);
       debugMemory("prepMic");
     } else {
@@ -7,6 +7,8 @@
 */
 
 #include "appGlobals.h"
+#include "governor.h"
+#include "esp_rom_crc.h"
 
 // user parameters set from web
 bool useMotion  = true; // whether to use camera for motion detection (with motionDetect.cpp)
@@ -17,6 +19,23 @@ bool forceRecord = false; // Recording enabled by rec button
 int moveStartChecks = 5; // checks per second for start motion
 int moveStopSecs = 2; // secs between each check for stop, also determines post motion time
 int maxFrames = 20000; // maximum number of frames in video before auto close 
+bool useOpenDML = false; // use OpenDML (AVI 2.0) for recordings beyond 1GB
+bool useFilePool = false; // record into pre-allocated files to avoid FAT allocation delays
+int poolFileMB = 64; // size of each pre-allocated file
+bool rawSectors = false; // write recording direct to sectors of contiguous pool file, bypassing FAT
+bool alignFrames = false; // pad frames to start on SD sector boundary
+bool compactJpeg = false; // store repeated Huffman tables once per recording
+bool dupFrames = false; // store near duplicate frames of static scene as index entries only
+bool statsInName = true; // include FPS, duration and frame count in recording file name
+bool fileChecksum = false; // calculate CRC32 of each recording while it is written
+bool frameTimes = false; // save sequence number and capture time of each frame
+int thumbSecs = 0; // interval between thumbnails in recording, 0 for none
+int segmentMins = 0; // continuous recording in segments of given minutes, 0 for off
+bool useMP4 = false; // record fragmented MP4 instead of AVI
+int writeRingKB = 0; // max PSRAM ring holding frames for SD writer task, 0 to write on capture task
+int preRollSecs = 0; // secs of frames before capture started to include in recording, 0 for off
+int preRollKB = 1024; // PSRAM ring holding pre-roll frames
+bool useGovernor = false; // lower FPS and jpeg quality while recording if SD cannot keep up
 
 // record timelapse avi independently of motion capture, file name has same format as avi except ends with T
 int tlSecsBetweenFrames; // too short interval will interfere with other activities
@@ -34,13 +53,16 @@ uint8_t xclkMhz = 20; // camera clock rate MHz
 
 // header and reporting info
 static uint32_t vidSize; // total video size
-static uint16_t frameCnt;
+static uint32_t frameCnt;
 static uint32_t startTime; // total overall time
 static uint32_t dTimeTot; // total frame decode/monitor time
 static uint32_t fTimeTot; // total frame buffering time
 static uint32_t wTimeTot; // total SD write time
+static uint32_t writerBusyMs = 0; // cumulative time spent saving frames, for load sampling
 static uint32_t oTime; // file opening time
-static uint32_t cTime; // file closing time
+uint32_t maxOpenTime = 0; // worst case file opening time
+uint32_t maxCloseTime = 0; // worst case file closing time
+uint32_t maxCloseStall = 0; // worst case capture stall when file closed
 static uint32_t sTime; // file streaming time
 
 uint8_t frameDataRows = 14;                         
@@ -48,10 +70,71 @@ static uint16_t frameInterval; // units of 0.1ms between frames
 
 // SD card storage
 #define MAX_JPEG ONEMEG/2 // UXGA jpeg frame buffer at highest quality 375kB rounded up
-uint8_t iSDbuffer[(RAMSIZE + CHUNK_HDR) * 2];
+#define DUP_SIZE_PERMILLE 3 // max size difference of near duplicate frame from last stored frame
+uint8_t iSDbuffer[(RAMSIZE + CHUNK_HDR) * 2] __attribute__((aligned(4))); // word aligned for SD DMA
 static size_t highPoint;
 static File aviFile;
 static char aviFileName[FILE_NAME_LEN];
+static bool isPooled = false; // aviFile claimed from file pool
+static uint32_t rawSector = 0; // first sector of aviFile if written direct to sectors, else 0
+static uint8_t rawDrv; // FatFs physical drive holding aviFile
+static size_t rawLen, rawPos; // contiguous extent of aviFile, and position of next write
+static uint8_t extentSector[SECTOR_SIZE] __attribute__((aligned(4))); // first sector of pooled recording, holding extent written
+static uint32_t extentTime; // when extent of pooled recording last stamped
+static SemaphoreHandle_t poolMutex = NULL; // pool folder is filled by pool task and claimed by capture task
+static volatile bool poolRefill = false; // pool files claimed since pool last filled
+static TaskHandle_t poolHandle = NULL;
+static const char* recTemp = AVITEMP; // temporary name of file being recorded
+static char recName[FILE_NAME_LEN]; // final name of file recorded without temporary name
+static const char* nameTemp = NULL; // file marking recording under recName as in progress
+static uint8_t captureTrigger; // CAPTURE_ bits for what started current recording
+static uint32_t motionChecks, motionHits; // motion checks during current recording
+static bool isMP4 = false; // current recording is fragmented MP4
+static size_t fragPos = 0; // file position of current MP4 fragment, 0 if none
+static uint32_t fileCrc, crcLen; // running CRC32 of recording, excluding header written when closed
+static uint32_t fragCrc, fragCrcLen; // CRC32 of current MP4 fragment content after its header space
+static size_t lastJpegLen; // size of last frame stored in full
+static uint32_t dupRun, dupFrameCnt; // consecutive and total frames stored as repeats
+static bool isCrypt = false; // current recording is encrypted
+static uint32_t cryptUs, cryptLen; // time spent encrypting current recording, and bytes encrypted
+static bool recFull = false; // recording cannot hold more frames, remaining queued frames discarded
+static int64_t firstCapUs, lastCapUs; // capture times of first and last frames in recording
+static uint32_t firstSeq, lastSeq; // sequence numbers of first and last frames in recording
+
+// continuous recording segments
+static bool isSegmented = false; // current recording is a segment
+static time_t segStart; // wall clock start of current segment
+static time_t segEndTime; // time boundary at which current segment is rotated
+
+// finished recording being completed by finalize task while next recording captured
+struct finishStruct {
+  File aviFile;
+  char tempName[FILE_NAME_LEN];
+  char fileName[FILE_NAME_LEN];
+  const char* nameTemp; // in progress marker of recording made without temporary name, else NULL
+  uint8_t* tailBuff; // content not yet written to file
+  size_t tailLen;
+  uint8_t hdrBuff[SECTOR_SIZE]; // avi header, if not yet written
+  size_t hdrLen;
+  bool isSegment, isValid, isPooled, isRaw, hasIdx, hasCrc;
+  uint32_t crc, crcLen; // running CRC32 of content after header
+  uint32_t hdrCrc, hdrCrcLen; // CRC32 of header
+  time_t startTime;
+  uint32_t duration; // ms
+  uint32_t frameCnt, vidSize;
+  uint8_t reqFPS;
+  float actualFPS;
+  uint32_t dTimeTot, fTimeTot, wTimeTot, oTime;
+  uint32_t closeStart, stallTime;
+  size_t alignPadding, tablesStripped;
+  uint32_t dupFrameCnt;
+  uint32_t cryptUs, cryptLen;
+  uint32_t dropped, skipped, failures, lost;
+  uint32_t idxEntryNs, idxPages, idxPageMs;
+};
+static finishStruct finRec = {};
+static TaskHandle_t finalizeHandle = NULL;
+static volatile bool finalizeInProgress = false;
 
 // SD playback
 static File playbackFile;
@@ -60,11 +143,22 @@ static size_t readLen;
 static uint8_t recFPS;
 static uint32_t recDuration;
 static uint8_t saveFPS = 99;
+static bool isMultiRiff = false;
+static bool isAlignedPlay = false; // frames aligned on sectors, so read direct to alternate buffers
+static size_t alignSkip; // offset of movi data in first sector
+static bool isCryptPlay = false; // playback file is encrypted
+static aviCryptStruct playCrypt;
+#define MAX_FRAME_GAP_US 2000000 // larger gap between capture times restarts playback pacing
+static int64_t nextFrameUs; // capture time of next frame to play, -1 if not recorded
+static int64_t prevFrameUs; // capture time of frame last played, 0 if none
+static int64_t paceCapUs, pacePlayUs; // capture time and play time that pacing is relative to
+static uint8_t* readBuff = iSDbuffer + RAMSIZE + CHUNK_HDR; // where next cluster is read to
 bool doPlayback = false;
 
 // task control
 TaskHandle_t captureHandle = NULL;
 TaskHandle_t playbackHandle = NULL;
+static TaskHandle_t writerHandle = NULL;
 static SemaphoreHandle_t readSemaphore;
 static SemaphoreHandle_t playbackSemaphore;
 SemaphoreHandle_t motionMutex = NULL;
@@ -76,6 +170,51 @@ static volatile bool isPlaying = false;
 bool isCapturing = false;
 bool stopPlayback = false;
 bool timeLapseOn = false;
+bool tlIndexBusy = false;
+
+// SD writer task, fed with frames copied into PSRAM ring by capture task
+#define WRITE_QUEUE_LEN 64 // max frames or actions awaiting writer task
+enum writeAction {WRITE_FRAME, WRITE_OPEN, WRITE_CLOSE};
+struct writeItem {
+  uint8_t action;
+  uint8_t trigger; // CAPTURE_ bits for WRITE_OPEN
+  uint8_t* buf; // copy of frame in ring
+  size_t len; // frame length
+  size_t ringLen; // ring space used, including any skipped at end of ring
+  struct timeval timestamp; // when frame captured
+  uint32_t seq; // frame sequence number
+  uint32_t dTime; // frame monitoring time
+};
+static QueueHandle_t writeQueue = NULL; // NULL if frames written by capture task
+static SemaphoreHandle_t ringMutex = NULL;
+// PSRAM byte ring, space used in order allocated and released oldest first
+struct byteRing {
+  uint8_t* buff;
+  size_t size, head, used;
+};
+static byteRing writeRing = {};
+static size_t ringHighWater = 0; // max ring bytes in use
+static uint32_t queueHighWater = 0; // max frames awaiting write
+static uint32_t ringDropped = 0; // frames dropped as ring or queue full
+static uint32_t dropBase; // ringDropped at start of current recording
+static uint32_t ticksSkipped = 0; // frame timer ticks discarded as capture task too slow
+static uint32_t fbFailures = 0; // frames not obtained from camera
+static uint32_t skipBase, failBase; // ticksSkipped and fbFailures at start of current recording
+static uint32_t frameSeq = 0; // sequence number of next frame, including frames lost
+
+// frames held while not capturing, saved at start of next recording
+#define PRE_ROLL_MAX 256 // max frames held for pre-roll
+struct preRollFrame {
+  size_t pos; // offset in ring
+  size_t len; // frame length
+  size_t ringLen; // ring space used
+  struct timeval timestamp; // when frame captured
+  uint32_t seq; // frame sequence number
+};
+static byteRing preRoll = {};
+static preRollFrame preRollFrames[PRE_ROLL_MAX];
+static uint16_t preRollFirst, preRollCnt; // oldest frame held, and number held
+static volatile bool preRollBusy = false; // held frames being saved to new recording
 
 /**************** timers & ISRs ************************/
 
@@ -109,23 +248,321 @@ void controlFrameTimer(bool restartTimer) {
 
 /**************** capture AVI  ************************/
 
-static void openAvi() {
+static void poolFileName(char* poolName, int poolNum, bool isRaw = rawSectors) {
+  // pool files allocated as a contiguous extent for raw sector writes are named separately
+  snprintf(poolName, FILE_NAME_LEN - 1, "%s/pool%d.%s", POOL_DIR, poolNum, isRaw ? "raw" : "tmp");
+}
+
+static bool needPoolFile(char* poolName, int poolNum) {
+  // whether pool file is missing, after removing any of other type
+  xSemaphoreTake(poolMutex, portMAX_DELAY);
+  poolFileName(poolName, poolNum, !rawSectors);
+  if (SD_MMC.exists(poolName)) SD_MMC.remove(poolName);
+  poolFileName(poolName, poolNum);
+  bool isMissing = !SD_MMC.exists(poolName);
+  xSemaphoreGive(poolMutex);
+  return isMissing;
+}
+
+static void fillFilePool() {
+  // create pre-extended files in hidden folder so that recording 
+  // writes into already allocated clusters
+  // files are created under staging name so capture task is only held by pool lock for rename
+  if (!useFilePool) return;
+  char poolName[FILE_NAME_LEN];
+  char newName[FILE_NAME_LEN];
+  SD_MMC.mkdir(POOL_DIR);
+  for (int i = 0; i < POOL_FILES; i++) {
+    if (isCapturing) {
+      // allocation competes with recording for the card, so resumed when idle
+      poolRefill = true;
+      return;
+    }
+    if (!needPoolFile(poolName, i)) continue;
+    snprintf(newName, FILE_NAME_LEN - 1, "%s/new.%s", POOL_DIR, rawSectors ? "raw" : "tmp");
+    uint32_t pTime = millis();
+    bool created;
+    if (rawSectors) created = createRawFile(newName, poolFileMB * ONEMEG);
+    else {
+      File poolFile = SD_MMC.open(newName, FILE_WRITE);
+      // extending file allocates its clusters without writing content, so it holds stale card content
+      created = poolFile && poolFile.seek(poolFileMB * ONEMEG - 1, SeekSet) && poolFile.write((uint8_t)0);
+      poolFile.close();
+    }
+    if (created) {
+      // pool slot may have been refilled by released recording meanwhile
+      xSemaphoreTake(poolMutex, portMAX_DELAY);
+      created = SD_MMC.rename(newName, poolName);
+      xSemaphoreGive(poolMutex);
+    }
+    if (created) LOG_DBG("Created %spool file %s in %lu ms", rawSectors ? "raw " : "", poolName, millis() - pTime);
+    else {
+      SD_MMC.remove(newName);
+      LOG_ERR("Failed to create pool file %s", poolName);
+    }
+  }
+}
+
+static bool claimPoolFile() {
+  // rename a pool file to be the recording file
+  char poolName[FILE_NAME_LEN];
+  bool claimed = false;
+  xSemaphoreTake(poolMutex, portMAX_DELAY);
+  for (int i = 0; i < POOL_FILES && useFilePool && !claimed; i++) {
+    poolFileName(poolName, i);
+    claimed = SD_MMC.exists(poolName) && SD_MMC.rename(poolName, recTemp);
+  }
+  xSemaphoreGive(poolMutex);
+  return claimed;
+}
+
+static void poolTask(void* parameter) {
+  fillFilePool();
+  poolHandle = NULL;
+  vTaskDelete(NULL);
+}
+
+static void checkFilePool() {
+  // refill pool in background once recording and its completion are finished
+  if (!poolRefill || isCapturing || finalizeInProgress || poolHandle != NULL) return;
+  if (writeQueue != NULL && uxQueueMessagesWaiting(writeQueue)) return;
+  poolRefill = false;
+  xTaskCreate(&poolTask, "poolTask", 1024 * 4, NULL, 1, &poolHandle);
+}
+
+static void releasePoolFile(const char* fileName, bool isRaw) {
+  // return unwanted recording file to pool, if still of required type
+  char poolName[FILE_NAME_LEN];
+  bool released = false;
+  xSemaphoreTake(poolMutex, portMAX_DELAY);
+  for (int i = 0; i < POOL_FILES && isRaw == rawSectors && !released; i++) {
+    poolFileName(poolName, i);
+    released = !SD_MMC.exists(poolName) && SD_MMC.rename(fileName, poolName);
+  }
+  if (!released) SD_MMC.remove(fileName);
+  xSemaphoreGive(poolMutex);
+}
+
+static void truncateFile(const char* fileName, size_t fileLen) {
+  // release clusters beyond given length, via VFS path
+  char vfsName[FILE_NAME_LEN];
+  snprintf(vfsName, sizeof(vfsName), "/sdcard%s", fileName);
+  truncate(vfsName, fileLen);
+}
+
+static uint32_t gf2Times(const uint32_t* mat, uint32_t vec) {
+  // multiply GF(2) matrix by vector
+  uint32_t sum = 0;
+  for (int i = 0; vec; vec >>= 1, i++) if (vec & 1) sum ^= mat[i];
+  return sum;
+}
+
+static void gf2Square(uint32_t* square, const uint32_t* mat) {
+  for (int i = 0; i < 32; i++) square[i] = gf2Times(mat, mat[i]);
+}
+
+static uint32_t crc32Combine(uint32_t crc1, uint32_t crc2, uint32_t len2) {
+  // CRC32 of two concatenated blocks from the CRC32 of each, as zlib crc32_combine(),
+  // so content can be checksummed in the order written rather than in file order
+  if (!len2) return crc1;
+  uint32_t even[32], odd[32];
+  odd[0] = 0xEDB88320; // reflected CRC32 polynomial
+  for (uint32_t i = 1, row = 1; i < 32; i++, row <<= 1) odd[i] = row;
+  gf2Square(even, odd); // operator for 2 zero bits
+  gf2Square(odd, even); // operator for 4 zero bits
+  // apply len2 zero bytes to crc1
+  while (len2) {
+    gf2Square(even, odd);
+    if (len2 & 1) crc1 = gf2Times(even, crc1);
+    len2 >>= 1;
+    if (!len2) break;
+    gf2Square(odd, even);
+    if (len2 & 1) crc1 = gf2Times(odd, crc1);
+    len2 >>= 1;
+  }
+  return crc1 ^ crc2;
+}
+
+#define EXTENT_MS 5000 // interval between updates of written extent of pooled recording, later content lost on power loss
+static const char extentTag[] = "XTNT"; // replaces RIFF tag in empty header of pooled recording
+
+static void cryptWrite(uint8_t* data, size_t dataLen, size_t filePos) {
+  // encrypt content in place before it is written at filePos
+  uint32_t cTime = micros();
+  encryptAvi(data, dataLen, filePos);
+  cryptUs += micros() - cTime;
+  cryptLen += dataLen;
+}
+
+static void startExtent(uint8_t* data) {
+  // mark empty header of pooled recording as holding its written extent, initially none
+  memcpy(data, extentTag, 4);
+  memset(data + 4, 0, 4);
+  memcpy(extentSector, data, SECTOR_SIZE);
+  extentTime = millis();
+}
+
+static void stampExtent() {
+  // periodically update written extent of pooled recording, 
+  // as pool file beyond it holds stale content which recovery must not scan
+  uint32_t extent = rawSector ? rawPos : aviFile.position();
+  memcpy(extentSector + 4, &extent, 4);
+  if (rawSector) {
+    if (!writeRawSectors(rawDrv, rawSector, extentSector, SECTOR_SIZE)) LOG_WRN("Failed to stamp recording extent");
+  } else {
+    aviFile.flush(); // content must be on card before extent covering it
+    aviFile.seek(0, SeekSet);
+    aviFile.write(extentSector, 8);
+    aviFile.seek(extent, SeekSet);
+  }
+  extentTime = millis();
+}
+
+static void aviWrite(uint8_t* data, size_t dataLen) {
+  // write sector multiple to recording, direct to its sectors if raw recording within extent
+  size_t filePos = rawSector ? rawPos : aviFile.position();
+  bool isExtent = isPooled && !isMP4;
+  if (isExtent && !filePos) startExtent(data);
+  bool isRaw = false;
+  if (rawSector && rawPos + dataLen <= rawLen) {
+    isRaw = writeRawSectors(rawDrv, rawSector + rawPos / SECTOR_SIZE, data, dataLen);
+    if (isRaw) rawPos += dataLen;
+    else LOG_ERR("Raw sector write failed at %u, reverting to file system", rawPos);
+  }
+  if (!isRaw) {
+    if (rawSector) {
+      // continue via file system from end of raw content
+      aviFile.seek(rawPos, SeekSet);
+      rawSector = 0;
+    }
+    aviFile.write(data, dataLen);
+  }
+  if (isExtent && millis() - extentTime >= EXTENT_MS) stampExtent();
+}
+
+static void addCrc(const uint8_t* data, size_t dataLen) {
+  // checksum content as it is buffered, so file does not need to be read back
+  if (fragPos) {
+    fragCrc = esp_rom_crc32_le(fragCrc, data, dataLen);
+    fragCrcLen += dataLen;
+  } else {
+    fileCrc = esp_rom_crc32_le(fileCrc, data, dataLen);
+    crcLen += dataLen;
+  }
+}
+
+static void bufferCopy(const uint8_t* data, size_t dataLen, bool doCrc) {
+  // copy data to SD buffer, encrypted for its position in file, 
+  // so checksum is of content as stored
+  uint8_t* copyPtr = iSDbuffer + highPoint;
+  memcpy(copyPtr, data, dataLen);
+  if (isCrypt) cryptWrite(copyPtr, dataLen, (rawSector ? rawPos : aviFile.position()) + highPoint);
+  if (fileChecksum && doCrc) addCrc(copyPtr, dataLen);
+  highPoint += dataLen;
+}
+
+static void bufferWrite(const uint8_t* data, size_t dataLen, bool doCrc = true) {
+  // copy data to SD buffer, writing to SD each time RAMSIZE is filled
+  size_t dataRemain = dataLen;
+  while (dataRemain >= RAMSIZE - highPoint) {
+    size_t copyLen = RAMSIZE - highPoint;
+    bufferCopy(data + dataLen - dataRemain, copyLen, doCrc);
+    aviWrite(iSDbuffer, RAMSIZE);
+    dataRemain -= copyLen;
+    highPoint = 0;
+  } 
+  // whats left or small data
+  bufferCopy(data + dataLen - dataRemain, dataRemain, doCrc);
+}
+
+static void recordingName(char* fileName, uint8_t recFPS, uint32_t durationSecs, uint32_t frames, bool hasWav, const char* fileExt) {
+  // name recording from date time and frame size, plus FPS, duration, and frame count if statsInName
+  int alen = statsInName 
+    ? snprintf(fileName, FILE_NAME_LEN - 1, "%s_%s_%u_%u_%u%s.%s", partName, frameData[fsizePtr].frameSizeStr, 
+      recFPS, durationSecs, frames, hasWav ? "_S" : "", fileExt)
+    : snprintf(fileName, FILE_NAME_LEN - 1, "%s_%s%s.%s", partName, frameData[fsizePtr].frameSizeStr, hasWav ? "_S" : "", fileExt);
+  if (alen > FILE_NAME_LEN - 1) LOG_WRN("file name truncated");
+}
+
+static inline uint8_t motionPct() {
+  // percentage of motion checks during recording that detected motion
+  return motionChecks ? 100 * motionHits / motionChecks : 0;
+}
+
+static void openAvi(bool newCapture = true, uint32_t preRollMs = 0) {
   // derive filename from date & time, store in date folder
   // time to open a new file on SD increases with the number of files already present
+  // preRollMs is age of oldest pre-roll frame to be saved ahead of live frames
   oTime = millis();
+  isSegmented = segmentMins > 0;
+  segStart = time(NULL) - preRollMs / 1000;
+  if (isSegmented) {
+    // rotate on multiple of segment length
+    time_t segSecs = segmentMins * 60;
+    segEndTime = (segStart / segSecs + 1) * segSecs;
+  }
   dateFormat(partName, sizeof(partName), true);
   SD_MMC.mkdir(partName); // make date folder if not present
   dateFormat(partName, sizeof(partName), false);
-  // open avi file with temporary name 
-  aviFile  = SD_MMC.open(AVITEMP, FILE_WRITE);
+  uint8_t* initPtr;
+  size_t initLen = useMP4 ? prepMp4(&initPtr, fsizePtr, micUse && micGain) : 0;
+  isMP4 = initLen > 0;
+  recTemp = isMP4 ? MP4TEMP : AVITEMP;
+  // previous recording keeps its temporary name until finalized
+  if (finalizeInProgress && !strcmp(finRec.tempName, recTemp)) recTemp = SEGTEMP;
+  if (!statsInName && !isSegmented && !isMP4) {
+    // name is known at start, so record under final name to avoid rename when closed
+    recordingName(recName, 0, 0, 0, micUse && micGain, FILE_EXT);
+    recTemp = recName;
+    // mark as in progress for recovery, as its name gives no indication
+    nameTemp = finalizeInProgress && finRec.nameTemp != NULL && !strcmp(finRec.nameTemp, NAMETEMP) ? SEGNAMETEMP : NAMETEMP;
+    File nf = SD_MMC.open(nameTemp, FILE_WRITE);
+    if (!nf || nf.write((uint8_t*)recName, strlen(recName)) != strlen(recName)) LOG_WRN("Failed to mark %s as in progress", recName);
+    nf.close();
+  } else nameTemp = NULL;
+  // open file with temporary name, pool file is opened without truncation
+  isPooled = claimPoolFile();
+  aviFile = SD_MMC.open(recTemp, isPooled ? "r+" : FILE_WRITE);
+  rawPos = 0;
+  rawSector = isPooled && rawSectors && !isMP4 ? getRawExtent(recTemp, rawLen, rawDrv) : 0;
   oTime = millis() - oTime;
+  maxOpenTime = max(oTime, maxOpenTime);
   LOG_DBG("File opening time: %ums", oTime);
-  startAudio();
+  if (newCapture) startAudio(); // already running for next segment
   // initialisation of counters
-  startTime = millis();
-  frameCnt = fTimeTot = wTimeTot = dTimeTot = vidSize = 0;
-  highPoint = AVI_HEADER_LEN; // allot space for AVI header
+  startTime = millis() - preRollMs;
+  frameCnt = fTimeTot = wTimeTot = dTimeTot = vidSize = motionChecks = motionHits = 0;
+  fileCrc = crcLen = fragCrc = fragCrcLen = 0;
+  lastJpegLen = dupRun = dupFrameCnt = cryptUs = cryptLen = 0;
+  recFull = false;
+  dropBase = ringDropped;
+  skipBase = ticksSkipped;
+  failBase = fbFailures;
   prepAviIndex();
+  isCrypt = false;
+  uint8_t* cryptPtr;
+  if (isMP4) {
+    // MP4 init segment is complete at start, followed by any encryption details
+    highPoint = fragPos = 0;
+    bufferWrite(initPtr, initLen);
+    size_t cryptBoxLen = startMp4Crypt(&cryptPtr, initLen);
+    if (cryptBoxLen) bufferWrite(cryptPtr, cryptBoxLen);
+    isCrypt = cryptBoxLen > 0;
+    return;
+  }
+  uint8_t* hdrPtr;
+  highPoint = getAviHdr(&hdrPtr); // allot space for AVI header
+  size_t moviStart = highPoint;
+  memset(iSDbuffer, 0, RAMSIZE); // header left empty until closed, so unfinished recording identifiable
+  while (highPoint >= RAMSIZE) {
+    // OpenDML header exceeds buffer
+    aviWrite(iSDbuffer, RAMSIZE);
+    highPoint -= RAMSIZE;
+  }
+  // encryption details written at start, so unfinished recording can be decrypted
+  size_t cryptChunkLen = startAviCrypt(&cryptPtr, moviStart);
+  if (cryptChunkLen) bufferWrite(cryptPtr, cryptChunkLen);
+  isCrypt = cryptChunkLen > 0;
 }
 
 static inline bool doMonitor(bool capturing) {
@@ -138,6 +575,22 @@ static inline bool doMonitor(bool capturing) {
   return !(bool)motionCnt;
 }  
 
+static void timeLapseWrite(File& tlFile, const uint8_t* data, size_t dataLen, bool isCryptTL) {
+  // write to time lapse avi, encrypting a copy as frame buffer is returned to camera
+  static uint8_t tlBuff[SECTOR_SIZE * 2];
+  if (!isCryptTL) {
+    tlFile.write(data, dataLen);
+    return;
+  }
+  size_t filePos = tlFile.position();
+  for (size_t done = 0; done < dataLen; done += sizeof(tlBuff)) {
+    size_t copyLen = std::min(dataLen - done, sizeof(tlBuff));
+    memcpy(tlBuff, data + done, copyLen);
+    encryptAvi(tlBuff, copyLen, filePos + done, true);
+    tlFile.write(tlBuff, copyLen);
+  }
+}
+
 static void timeLapse(camera_fb_t* fb) {
   // record a time lapse avi
   // Note that if FPS changed during time lapse recording, 
@@ -146,10 +599,16 @@ static void timeLapse(camera_fb_t* fb) {
   static int intervalMark = tlSecsBetweenFrames * saveFPS;
   static File tlFile;
   static char TLname[FILE_NAME_LEN];
+  static bool isCryptTL = false;
   if (timeLapseOn) {
     if (timeSynchronized) {
       if (!frameCntTL) {
-        // initialise time lapse avi
+        // initialise time lapse avi, once any timelapse compilation has released time lapse index
+        xSemaphoreTake(aviMutex, portMAX_DELAY);
+        bool tlWait = tlIndexBusy;
+        tlIndexBusy = true;
+        xSemaphoreGive(aviMutex);
+        if (tlWait) return;
         requiredFrames = tlDurationMins * 60 / tlSecsBetweenFrames;
         dateFormat(partName, sizeof(partName), true);
         SD_MMC.mkdir(partName); // make date folder if not present
@@ -161,6 +620,10 @@ static void timeLapse(camera_fb_t* fb) {
         tlFile = SD_MMC.open(TLTEMP, FILE_WRITE);
         tlFile.write(aviHeader, AVI_HEADER_LEN); // space for header
         prepAviIndex(true);
+        uint8_t* cryptPtr;
+        size_t cryptChunkLen = startAviCrypt(&cryptPtr, AVI_HEADER_LEN, true);
+        if (cryptChunkLen) tlFile.write(cryptPtr, cryptChunkLen);
+        isCryptTL = cryptChunkLen > 0;
         LOG_INF("Started time lapse file %s, duration %u mins, for %u frames",  TLname, tlDurationMins, requiredFrames);
         frameCntTL++; // to stop re-entering
       }
@@ -172,8 +635,8 @@ static void timeLapse(camera_fb_t* fb) {
         uint16_t filler = (4 - (fb->len & 0x00000003)) & 0x00000003; 
         uint32_t jpegSize = fb->len + filler;
         memcpy(hdrBuff+4, &jpegSize, 4);
-        tlFile.write(hdrBuff, CHUNK_HDR); // jpeg frame details
-        tlFile.write(fb->buf, jpegSize);
+        timeLapseWrite(tlFile, hdrBuff, CHUNK_HDR, isCryptTL); // jpeg frame details
+        timeLapseWrite(tlFile, fb->buf, jpegSize, isCryptTL);
         buildAviIdx(jpegSize, true, true); // save avi index for frame
         frameCntTL++;
         intervalCnt = 0;   
@@ -186,7 +649,7 @@ static void timeLapse(camera_fb_t* fb) {
         buildAviHdr(tlPlaybackFPS, fsizePtr, --frameCntTL, true);
         xSemaphoreGive(aviMutex);
         // add index
-        finalizeAviIndex(frameCntTL, true);
+        finalizeAviIndex(true);
         size_t idxLen = 0;
         do {
           idxLen = writeAviIndex(iSDbuffer, RAMSIZE, true);
@@ -198,45 +661,162 @@ static void timeLapse(camera_fb_t* fb) {
         tlFile.close(); 
         SD_MMC.rename(TLTEMP, TLname);
         frameCntTL = intervalCnt = 0;
+        tlIndexBusy = false;
         LOG_DBG("Finished time lapse");
       }
     }
-  } else frameCntTL = intervalCnt = 0;
+  } else {
+    if (frameCntTL) tlIndexBusy = false; // time lapse abandoned
+    frameCntTL = intervalCnt = 0;
+  }
+}
+
+static void saveChunk(const uint8_t* chunkId, const uint8_t* chunkData, size_t dataLen, bool doAlign = false, 
+  size_t cutPos = 0, size_t cutLen = 0) {
+  // add chunk to avi, preceded by any OpenDML structures that are due
+  // content from cutPos for cutLen bytes is omitted
+  if (odmlDue(dataLen + CHUNK_HDR + (doAlign ? SECTOR_SIZE + CHUNK_HDR : 0))) {
+    // insert OpenDML index chunks or start new RIFF
+    uint8_t* odmlPtr;
+    size_t odmlLen;
+    while ((odmlLen = odmlStep(&odmlPtr))) bufferWrite(odmlPtr, odmlLen);
+  }
+  if (doAlign) {
+    // pad so that chunk starts on sector boundary, buffer is multiple of sector size
+    uint8_t* junkPtr;
+    size_t junkLen = alignAviChunk(highPoint, &junkPtr);
+    if (junkLen) bufferWrite(junkPtr, junkLen);
+  }
+  // add avi chunk header
+  uint8_t hdrBuff[CHUNK_HDR];
+  memcpy(hdrBuff, chunkId, 4); 
+  memcpy(hdrBuff+4, &dataLen, 4);
+  bufferWrite(hdrBuff, CHUNK_HDR);
+  // add chunk content
+  if (cutLen) {
+    bufferWrite(chunkData, cutPos);
+    bufferWrite(chunkData + cutPos + cutLen, dataLen - cutPos);
+  } else bufferWrite(chunkData, dataLen);
+}
+
+static void saveAudio() {
+  // interleave audio captured since previous frame
+  uint8_t* audPtr;
+  size_t audLen = getAudioChunk(&audPtr);
+  if (audLen && isMP4) mp4AddAudio(audPtr, audLen); // held until end of fragment
+  else if (audLen) {
+    saveChunk(wbBuf, audPtr, audLen);
+    buildAviIdx(audLen, false); // save avi index for audio
+  }
+}
+
+static void saveThumb() {
+  // interleave thumbnail from motion detection if a new one is available
+  uint8_t* thumbPtr;
+  size_t thumbLen;
+  if (haveThumbs && fetchThumb(&thumbPtr, &thumbLen)) {
+    // align end of jpeg on 4 byte boundary for AVI
+    thumbLen += (4 - (thumbLen & 0x00000003)) & 0x00000003;
+    saveChunk(thBuf, thumbPtr, thumbLen);
+    buildThumbIdx(thumbLen); // save avi index for thumbnail
+  }
+}
+
+static void saveMp4Frag() {
+  // complete current MP4 fragment by appending its audio, 
+  // then writing its header to the space reserved before its frames
+  if (!fragPos) return;
+  uint8_t* fragPtr;
+  size_t fragLen = mp4FragAudio(&fragPtr);
+  if (fragLen) bufferWrite(fragPtr, fragLen);
+  fragLen = mp4FragHdr(&fragPtr);
+  if (isCrypt) cryptWrite(fragPtr, fragLen, fragPos);
+  if (fileChecksum) {
+    // header precedes fragment content already checksummed
+    fileCrc = esp_rom_crc32_le(fileCrc, fragPtr, fragLen);
+    fileCrc = crc32Combine(fileCrc, fragCrc, fragCrcLen);
+    crcLen += fragLen + fragCrcLen;
+    fragCrc = fragCrcLen = 0;
+  }
+  aviFile.write(iSDbuffer, highPoint); 
+  highPoint = 0;
+  size_t endPos = aviFile.position();
+  aviFile.seek(fragPos, SeekSet);
+  aviFile.write(fragPtr, fragLen);
+  aviFile.seek(endPos, SeekSet);
+  fragPos = 0;
 }
 
-static void saveFrame(camera_fb_t* fb) {
-  // save frame on SD card
+static void saveMp4Frame(camera_fb_t* fb, uint32_t frameTime) {
+  // add frame to current MP4 fragment, completing fragment first if due
+  if (mp4FragDue(frameTime)) saveMp4Frag();
+  if (!fragPos) {
+    // reserve space for header of new fragment
+    uint8_t* spacePtr;
+    size_t spaceLen = mp4FragSpace(&spacePtr);
+    fragPos = aviFile.position() + highPoint;
+    bufferWrite(spacePtr, spaceLen, false); // checksummed when header written
+  }
+  bufferWrite(fb->buf, fb->len);
+  mp4AddFrame(fb->len, frameTime);
+}
+
+static bool isDupFrame(camera_fb_t* fb) {
+  // frame is treated as repeat of last stored frame if scene unchanged and size almost the same,
+  // with a frame stored in full at least every second
+  if (!dupFrames || isMP4 || !lastJpegLen || dupRun >= FPS) return false;
+  if (useMotion && sceneChanged) return false;
+  size_t sizeDiff = fb->len > lastJpegLen ? fb->len - lastJpegLen : lastJpegLen - fb->len;
+  return sizeDiff * 1000 <= lastJpegLen * DUP_SIZE_PERMILLE;
+}
+
+static inline int64_t frameUsecs(const struct timeval& timestamp) {
+  // camera driver timestamps frames with esp_timer_get_time()
+  return (int64_t)timestamp.tv_sec * 1000000 + timestamp.tv_usec;
+}
+
+static void saveFrame(camera_fb_t* fb, uint32_t seq) {
+  // save frame on SD card, with its sequence number and capture time
   uint32_t fTime = millis();
-  // align end of jpeg on 4 byte boundary for AVI
-  uint16_t filler = (4 - (fb->len & 0x00000003)) & 0x00000003; 
-  size_t jpegSize = fb->len + filler;
-  // add avi frame header
-  memcpy(iSDbuffer+highPoint, dcBuf, 4); 
-  memcpy(iSDbuffer+highPoint+4, &jpegSize, 4);
-  highPoint += CHUNK_HDR;
-  if (highPoint >= RAMSIZE) {
-    // marker overflows buffer
-    highPoint -= RAMSIZE;
-    aviFile.write(iSDbuffer, RAMSIZE);
-    // push overflow to buffer start
-    memcpy(iSDbuffer, iSDbuffer+RAMSIZE, highPoint);
+  int64_t capUs = frameUsecs(fb->timestamp);
+  if (!frameCnt) {
+    firstCapUs = capUs;
+    firstSeq = seq;
   }
-  // add frame content
-  size_t jpegRemain = jpegSize;
+  lastCapUs = capUs;
+  lastSeq = seq;
+  // repeated frame is indexed ahead of interleaved chunks, so that index is in file order
+  uint8_t* dupPtr;
+  size_t dupLen = isDupFrame(fb) ? getDupChunk(&dupPtr) : 0;
+  // omit Huffman tables already stored for recording
+  size_t cutPos = 0;
+  size_t cutLen = isMP4 || dupLen ? 0 : stripJpegTables(fb->buf, fb->len, cutPos);
+  // align end of jpeg on 4 byte boundary for AVI
+  size_t jpegLen = fb->len - cutLen;
+  uint16_t filler = (4 - (jpegLen & 0x00000003)) & 0x00000003; 
+  size_t jpegSize = jpegLen + filler;
   uint32_t wTime = millis();
-  while (jpegRemain >= RAMSIZE - highPoint) {
-    // write to SD when RAMSIZE is filled in buffer
-    memcpy(iSDbuffer+highPoint, fb->buf + jpegSize - jpegRemain, RAMSIZE - highPoint);
-    aviFile.write(iSDbuffer, RAMSIZE);
-    jpegRemain -= RAMSIZE - highPoint;
-    highPoint = 0;
-  } 
+  if (frameTimes && !isMP4) {
+    // capture time precedes frame or its repeat marker, for playback pacing
+    uint8_t* timePtr;
+    size_t timeLen = getTimeChunk(&timePtr, seq, capUs);
+    bufferWrite(timePtr, timeLen);
+  }
+  if (dupLen) bufferWrite(dupPtr, dupLen);
+  saveAudio();
+  if (isMP4) saveMp4Frame(fb, capUs / 1000);
+  else {
+    saveThumb();
+    if (!dupLen) {
+      uint8_t* tablesPtr;
+      size_t tablesLen = getTablesChunk(&tablesPtr);
+      if (tablesLen) bufferWrite(tablesPtr, tablesLen);
+      saveChunk(dcBuf, fb->buf, jpegSize, true, cutPos, cutLen);
+    }
+  }
   wTime = millis() - wTime;
   wTimeTot += wTime;
   LOG_DBG("SD storage time %u ms", wTime);
-  // whats left or small frame
-  memcpy(iSDbuffer+highPoint, fb->buf + jpegSize - jpegRemain, jpegRemain);
-  highPoint += jpegRemain;
   
   if (smtpUse) {
     if (frameCnt == smtpFrame) {
@@ -245,94 +825,625 @@ static void saveFrame(camera_fb_t* fb) {
       if (fb->len < MAX_JPEG && SMTPbuffer != NULL) memcpy(SMTPbuffer, fb->buf, fb->len);
     }
   }
-  buildAviIdx(jpegSize); // save avi index for frame
-  vidSize += jpegSize + CHUNK_HDR;
+  if (dupLen) {
+    dupRun++;
+    dupFrameCnt++;
+  } else {
+    if (!isMP4) buildAviIdx(jpegSize); // save avi index for frame
+    vidSize += jpegSize + CHUNK_HDR;
+    lastJpegLen = fb->len;
+    dupRun = 0;
+  }
   frameCnt++; 
   fTime = millis() - fTime - wTime;
   fTimeTot += fTime;
+  writerBusyMs += fTime + wTime;
   LOG_DBG("Frame processing time %u ms", fTime);
 }
 
-static bool closeAvi() {
-  // closes the recorded file
-  uint32_t vidDuration = millis() - startTime;
-  uint32_t vidDurationSecs = lround(vidDuration/1000.0);
-  Serial.println("");
-  LOG_DBG("Capture time %u, min seconds: %u ", vidDurationSecs, minSeconds);
+static void addToManifest(const char* segName, time_t startEpoch, uint32_t durationMs, uint32_t frames) {
+  // append segment to manifest in its date folder, so that a day can be treated as one timeline
+  char manifestName[FILE_NAME_LEN];
+  char startStr[20];
+  char manifestLine[FILE_NAME_LEN + 50];
+  strftime(manifestName, sizeof(manifestName), "/%Y%m%d/" SEG_MANIFEST, localtime(&startEpoch));
+  strftime(startStr, sizeof(startStr), "%Y-%m-%d %H:%M:%S", localtime(&startEpoch));
+  bool newManifest = !SD_MMC.exists(manifestName);
+  File mf = SD_MMC.open(manifestName, FILE_APPEND);
+  if (!mf) {
+    LOG_ERR("Failed to open %s", manifestName);
+    return;
+  }
+  // start time, duration in ms, frame count, file name
+  int mlen = newManifest ? snprintf(manifestLine, sizeof(manifestLine), "start,durationMs,frames,file\n") : 0;
+  mf.write((uint8_t*)manifestLine, mlen);
+  mlen = snprintf(manifestLine, sizeof(manifestLine), "%s,%u,%u,%s\n", startStr, durationMs, frames, segName);
+  mf.write((uint8_t*)manifestLine, mlen);
+  mf.close();
+}
 
-  cTime = millis();
-  // write remaining frame content to SD
-  aviFile.write(iSDbuffer, highPoint); 
-  size_t readLen = 0;
-  // add wav file if exists
-  finishAudio(true);
-  bool haveWav = haveWavFile();
-  if (haveWav) {
-    do {
-      readLen = writeWavFile(iSDbuffer, RAMSIZE);
-      aviFile.write(iSDbuffer, readLen);
-    } while (readLen > 0);
-  }
-  // save avi index
-  finalizeAviIndex(frameCnt);
-  do {
-    readLen = writeAviIndex(iSDbuffer, RAMSIZE);
-    if (readLen) aviFile.write(iSDbuffer, readLen);
-  } while (readLen > 0);
-  // save avi header at start of file
-  float actualFPS = (1000.0f * (float)frameCnt) / ((float)vidDuration);
-  uint8_t actualFPSint = (uint8_t)(lround(actualFPS));  
-  xSemaphoreTake(aviMutex, portMAX_DELAY);
-  buildAviHdr(actualFPSint, fsizePtr, frameCnt);
-  xSemaphoreGive(aviMutex); 
-  aviFile.seek(0, SeekSet); // start of file
-  aviFile.write(aviHeader, AVI_HEADER_LEN); 
-  aviFile.close();
-  LOG_DBG("Final SD storage time %lu ms", millis() - cTime);
-  uint32_t hTime = millis(); 
-  if (vidDurationSecs >= minSeconds) {
-    // name file to include actual dateTime, FPS, duration, and frame count
-    int alen = snprintf(aviFileName, FILE_NAME_LEN - 1, "%s_%s_%u_%u_%u%s.%s", 
-      partName, frameData[fsizePtr].frameSizeStr, actualFPSint, vidDurationSecs, frameCnt, haveWav ? "_S" : "", FILE_EXT);
-    if (alen > FILE_NAME_LEN - 1) LOG_WRN("file name truncated");
-    SD_MMC.rename(AVITEMP, aviFileName);
-    LOG_DBG("AVI close time %lu ms", millis() - hTime); 
-    cTime = millis() - cTime;
+static void addChecksum(const char* fileName, size_t fileLen, uint32_t crc) {
+  // append checksum of completed recording to manifest in its date folder
+  char manifestName[FILE_NAME_LEN];
+  char manifestLine[FILE_NAME_LEN + 30];
+  const char* baseName = strrchr(fileName, '/') + 1;
+  snprintf(manifestName, sizeof(manifestName), "%.*s" CRC_MANIFEST, baseName - fileName, fileName);
+  bool newManifest = !SD_MMC.exists(manifestName);
+  File mf = SD_MMC.open(manifestName, FILE_APPEND);
+  if (!mf) {
+    LOG_ERR("Failed to open %s", manifestName);
+    return;
+  }
+  // file name, length, crc32
+  int mlen = newManifest ? snprintf(manifestLine, sizeof(manifestLine), "file,bytes,crc32\n") : 0;
+  mf.write((uint8_t*)manifestLine, mlen);
+  mlen = snprintf(manifestLine, sizeof(manifestLine), "%s,%u,%08x\n", baseName, fileLen, crc);
+  mf.write((uint8_t*)manifestLine, mlen);
+  mf.close();
+}
+
+char* loadChecksums(const char* folder) {
+  // load checksum manifest of date folder, returned buffer to be freed by caller
+  char manifestName[FILE_NAME_LEN];
+  snprintf(manifestName, sizeof(manifestName), "%s/" CRC_MANIFEST, folder);
+  if (!SD_MMC.exists(manifestName)) return NULL;
+  File mf = SD_MMC.open(manifestName, FILE_READ);
+  if (!mf) return NULL;
+  size_t mfLen = mf.size();
+  char* csvBuff = psramFound() ? (char*)ps_malloc(mfLen + 1) : (char*)malloc(mfLen + 1);
+  if (csvBuff != NULL) csvBuff[mf.read((uint8_t*)csvBuff, mfLen)] = 0;
+  mf.close();
+  return csvBuff;
+}
+
+bool findChecksum(const char* csvBuff, const char* fileName, size_t fileLen, char* crcStr) {
+  // get checksum of file from loaded manifest, ignored if file length no longer matches
+  if (csvBuff == NULL) return false;
+  const char* baseName = strrchr(fileName, '/');
+  baseName = baseName == NULL ? fileName : baseName + 1;
+  size_t nameLen = strlen(baseName);
+  const char* found = NULL;
+  // use latest entry, in case file was recreated
+  for (const char* p = strstr(csvBuff, baseName); p != NULL; p = strstr(p + 1, baseName))
+    if (p > csvBuff && p[-1] == '\n' && p[nameLen] == ',') found = p;
+  if (found == NULL) return false;
+  char* crcPos;
+  if (strtoul(found + nameLen + 1, &crcPos, 10) != fileLen || *crcPos != ',') return false;
+  strncpy(crcStr, crcPos + 1, 8);
+  crcStr[8] = 0;
+  return true;
+}
+
+static void finalizeAvi() {
+  // complete recording handed over by capture task, then name and distribute it
+  static uint8_t* finBuff = NULL;
+  if (finBuff == NULL) finBuff = (uint8_t*)ps_malloc(RAMSIZE);
+  File& df = finRec.aviFile;
+  if (!finRec.isValid) {
+    // delete too small files
+    df.close();
+    if (finRec.isPooled) releasePoolFile(finRec.tempName, finRec.isRaw);
+    else SD_MMC.remove(finRec.tempName);
+    if (finRec.nameTemp != NULL) SD_MMC.remove(finRec.nameTemp);
+    LOG_WRN("Insufficient capture duration: %u secs", finRec.duration / 1000);
+    return;
+  }
+  // write remaining content, then index and header
+  if (finRec.tailLen) df.write(finRec.tailBuff, finRec.tailLen);
+  uint32_t iTime = millis();
+  size_t idxLen = 0, idxWriteLen = 0;
+  while (finRec.hasIdx && (idxLen = writeSegIndex(finBuff, RAMSIZE))) {
+    idxWriteLen += df.write(finBuff, idxLen);
+    if (finRec.hasCrc) {
+      finRec.crc = esp_rom_crc32_le(finRec.crc, finBuff, idxLen);
+      finRec.crcLen += idxLen;
+    }
+  }
+  iTime = millis() - iTime;
+  size_t aviLen = df.position(); // pool file is larger than content
+  if (finRec.hdrLen) {
+    df.seek(0, SeekSet);
+    df.write(finRec.hdrBuff, finRec.hdrLen);
+  }
+  df.close();
+  if (finRec.isPooled) truncateFile(finRec.tempName, aviLen); // release unused clusters
+  if (strcmp(finRec.tempName, finRec.fileName)) SD_MMC.rename(finRec.tempName, finRec.fileName);
+  if (finRec.nameTemp != NULL) SD_MMC.remove(finRec.nameTemp); // header now written
+  if (finRec.isSegment) addToManifest(finRec.fileName, finRec.startTime, finRec.duration, finRec.frameCnt);
+  uint32_t aviCrc = crc32Combine(finRec.hdrCrc, finRec.crc, finRec.crcLen);
+  if (finRec.hasCrc && finRec.hdrCrcLen + finRec.crcLen != aviLen) {
+    LOG_WRN("Checksum covers %u of %u bytes, not saved", finRec.hdrCrcLen + finRec.crcLen, aviLen);
+    finRec.hasCrc = false;
+  }
+  if (finRec.hasCrc) addChecksum(finRec.fileName, aviLen, aviCrc);
+  uint32_t cTime = millis() - finRec.closeStart;
+  maxCloseTime = max(cTime, maxCloseTime);
+  if (finRec.isSegment) LOG_INF("Completed segment %s in %u ms, capture stalled %u ms", finRec.fileName, cTime, finRec.stallTime);
+  else {
     // AVI stats
+    uint32_t vidSize = finRec.vidSize;
+    uint32_t frameCnt = finRec.frameCnt;
     LOG_INF("******** AVI recording stats ********");
-    LOG_INF("Recorded %s", aviFileName);
-    LOG_INF("AVI duration: %u secs", vidDurationSecs);
+    LOG_INF("Recorded %s", finRec.fileName);
+    LOG_INF("AVI duration: %u secs", (uint32_t)lround(finRec.duration / 1000.0));
     LOG_INF("Number of frames: %u", frameCnt);
-    LOG_INF("Required FPS: %u", FPS);
-    LOG_INF("Actual FPS: %0.1f", actualFPS);
+    LOG_INF("Required FPS: %u", finRec.reqFPS);
+    LOG_INF("Actual FPS: %0.1f", finRec.actualFPS);
     LOG_INF("File size: %0.2f MB", (float)vidSize / ONEMEG);
+    if (finRec.alignPadding) LOG_INF("Sector alignment padding: %u kB (%0.1f%%)", finRec.alignPadding / 1024, 100.0 * finRec.alignPadding / vidSize);
+    if (finRec.hasCrc) LOG_INF("CRC32 checksum: %08x", aviCrc);
+    if (finRec.dupFrameCnt) LOG_INF("Repeated frames indexed only: %u (%0.1f%%)", finRec.dupFrameCnt, 100.0 * finRec.dupFrameCnt / frameCnt);
+    if (finRec.tablesStripped) LOG_INF("Huffman tables omitted: %u kB (%0.1f%%)", finRec.tablesStripped / 1024, 100.0 * finRec.tablesStripped / (vidSize + finRec.tablesStripped));
     if (frameCnt) {
       LOG_INF("Average frame length: %u bytes", vidSize / frameCnt);
-      LOG_INF("Average frame monitoring time: %u ms", dTimeTot / frameCnt);
-      LOG_INF("Average frame buffering time: %u ms", fTimeTot / frameCnt);
-      LOG_INF("Average frame storage time: %u ms", wTimeTot / frameCnt);
+      LOG_INF("Average frame monitoring time: %u ms", finRec.dTimeTot / frameCnt);
+      LOG_INF("Average frame buffering time: %u ms", finRec.fTimeTot / frameCnt);
+      LOG_INF("Average frame storage time: %u ms", finRec.wTimeTot / frameCnt);
     }
-    LOG_INF("Average SD write speed: %u kB/s", ((vidSize / wTimeTot) * 1000) / 1024);
-    LOG_INF("File open / completion times: %u ms / %u ms", oTime, cTime);
-    LOG_INF("Busy: %u%%", std::min(100 * (wTimeTot + fTimeTot + dTimeTot + oTime + cTime) / vidDuration, (uint32_t)100));
+    LOG_INF("Average SD write speed: %u kB/s", ((vidSize / max(finRec.wTimeTot, 1U)) * 1000) / 1024);
+    if (finRec.cryptLen) LOG_INF("Encrypted: %u kB, AES-CTR speed: %u kB/s", finRec.cryptLen / 1024, (uint32_t)(((uint64_t)finRec.cryptLen * 1000000 / max(finRec.cryptUs, 1U)) / 1024));
+    if (finRec.idxEntryNs) LOG_INF("Average index entry time: %u ns", finRec.idxEntryNs);
+    if (finRec.idxPages) LOG_INF("Index pages: %u, average page write time: %u ms", finRec.idxPages, finRec.idxPageMs);
+    if (idxWriteLen) LOG_INF("Index finalization: %u kB in %u ms", idxWriteLen / 1024, iTime);
+    LOG_INF("File open / completion times: %u ms / %u ms, max %u ms / %u ms", finRec.oTime, cTime, maxOpenTime, maxCloseTime);
+    LOG_INF("Capture stalled by close: %u ms, max %u ms", finRec.stallTime, maxCloseStall);
+    if (writeQueue != NULL) LOG_INF("Write ring max: %u kB of %u kB, %u frames", ringHighWater / 1024, writeRing.size / 1024, queueHighWater);
+    LOG_INF("Frames lost: %u (timer ticks skipped: %u, camera failures: %u, write ring full: %u)", finRec.lost, finRec.skipped, finRec.failures, finRec.dropped);
+    LOG_INF("Busy: %u%%", std::min(100 * (finRec.wTimeTot + finRec.fTimeTot + finRec.dTimeTot + finRec.oTime + finRec.stallTime) / max(finRec.duration, 1U), (uint32_t)100));
     checkMemory();
     LOG_INF("*************************************");
-    
 #ifdef USE_WEBSOCKET_SERVER
     socketSendToServer("RecordStop");
 #endif
-    if (autoUpload) ftpFileOrFolder(aviFileName); // Upload it to remote ftp server if requested
-    checkFreeSpace();
-    char subjectMsg[50];
-    sprintf(subjectMsg, "Frame %u attached", smtpFrame);
-    emailAlert("Motion Alert", subjectMsg);
-    return true; 
-  } else {
-    // delete too small files if exist
-    SD_MMC.remove(AVITEMP);
-    LOG_WRN("Insufficient capture duration: %u secs", vidDurationSecs);                 
-    return false;
   }
+  if (autoUpload) ftpFileOrFolder(finRec.fileName); // Upload it to remote ftp server if requested
+  checkFreeSpace();
+  poolRefill = true; // claimed pool file replaced when idle
+  if (finRec.isSegment) return;
+  if (mergeGapSecs && !segmentMins && !autoUpload) {
+    // merge with any preceding recordings in day folder, in background
+    char dayFolder[FILE_NAME_LEN];
+    strcpy(dayFolder, finRec.fileName);
+    *strrchr(dayFolder, '/') = 0;
+    mergeRecordings(dayFolder);
+  }
+  char subjectMsg[50];
+  sprintf(subjectMsg, "Frame %u attached", smtpFrame);
+  emailAlert("Motion Alert", subjectMsg);
+}
+
+static void finalizeTask(void* parameter) {
+  finalizeAvi();
+  finRec.aviFile = File(); // release handle
+  finalizeInProgress = false;
+  finalizeHandle = NULL;
+  vTaskDelete(NULL);
+}
+
+static void waitFinalize() {
+  // previous recording must be finalized before handing over another
+  while (finalizeInProgress) delay(10);
+}
+
+static void handOverAvi(bool isSegment, bool isValid) {
+  // snapshot state of recording so that finalize task can complete it,
+  // leaving capture task free to start next recording
+  uint32_t vidDuration = millis() - startTime;
+  // from capture times if available, as frames may be written some time after capture
+  if (frameCnt > 1 && lastCapUs > firstCapUs) vidDuration = (lastCapUs - firstCapUs) * frameCnt / (frameCnt - 1) / 1000;
+  waitFinalize();
+  finRec.isRaw = rawSector > 0;
+  if (rawSector) {
+    // file system used to complete recording, from end of raw content
+    LOG_DBG("Recorded %u kB direct to sectors", rawPos / 1024);
+    aviFile.seek(rawPos, SeekSet);
+    rawSector = 0;
+  }
+  if (finRec.tailBuff == NULL) finRec.tailBuff = (uint8_t*)ps_malloc(RAMSIZE);
+  finRec.closeStart = millis();
+  finRec.isSegment = isSegment;
+  finRec.isValid = isValid;
+  finRec.hasIdx = false;
+  finRec.hasCrc = fileChecksum && isValid;
+  finRec.tailLen = finRec.hdrLen = finRec.idxEntryNs = finRec.idxPages = 0;
+  finRec.hdrCrc = finRec.hdrCrcLen = 0;
+  if (isValid) {
+    // add remaining audio
+    if (!isSegment) finishAudio(true);
+    saveAudio();
+    if (isMP4) {
+      // complete final fragment, no header or index
+      mp4FragDue(millis());
+      saveMp4Frag();
+    } else if (!isSegment && odmlClose()) {
+      // save remaining OpenDML indexes, and complete each subsequent RIFF header
+      uint8_t* odmlPtr;
+      size_t odmlLen;
+      while ((odmlLen = odmlStep(&odmlPtr))) bufferWrite(odmlPtr, odmlLen);
+      aviFile.write(iSDbuffer, highPoint); 
+      highPoint = 0;
+      size_t endPos = aviFile.position();
+      uint8_t riffHdr[AVIX_HDR];
+      size_t riffPos;
+      for (uint8_t riffNum = 1; (riffPos = odmlRiffHdr(riffNum, riffHdr)); riffNum++) {
+        if (isCrypt) cryptWrite(riffHdr, AVIX_HDR, riffPos);
+        aviFile.seek(riffPos, SeekSet);
+        aviFile.write(riffHdr, AVIX_HDR);
+        finRec.hasCrc = false; // content changed after it was checksummed
+      }
+      aviFile.seek(endPos, SeekSet);
+    } else finRec.hasIdx = true;
+  } else finishAudio(false);
+  // remaining content written by finalize task, if buffer available
+  if (highPoint && finRec.tailBuff != NULL && isValid) {
+    memcpy(finRec.tailBuff, iSDbuffer, highPoint);
+    finRec.tailLen = highPoint;
+  } else if (highPoint && isValid) aviFile.write(iSDbuffer, highPoint); 
+  highPoint = 0;
+  finRec.frameCnt = frameCnt;
+  finRec.actualFPS = (1000.0f * (float)frameCnt) / ((float)vidDuration);
+  uint8_t actualFPSint = (uint8_t)(lround(finRec.actualFPS));  
+  if (!isMP4 && isValid) {
+    // build avi header, written at start of file by finalize task
+    uint8_t* hdrPtr;
+    xSemaphoreTake(aviMutex, portMAX_DELAY);
+    setAviMeta(segStart, vidDuration, captureTrigger, motionPct());
+    buildAviHdr(actualFPSint, fsizePtr, frameCnt);
+    size_t hdrLen = getAviHdr(&hdrPtr);
+    if (finRec.hasCrc) {
+      finRec.hdrCrc = esp_rom_crc32_le(0, hdrPtr, hdrLen);
+      finRec.hdrCrcLen = hdrLen;
+    }
+    if (hdrLen <= sizeof(finRec.hdrBuff)) {
+      memcpy(finRec.hdrBuff, hdrPtr, hdrLen);
+      finRec.hdrLen = hdrLen;
+    } else {
+      // OpenDML header is too large to hold, so write now
+      size_t endPos = aviFile.position();
+      aviFile.seek(0, SeekSet);
+      aviFile.write(hdrPtr, hdrLen);
+      aviFile.seek(endPos, SeekSet);
+    }
+    xSemaphoreGive(aviMutex); 
+    getAviIdxStats(finRec.idxEntryNs, finRec.idxPages, finRec.idxPageMs);
+    if (finRec.hasIdx) segmentAviIndex(); // index is appended by finalize task
+  }
+  // file keeps its temporary name until finalized
+  finRec.aviFile = aviFile;
+  aviFile = File();
+  strcpy(finRec.tempName, recTemp);
+  finRec.nameTemp = nameTemp;
+  recordingName(finRec.fileName, actualFPSint, lround(vidDuration/1000.0), frameCnt, haveSound, isMP4 ? MP4_EXT : FILE_EXT);
+  finRec.isPooled = isPooled;
+  finRec.crc = fileCrc;
+  finRec.crcLen = crcLen;
+  finRec.startTime = segStart;
+  finRec.duration = vidDuration;
+  finRec.reqFPS = FPS;
+  finRec.vidSize = vidSize;
+  finRec.dTimeTot = dTimeTot;
+  finRec.fTimeTot = fTimeTot;
+  finRec.wTimeTot = wTimeTot;
+  finRec.oTime = oTime;
+  finRec.alignPadding = alignPadding;
+  finRec.tablesStripped = tablesStripped;
+  finRec.dupFrameCnt = dupFrameCnt;
+  finRec.cryptUs = cryptUs;
+  finRec.cryptLen = cryptLen;
+  finRec.dropped = ringDropped - dropBase;
+  finRec.skipped = ticksSkipped - skipBase;
+  finRec.failures = fbFailures - failBase;
+  finRec.lost = frameCnt ? lastSeq - firstSeq + 1 - frameCnt : 0; // gaps in sequence
+  finalizeInProgress = true;
+  xTaskCreate(&finalizeTask, "finalizeTask", 1024 * 4, NULL, 1, &finalizeHandle);
+}
+
+static inline bool segmentDue() {
+  // segment rotated on time boundary, or when max frames reached,
+  // or if segments selected during a motion recording
+  return segmentMins && (!isSegmented || time(NULL) >= segEndTime || frameCnt >= maxFrames);
+}
+
+static void rotateAvi() {
+  // close current segment and open next one without stopping capture
+  // segment is completed by finalize task while next segment recorded
+  uint32_t rTime = millis();
+  handOverAvi(true, true);
+  openAvi(false);
+  finRec.stallTime = millis() - rTime;
+  maxCloseStall = max(finRec.stallTime, maxCloseStall);
+  LOG_INF("Rotated segment after %u frames in %u ms", finRec.frameCnt, finRec.stallTime);
+}
+
+static bool closeAvi() {
+  // closes the recorded file, which is completed by finalize task
+  uint32_t stallStart = millis();
+  uint32_t vidDurationSecs = lround((millis() - startTime)/1000.0);
+  Serial.println("");
+  LOG_DBG("Capture time %u, min seconds: %u ", vidDurationSecs, minSeconds);
+  bool isValid = vidDurationSecs >= minSeconds;
+  handOverAvi(false, isValid);
+  finRec.stallTime = millis() - stallStart;
+  if (isValid) maxCloseStall = max(finRec.stallTime, maxCloseStall);
+  LOG_DBG("Capture stalled by close for %u ms", finRec.stallTime);
+  return isValid;
+}
+
+static uint8_t* ringReserve(byteRing& ring, size_t len, size_t& ringLen) {
+  // reserve contiguous space in ring, wrapping to start of ring if not enough space at end
+  // returns NULL if ring too full
+  uint8_t* slot = NULL;
+  if (!ring.used) ring.head = 0;
+  size_t endLen = ring.size - ring.head;
+  size_t freeLen = ring.size - ring.used;
+  ringLen = 0;
+  if (len <= endLen && len <= freeLen) {
+    slot = ring.buff + ring.head;
+    ringLen = len;
+  } else if (len > endLen && endLen + len <= freeLen) {
+    slot = ring.buff;
+    ringLen = endLen + len; // space at end of ring skipped
+  }
+  if (slot != NULL) {
+    ring.head = slot - ring.buff + len;
+    ring.used += ringLen;
+  }
+  return slot;
+}
+
+static uint8_t* ringAlloc(size_t len, size_t& ringLen) {
+  // reserve space in write ring, shared with writer task
+  xSemaphoreTake(ringMutex, portMAX_DELAY);
+  uint8_t* slot = ringReserve(writeRing, len, ringLen);
+  ringHighWater = max(writeRing.used, ringHighWater);
+  xSemaphoreGive(ringMutex);
+  return slot;
+}
+
+static void sizeWriteRing(size_t frameLen) {
+  // size ring to hold frames captured during an SD write stall, at current frame size and rate, 
+  // up to writeRingKB, only grown while ring is empty at start of recording
+  size_t ringSize = std::min((size_t)writeRingKB * 1024, ((frameLen + 3) & ~3) * FPS * WRITE_STALL_MS / 1000);
+  xSemaphoreTake(ringMutex, portMAX_DELAY);
+  if (ringSize > writeRing.size && !writeRing.used) {
+    uint8_t* ringBuff = (uint8_t*)ps_malloc(ringSize);
+    if (ringBuff == NULL) LOG_WRN("Insufficient PSRAM for %u kB write ring", ringSize / 1024);
+    else {
+      free(writeRing.buff);
+      writeRing = {ringBuff, ringSize, 0, 0};
+      ringHighWater = 0;
+      LOG_DBG("Write ring sized to %u kB", ringSize / 1024);
+    }
+  }
+  xSemaphoreGive(ringMutex);
+}
+
+static void ringFree(size_t ringLen) {
+  // release oldest space in write ring, as frames are written in order
+  xSemaphoreTake(ringMutex, portMAX_DELAY);
+  writeRing.used -= ringLen;
+  xSemaphoreGive(ringMutex);
+}
+
+static void dropPreRoll() {
+  // discard oldest held frame
+  preRoll.used -= preRollFrames[preRollFirst].ringLen;
+  preRollFirst = (preRollFirst + 1) % PRE_ROLL_MAX;
+  preRollCnt--;
+}
+
+static void holdPreRoll(camera_fb_t* fb, uint32_t seq) {
+  // keep copy of frame while not capturing, replacing frames older than preRollSecs,
+  // then oldest frames until there is space
+  if (preRoll.buff == NULL || preRollBusy) return;
+  int64_t capUs = frameUsecs(fb->timestamp);
+  while (preRollCnt && capUs - frameUsecs(preRollFrames[preRollFirst].timestamp) > preRollSecs * 1000000LL) dropPreRoll();
+  uint8_t* slot = NULL;
+  size_t ringLen;
+  // frame is read up to 4 byte boundary when saved
+  while ((preRollCnt == PRE_ROLL_MAX || (slot = ringReserve(preRoll, (fb->len + 3) & ~3, ringLen)) == NULL) 
+    && preRollCnt) dropPreRoll();
+  if (slot == NULL) return; // frame larger than ring
+  memcpy(slot, fb->buf, fb->len);
+  preRollFrames[(preRollFirst + preRollCnt) % PRE_ROLL_MAX] = {(size_t)(slot - preRoll.buff), fb->len, ringLen, fb->timestamp, seq};
+  preRollCnt++;
+}
+
+static void savePreRoll() {
+  // save held frames to new recording ahead of live frames, then release ring to capture task
+  uint32_t preRollFrameCnt = preRollCnt;
+  while (preRollCnt) {
+    camera_fb_t fb = {};
+    fb.buf = preRoll.buff + preRollFrames[preRollFirst].pos;
+    fb.len = preRollFrames[preRollFirst].len;
+    fb.timestamp = preRollFrames[preRollFirst].timestamp;
+    saveFrame(&fb, preRollFrames[preRollFirst].seq);
+    dropPreRoll();
+  }
+  if (preRollFrameCnt) LOG_DBG("Saved %u pre-roll frames", preRollFrameCnt);
+  preRollBusy = false;
+}
+
+static void prepPreRoll() {
+  // ring allocated once, so no allocation per frame
+  if (!preRollSecs) return;
+  preRoll.size = preRollKB * 1024;
+  preRoll.buff = (uint8_t*)ps_malloc(preRoll.size);
+  if (preRoll.buff == NULL) {
+    preRoll.size = 0;
+    LOG_WRN("Insufficient PSRAM for %u kB pre-roll ring", preRollKB);
+  }
+}
+
+static void storeFrame(camera_fb_t* fb, uint32_t seq) {
+  // add frame to recording, rotating segment or auto closing as required
+  if (recFull) return; // waiting for capture task to close recording
+  if (segmentDue()) {
+    if (isSegmented) rotateAvi();
+    else {
+      // switch from motion recording to segments
+      closeAvi();
+      openAvi();
+    }
+  }
+  saveFrame(fb, seq);
+  showProgress();
+  if (!segmentMins && (frameCnt >= maxFrames || odmlFull())) {
+    Serial.println("");
+    LOG_INF("Auto closed recording after %u frames", frameCnt);
+    recFull = odmlFull(); // no room for further frames
+    forceRecord = false;
+  }
+}
+
+static void doWrite(writeItem& wItem) {
+  // carry out recording action in order queued by capture task
+  if (wItem.action == WRITE_OPEN) {
+    stopPlaying(); // terminate any playback
+    stopPlayback = true; // stop any subsequent playback
+    captureTrigger = wItem.trigger;
+    // recording starts from oldest held frame
+    openAvi(true, preRollBusy && preRollCnt ? (esp_timer_get_time() - frameUsecs(preRollFrames[preRollFirst].timestamp)) / 1000 : 0);
+    if (preRollBusy) savePreRoll();
+  } else if (wItem.action == WRITE_FRAME) {
+    camera_fb_t fb = {};
+    fb.buf = wItem.buf;
+    fb.len = wItem.len;
+    fb.timestamp = wItem.timestamp;
+    dTimeTot += wItem.dTime;
+    storeFrame(&fb, wItem.seq);
+  } else if (wItem.action == WRITE_CLOSE) {
+    closeAvi();
+    stopPlayback = false; // allow for playbacks
+  }
+}
+
+static void queueAction(uint8_t action, uint8_t trigger = 0) {
+  // pass open or close to writer task, never dropped
+  writeItem wItem = {action, trigger, NULL, 0, 0, {}, 0, 0};
+  if (writeQueue == NULL) doWrite(wItem);
+  else xQueueSend(writeQueue, &wItem, portMAX_DELAY);
+}
+
+static void queueFrame(camera_fb_t* fb, uint32_t seq, uint32_t dTime) {
+  // copy frame into ring for writer task, dropped if ring or queue full
+  writeItem wItem = {WRITE_FRAME, 0, fb->buf, fb->len, 0, fb->timestamp, seq, dTime};
+  if (writeQueue == NULL) {
+    doWrite(wItem);
+    return;
+  }
+  // frame is read up to 4 byte boundary when saved
+  if (!uxQueueSpacesAvailable(writeQueue) || (wItem.buf = ringAlloc((fb->len + 3) & ~3, wItem.ringLen)) == NULL) {
+    ringDropped++;
+    LOG_DBG("Write ring full, frame dropped");
+    return;
+  }
+  memcpy(wItem.buf, fb->buf, fb->len);
+  xQueueSend(writeQueue, &wItem, portMAX_DELAY);
+  queueHighWater = max((uint32_t)uxQueueMessagesWaiting(writeQueue), queueHighWater);
+}
+
+static void writerTask(void* parameter) {
+  // write queued frames to SD, so that capture is not held up by SD write latency
+  writeItem wItem;
+  while (true) {
+    if (xQueueReceive(writeQueue, &wItem, portMAX_DELAY) == pdTRUE) {
+      doWrite(wItem);
+      if (wItem.ringLen) ringFree(wItem.ringLen);
+    }
+  }
+  vTaskDelete(NULL);
+}
+
+static void prepWriter() {
+  // frames written by capture task if ring not configured, 
+  // else ring is allocated by sizeWriteRing() when first recording starts
+  if (!writeRingKB || !psramFound()) return;
+  ringMutex = xSemaphoreCreateMutex();
+  writeQueue = xQueueCreate(WRITE_QUEUE_LEN, sizeof(writeItem));
+  // on app core, as camera driver and WiFi run on protocol core
+  xTaskCreatePinnedToCore(&writerTask, "writerTask", 1024 * 4, NULL, 4, &writerHandle, APP_CPU_NUM);
+}
+
+void getWriteRingStats(uint32_t& usedPct, uint32_t& maxPct, uint32_t& dropped, uint32_t& skipped) {
+  // write ring occupancy and high water mark, frames dropped as ring full, and timer ticks skipped
+  usedPct = writeRing.size ? 100 * writeRing.used / writeRing.size : 0;
+  maxPct = writeRing.size ? 100 * ringHighWater / writeRing.size : 0;
+  dropped = ringDropped;
+  skipped = ticksSkipped;
+}
+
+/********************** capture governor ***********************/
+
+// samples recording load and applies settings decided by policy in governor.cpp
+
+static govState gov;
+static bool govActive = false; // governor started for current recording
+static uint32_t govMark, govBusyMark, govLostMark; // values at start of sample window
+static uint32_t govSteps; // changes made during current recording
+static uint8_t govLowFPS, govHighQuality; // most reduced settings during current recording
+
+static void startGovernor() {
+  // settings at start of recording are upper limits for governor
+  if (!useGovernor) return;
+  sensor_t* s = esp_camera_sensor_get();
+  gov = {FPS, (uint8_t)s->status.quality, FPS, (uint8_t)s->status.quality, 0, 0};
+  govLowFPS = gov.fps;
+  govHighQuality = gov.quality;
+  govSteps = 0;
+  govMark = millis();
+  govBusyMark = writerBusyMs;
+  govLostMark = ringDropped + ticksSkipped + fbFailures;
+  govActive = true;
+}
+
+static void govern() {
+  // sample recording load once per window and apply any change decided
+  if (!govActive || millis() - govMark < GOV_WINDOW_MS) return;
+  sensor_t* s = esp_camera_sensor_get();
+  // settings changed by user during recording become new limits
+  if (FPS != gov.fps) gov.userFPS = gov.fps = FPS;
+  if (s->status.quality != gov.quality) gov.userQuality = gov.quality = s->status.quality;
+  uint32_t elapsed = millis() - govMark;
+  uint32_t busyMs = writerBusyMs;
+  uint32_t lost = ringDropped + ticksSkipped + fbFailures;
+  govSample sample;
+  sample.loadPct = std::min(100 * (busyMs - govBusyMark) / elapsed, (uint32_t)100);
+  sample.ringPct = writeRing.size ? 100 * writeRing.used / writeRing.size : 0;
+  sample.lost = lost - govLostMark;
+  govMark += elapsed;
+  govBusyMark = busyMs;
+  govLostMark = lost;
+  // logged for replay by test/host/govTest
+  LOG_DBG("Governor sample busy %u%%, ring %u%%, lost %u", sample.loadPct, sample.ringPct, sample.lost);
+  uint8_t prevFPS = gov.fps;
+  uint8_t prevQuality = gov.quality;
+  if (govDecide(gov, sample, getGovPolicy(fsizePtr))) {
+    if (gov.quality != prevQuality) s->set_quality(s, gov.quality);
+    if (gov.fps != prevFPS) setFPS(gov.fps);
+    govSteps++;
+    govLowFPS = std::min(gov.fps, govLowFPS);
+    govHighQuality = std::max(gov.quality, govHighQuality);
+    LOG_INF("Governor set FPS %u, quality %u (busy %u%%, ring %u%%, lost %u)", gov.fps, gov.quality, sample.loadPct, sample.ringPct, sample.lost);
+  }
+}
+
+static void stopGovernor() {
+  // restore settings in use when recording started
+  if (!govActive) return;
+  govActive = false;
+  if (!govSteps) return;
+  sensor_t* s = esp_camera_sensor_get();
+  if (s->status.quality != gov.userQuality) s->set_quality(s, gov.userQuality);
+  if (FPS != gov.userFPS) setFPS(gov.userFPS);
+  LOG_INF("Governor made %u changes, lowest FPS %u, highest quality number %u", govSteps, govLowFPS, govHighQuality);
+}
+
+void getGovernorStats(uint8_t& fps, uint8_t& quality, uint32_t& steps) {
+  // settings applied by governor and changes made in current or last recording
+  fps = gov.fps;
+  quality = gov.quality;
+  steps = govSteps;
 }
 
 static boolean processFrame() {
@@ -347,20 +1458,31 @@ static boolean processFrame() {
 #ifdef USE_WEBSOCKET_SERVER
   xSemaphoreTake(frameMutex, portMAX_DELAY);
 #endif
-  if (fb == NULL) return false;
+  uint32_t seq = frameSeq++;
+  if (fb == NULL) {
+    fbFailures++;
+    return false;
+  }
   timeLapse(fb);
   // determine if time to monitor, then get motion capture status
   if (!forceRecord && useMotion) { 
     if (dbgMotion) checkMotion(fb, false); // check each frame for debug
-    else if (doMonitor(isCapturing)) captureMotion = checkMotion(fb, isCapturing); // check 1 in N frames
-  }
+    else if (doMonitor(isCapturing)) {
+      captureMotion = checkMotion(fb, isCapturing); // check 1 in N frames
+      if (isCapturing) {
+        motionChecks++;
+        if (captureMotion) motionHits++;
+      }
+    }
+  } else if (dupFrames && useMotion && isCapturing && doMonitor(true)) checkMotion(fb, false); // scene change for repeated frames
+
   if (pirUse) {
     pirVal = getPIRval();
     if (!pirVal && !isCapturing && !useMotion) checkMotion(fb, isCapturing); // to update light level
   }
   
   // either active PIR, Motion, or force start button will start capture, neither active will stop capture
-  isCapturing = forceRecord | captureMotion | pirVal;
+  isCapturing = forceRecord | captureMotion | pirVal | (segmentMins > 0);
   if (forceRecord || wasRecording || doRecording) {
     if (forceRecord && !wasRecording) wasRecording = true;
     else if (!forceRecord && wasRecording) wasRecording = false;
@@ -368,26 +1490,23 @@ static boolean processFrame() {
     if (isCapturing && !wasCapturing) {
       // movement has occurred, start recording, and switch on lamp if night time
       if (lampAuto && nightTime) setLamp(lampLevel); // switch on lamp
-      stopPlaying(); // terminate any playback
-      stopPlayback = true; // stop any subsequent playback
-      LOG_INF("Capture started by %s%s%s", captureMotion ? "Motion " : "", pirVal ? "PIR" : "",forceRecord ? "Button" : "");
+      preRollBusy = preRoll.buff != NULL; // held frames handed to new recording
+      LOG_INF("Capture started by %s%s%s%s", captureMotion ? "Motion " : "", pirVal ? "PIR" : "",forceRecord ? "Button" : "", segmentMins ? " Segments" : "");
 #ifdef USE_WEBSOCKET_SERVER
       socketSendToServer("RecordStart");
 #endif
-      openAvi();
+      if (writeQueue != NULL && fb != NULL) sizeWriteRing(fb->len);
+      queueAction(WRITE_OPEN, (captureMotion ? CAPTURE_MOTION : 0) | (pirVal ? CAPTURE_PIR : 0) 
+        | (forceRecord ? CAPTURE_BUTTON : 0) | (segmentMins ? CAPTURE_SEGMENT : 0));
       wasCapturing = true;
+      startGovernor();
     }
     if (isCapturing && wasCapturing) {
       // capture is ongoing
-      dTimeTot += millis() - dTime;
-      saveFrame(fb);
-      showProgress();
-      if (frameCnt >= maxFrames) {
-        Serial.println("");
-        LOG_INF("Auto closed recording after %u frames", maxFrames);
-        forceRecord = false;
-      }
+      queueFrame(fb, seq, millis() - dTime);
+      govern();
     }
+    else if (!isCapturing && !wasCapturing) holdPreRoll(fb, seq);
     if (!isCapturing && wasCapturing) {
       // movement stopped
       finishRecording = true;
@@ -403,9 +1522,11 @@ static boolean processFrame() {
   fb = NULL; 
   if (finishRecording) {
     // cleanly finish recording (normal or forced)
-    if (stopPlayback) closeAvi();
-    finishRecording = isCapturing = wasCapturing = stopPlayback = false; // allow for playbacks
+    queueAction(WRITE_CLOSE);
+    stopGovernor();
+    finishRecording = isCapturing = wasCapturing = false;
   }
+  checkFilePool();
   return res;
 }
 
@@ -414,7 +1535,12 @@ static void captureTask(void* parameter) {
   uint32_t ulNotifiedValue;
   while (true) {
     ulNotifiedValue = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
-    if (ulNotifiedValue > 5) ulNotifiedValue = 5; // prevent too big queue if FPS excessive
+    if (ulNotifiedValue > 5) {
+      // prevent too big queue if FPS excessive
+      ticksSkipped += ulNotifiedValue - 5;
+      frameSeq += ulNotifiedValue - 5; // lost frames are gaps in sequence
+      ulNotifiedValue = 5;
+    }
     // may be more than one isr outstanding if the task delayed by SD write or jpeg decode
     while (ulNotifiedValue-- > 0) processFrame();
   }
@@ -448,16 +1574,22 @@ static fnameStruct extractMeta(const char* fname) {
   // replace all '_' with space for sscanf
   for (int i = 0; i <= strlen(fnameStr); i++) 
     if (fnameStr[i] == '_') fnameStr[i] = ' ';
-  int items = sscanf(fnameStr, "%*s %*s %*s %hhu %u %hu", &fnameMeta.recFPS, &fnameMeta.recDuration, &fnameMeta.frameCnt);
+  int items = sscanf(fnameStr, "%*s %*s %*s %hhu %u %u", &fnameMeta.recFPS, &fnameMeta.recDuration, &fnameMeta.frameCnt);
   if (items != 3) LOG_ERR("failed to parse %s, items %u", fname, items);
   return fnameMeta;
 }
 
 static void playbackFPS(const char* fname) {
-  // extract meta data from filename to commence playback
-  fnameStruct fnameMeta = extractMeta(fname);
-  recFPS = fnameMeta.recFPS;
-  recDuration = fnameMeta.recDuration;
+  // get meta data from avi info list to commence playback, else from filename
+  aviMetaStruct aviMeta;
+  if (getAviMeta(playbackFile, aviMeta)) {
+    recFPS = aviMeta.recFPS;
+    recDuration = lround(aviMeta.duration / 1000.0);
+  } else {
+    fnameStruct fnameMeta = extractMeta(fname);
+    recFPS = fnameMeta.recFPS;
+    recDuration = fnameMeta.recDuration;
+  }
   // temp change framerate to recorded framerate
   FPS = recFPS;
   controlFrameTimer(true); // set frametimer
@@ -469,7 +1601,9 @@ static void readSD() {
   // read to interim dram before copying to psram
   readLen = 0;
   if (!stopPlayback) {
-    readLen = playbackFile.read(iSDbuffer+RAMSIZE+CHUNK_HDR, RAMSIZE);
+    size_t readPos = playbackFile.position();
+    readLen = playbackFile.read(readBuff, RAMSIZE);
+    if (isCryptPlay) cryptAvi(playCrypt, readBuff, readLen, readPos);
     LOG_DBG("SD read time %lu ms", millis() - rTime);
   }
   wTimeTot += millis() - rTime;
@@ -486,14 +1620,53 @@ void openSDfile(const char* streamFile) {
     strcpy(aviFileName, streamFile);
     LOG_INF("Playing %s", aviFileName);
     playbackFile = SD_MMC.open(aviFileName, FILE_READ);
-    playbackFile.seek(AVI_HEADER_LEN, SeekSet); // skip over header
     playbackFPS(aviFileName);
+    if (isCryptPlay) freeAviCrypt(playCrypt);
+    isCryptPlay = getAviCrypt(playbackFile, playCrypt);
+    loadJpegTables(playbackFile); // for frames stored without Huffman tables
+    size_t moviStart = getMoviStart(playbackFile, isMultiRiff);
+    isAlignedPlay = isAlignedAvi(playbackFile);
+    // if aligned, read from sector boundary so frame markers are not split between buffers
+    alignSkip = isAlignedPlay ? moviStart & (SECTOR_SIZE - 1) : 0;
+    playbackFile.seek(moviStart - alignSkip, SeekSet); // skip over header
+    // aligned playback alternates between two buffers, each preceded by overlap
+    readBuff = iSDbuffer + RAMSIZE + CHUNK_HDR + (isAlignedPlay ? CHUNK_HDR : 0);
     isPlaying = true; // task control
     doPlayback = true; // browser control
     readSD(); // prime playback task
   }
 }
 
+static void paceFrame() {
+  // wait until next frame due, from its capture time if recorded, else from frame timer
+  if (nextFrameUs < 0) {
+    xSemaphoreTake(playbackSemaphore, portMAX_DELAY);
+    return;
+  }
+  int64_t nowUs = esp_timer_get_time();
+  int64_t gapUs = nextFrameUs - prevFrameUs;
+  if (!prevFrameUs || gapUs < 0 || gapUs > MAX_FRAME_GAP_US) {
+    // first timed frame, or discontinuity such as between merged recordings
+    paceCapUs = nextFrameUs;
+    pacePlayUs = nowUs;
+  }
+  int64_t waitUs = pacePlayUs + nextFrameUs - paceCapUs - nowUs;
+  if (waitUs >= 1000) delay(waitUs / 1000); // else playback is behind, so no wait
+  prevFrameUs = nextFrameUs;
+  nextFrameUs = -1;
+}
+
+static bool isSkipChunk(uint32_t chunkId) {
+  // chunks between frames that playback can pass over
+  if ((chunkId & 0xFFFF) == 0x7869) return true; // ix## standard index
+  if (chunkId == 0x4B4E554A) return true; // JUNK
+  if (chunkId == 0x62773130) return true; // 01wb interleaved audio
+  if (chunkId == 0x63643230) return true; // 02dc thumbnail
+  if (chunkId == 0x46464952 || chunkId == 0x5453494C) return isMultiRiff; // RIFF or LIST in AVIX
+  if (chunkId == 0x31786469) return isMultiRiff; // idx1 before next RIFF
+  return false;
+}
+
 mjpegStruct getNextFrame(bool firstCall) {
   // get next cluster on demand when ready for opened avi
   mjpegStruct mjpegData;
@@ -504,13 +1677,18 @@ mjpegStruct getNextFrame(bool firstCall) {
   static uint32_t tTimeTot;
   static uint32_t hTime;
   static size_t remainingFrame;
+  static size_t remainingSkip;
   static size_t buffLen;
+  static size_t playBase; // start of buffer being played from
   const uint32_t dcVal = 0x63643030; // value of 00dc marker
   if (firstCall) {
     sTime = millis();
     hTime = millis();  
     remainingBuff = completedPlayback = false;
-    frameCnt = remainingFrame = vidSize =  buffOffset = 0;
+    frameCnt = remainingFrame = remainingSkip = vidSize = buffLen = playBase = 0;
+    nextFrameUs = -1;
+    prevFrameUs = 0;
+    buffOffset = CHUNK_HDR + alignSkip; // first buffer has no overlap
     wTimeTot = fTimeTot = hTimeTot = tTimeTot = 0;
   }  
   
@@ -522,46 +1700,83 @@ mjpegStruct getNextFrame(bool firstCall) {
     if (!remainingBuff) {
       // load more data from SD
       mTime = millis();
-      // move final bytes to buffer start in case jpeg marker at end of buffer
-      memcpy(iSDbuffer, iSDbuffer+RAMSIZE, CHUNK_HDR);
+      uint8_t* prevBuff = iSDbuffer + playBase;
       xSemaphoreTake(readSemaphore, portMAX_DELAY); // wait for read from SD card completed
-      buffLen = readLen;
       LOG_DBG("SD wait time %lu ms", millis()-mTime);
       wTimeTot += millis()-mTime;
       mTime = millis();  
-      // overlap buffer by CHUNK_HDR to prevent jpeg marker being split between buffers                               
-      memcpy(iSDbuffer+CHUNK_HDR, iSDbuffer+RAMSIZE+CHUNK_HDR, buffLen); // load new cluster from double buffer
-
-      LOG_DBG("memcpy took %lu ms for %u bytes", millis()-mTime, buffLen);
+      if (isAlignedPlay) {
+        // play from buffer just read, and read next cluster into buffer just played
+        playBase = playBase ? 0 : RAMSIZE + CHUNK_HDR;
+        readBuff = prevBuff + CHUNK_HDR;
+      }
+      // move final bytes to buffer start in case marker at end of buffer
+      memcpy(iSDbuffer + playBase, prevBuff + buffLen, CHUNK_HDR);
+      buffOffset -= buffLen; // carry over position, marker may overlap end of buffer
+      buffLen = readLen;
+      if (!isAlignedPlay) {
+        // overlap buffer by CHUNK_HDR to prevent jpeg marker being split between buffers                               
+        memcpy(iSDbuffer+CHUNK_HDR, iSDbuffer+RAMSIZE+CHUNK_HDR, buffLen); // load new cluster from double buffer
+        LOG_DBG("memcpy took %lu ms for %u bytes", millis()-mTime, buffLen);
+      }
       fTimeTot += millis() - mTime;
       remainingBuff = true;
-      if (buffOffset > RAMSIZE) buffOffset = 4; // special case, marker overlaps end of buffer 
-      else buffOffset = frameCnt ? 0 : CHUNK_HDR; // only before 1st frame
       xTaskNotifyGive(playbackHandle); // wake up task to get next cluster - sets readLen
     }
     mTime = millis();
+    if (!remainingFrame && remainingSkip) {
+      // skip over non frame chunk, eg OpenDML index
+      size_t skipLen = min(remainingSkip, buffLen - min(buffOffset, buffLen));
+      remainingSkip -= skipLen;
+      buffOffset += skipLen;
+      if (remainingSkip) {
+        remainingBuff = false;
+        mjpegData.buffLen = mjpegData.jpegSize = 0;
+        mjpegData.buffOffset = CHUNK_HDR; // nothing to send, get next buffer
+        return mjpegData;
+      }
+    }
     if (!remainingFrame) {
       // at start of jpeg frame marker
       uint32_t inVal;
-      memcpy(&inVal, iSDbuffer + buffOffset, 4);
-      if (inVal != dcVal) {
+      memcpy(&inVal, iSDbuffer + playBase + buffOffset, 4);
+      if (inVal != dcVal && buffLen && isSkipChunk(inVal)) {
+        // skip over chunk then check for next frame
+        uint32_t chunkSize;
+        memcpy(&chunkSize, iSDbuffer + playBase + buffOffset + 4, 4);
+        if (inVal == 0x46464952 || inVal == 0x5453494C) remainingSkip = 12; // RIFF or LIST header only
+        else remainingSkip = CHUNK_HDR + chunkSize + (chunkSize & 1);
+        uint32_t seq;
+        if (buffOffset + TIME_CHUNK_LEN <= buffLen + CHUNK_HDR && getFrameTime(iSDbuffer + playBase + buffOffset, seq, nextFrameUs)) {
+          // capture time of following frame, which is ignored if chunk split between buffers
+          LOG_DBG("Frame %u captured at %lld us", seq, nextFrameUs);
+        } else if (buffOffset + 4 <= buffLen && isDupChunk(iSDbuffer + playBase + buffOffset)) {
+          // repeat of previous frame, which browser continues to show until next frame due
+          paceFrame();
+          frameCnt++;
+        }
+        mjpegData.buffLen = mjpegData.jpegSize = 0;
+        mjpegData.buffOffset = CHUNK_HDR; // nothing to send
+        return mjpegData;
+      }
+      if (inVal != dcVal || !buffLen) {
         // reached end of frames to stream
         mjpegData.buffLen = buffOffset; // remainder of final jpeg
-        mjpegData.buffOffset = 0; // from start of buff
+        mjpegData.buffOffset = playBase; // from start of buff
         mjpegData.jpegSize = 0; 
         stopPlayback = completedPlayback = true;
         return mjpegData;
       } else {
         // get jpeg frame size
         uint32_t jpegSize;
-        memcpy(&jpegSize, iSDbuffer + buffOffset + 4, 4);
+        memcpy(&jpegSize, iSDbuffer + playBase + buffOffset + 4, 4);
         remainingFrame = jpegSize;
         vidSize += jpegSize;
         buffOffset += CHUNK_HDR; // skip over marker 
         mjpegData.jpegSize = jpegSize; // signal start of jpeg to webServer
         mTime = millis();
-        // wait on playbackSemaphore for rate control
-        xSemaphoreTake(playbackSemaphore, portMAX_DELAY);
+        // wait for rate control
+        paceFrame();
         LOG_DBG("frame timer wait %lu ms", millis()-mTime);
         tTimeTot += millis()-mTime;
         frameCnt++;
@@ -569,9 +1784,9 @@ mjpegStruct getNextFrame(bool firstCall) {
       }
     } else mjpegData.jpegSize = 0; // within frame,    
     // determine amount of data to send to webServer
-    if (buffOffset > RAMSIZE) mjpegData.buffLen = 0; // special case 
+    if (buffOffset > buffLen) mjpegData.buffLen = 0; // marker overlaps end of buffer 
     else mjpegData.buffLen = (remainingFrame > buffLen - buffOffset) ? buffLen - buffOffset : remainingFrame;
-    mjpegData.buffOffset = buffOffset; // from here    
+    mjpegData.buffOffset = playBase + buffOffset; // from here    
     remainingFrame -= mjpegData.buffLen;
     buffOffset += mjpegData.buffLen;
     if (buffOffset >= buffLen) remainingBuff = false;
@@ -642,21 +1857,165 @@ static void startSDtasks() {
   // tasks to manage SD card operation
   xTaskCreate(&captureTask, "captureTask", 1024 * 4, NULL, 5, &captureHandle);
   xTaskCreate(&playbackTask, "playbackTask", 1024 * 4, NULL, 4, &playbackHandle);
+  prepWriter();
+  prepPreRoll();
   sensor_t * s = esp_camera_sensor_get();
   fsizePtr = s->status.framesize; 
   setFPS(frameData[fsizePtr].defaultFPS); // initial frames per second  
   debugMemory("startSDtasks");
 }
 
+static void renameRecovered(const char* tempName, time_t lastWrite, uint32_t recFrames, bool haveWav, const char* fileExt) {
+  // name recovered file using time of last write to SD
+  strftime(partName, sizeof(partName), "/%Y%m%d", localtime(&lastWrite));
+  SD_MMC.mkdir(partName); // make date folder if not present
+  strftime(partName, sizeof(partName), "/%Y%m%d/%Y%m%d_%H%M%S", localtime(&lastWrite));
+  uint8_t recoverFPS = FPS ? FPS : 1;
+  recordingName(aviFileName, recoverFPS, recFrames / recoverFPS, recFrames, haveWav, fileExt);
+  SD_MMC.rename(tempName, aviFileName);
+}
+
+static void keepEncrypted(const char* tempName) {
+  // keep encrypted recording out of way of next recording, to be recovered at restart once passphrase set
+  if (strcmp(tempName, CRYPTTEMP)) {
+    if (SD_MMC.exists(CRYPTTEMP)) SD_MMC.remove(CRYPTTEMP);
+    SD_MMC.rename(tempName, CRYPTTEMP);
+  }
+  LOG_ERR("Cannot recover encrypted %s without passphrase", tempName);
+}
+
+static bool recoverTempAvi(const char* tempName, bool keepName = false) {
+  // recover avi left unfinished by power loss during recording
+  if (!SD_MMC.exists(tempName)) return false;
+  uint32_t rTime = millis();
+  File df = SD_MMC.open(tempName, "r+");
+  if (!df) return false;
+  time_t lastWrite = df.getLastWrite();
+  size_t fileSize = df.size();
+  // pooled recording is only valid up to extent stamped in its empty header
+  uint32_t extentHdr[2];
+  bool hasExtent = df.read((uint8_t*)extentHdr, 8) == 8 && !memcmp(extentHdr, extentTag, 4);
+  size_t scanLen = hasExtent ? std::min((size_t)extentHdr[1], fileSize) : fileSize;
+  uint32_t recFrames;
+  bool noKey;
+  size_t aviLen = recoverAviIdx(df, scanLen, iSDbuffer, RAMSIZE, recFrames, noKey);
+  if (noKey) {
+    df.close();
+    keepEncrypted(tempName);
+    return false;
+  }
+  if (!aviLen) {
+    df.close();
+    SD_MMC.remove(tempName);
+    LOG_WRN("No frames to recover from %s", tempName);
+    return false;
+  }
+  // overwrite any torn final frame with index
+  df.seek(aviLen, SeekSet);
+  size_t readLen = 0;
+  bool haveWav = haveSound;
+  finalizeAviIndex();
+  do {
+    readLen = writeAviIndex(iSDbuffer, RAMSIZE);
+    if (readLen) aviLen += df.write(iSDbuffer, readLen);
+  } while (readLen > 0);
+  uint8_t recoverFPS = FPS ? FPS : 1;
+  xSemaphoreTake(aviMutex, portMAX_DELAY);
+  setAviMeta(lastWrite - recFrames / recoverFPS, recFrames * 1000 / recoverFPS, 0, 0);
+  recoverAviHdr(df, recoverFPS, fsizePtr, recFrames);
+  xSemaphoreGive(aviMutex); 
+  df.close();
+  if (fileSize > aviLen) {
+    // remove remainder of torn frame
+    truncateFile(tempName, aviLen); 
+  }
+  if (keepName) strcpy(aviFileName, tempName);
+  else renameRecovered(tempName, lastWrite, recFrames, haveWav, FILE_EXT);
+  LOG_INF("Recovered %s with %u frames in %lu ms", aviFileName, recFrames, millis() - rTime);
+  return true;
+}
+
+static bool recoverTempMp4(const char* tempName) {
+  // recover mp4 left unfinished by power loss, discarding any incomplete fragment
+  if (!SD_MMC.exists(tempName)) return false;
+  File df = SD_MMC.open(tempName, FILE_READ);
+  if (!df) return false;
+  time_t lastWrite = df.getLastWrite();
+  uint32_t recFrames;
+  bool noKey;
+  size_t mp4Len = recoverMp4(df, recFrames, noKey);
+  df.close();
+  if (noKey) {
+    keepEncrypted(tempName);
+    return false;
+  }
+  if (!recFrames) {
+    SD_MMC.remove(tempName);
+    LOG_WRN("No frames to recover from %s", tempName);
+    return false;
+  }
+  truncateFile(tempName, mp4Len);
+  renameRecovered(tempName, lastWrite, recFrames, haveSound, MP4_EXT);
+  LOG_INF("Recovered %s with %u frames", aviFileName, recFrames);
+  return true;
+}
+
+static bool recoverNamedAvi(const char* markName) {
+  // recover recording left unfinished under its final name, as held in its in progress marker,
+  // if its header is still empty or only holds pooled extent
+  char recordName[FILE_NAME_LEN] = {0};
+  if (!SD_MMC.exists(markName)) return false;
+  File mf = SD_MMC.open(markName, FILE_READ);
+  if (mf) mf.read((uint8_t*)recordName, FILE_NAME_LEN - 1);
+  mf.close();
+  SD_MMC.remove(markName);
+  char riffTag[4] = {0};
+  File df;
+  if (*recordName && SD_MMC.exists(recordName)) df = SD_MMC.open(recordName, FILE_READ);
+  if (!df) return false;
+  df.read((uint8_t*)riffTag, 4);
+  df.close();
+  return memcmp(riffTag, "RIFF", 4) ? recoverTempAvi(recordName, true) : false;
+}
+
+static bool recoverTempFile(const char* tempName) {
+  // recover file that may be either container, mp4 starts with ftyp box
+  char boxType[8] = {0};
+  File sf;
+  if (SD_MMC.exists(tempName)) sf = SD_MMC.open(tempName, FILE_READ);
+  if (sf) {
+    sf.read((uint8_t*)boxType, sizeof(boxType));
+    sf.close();
+  }
+  return memcmp(boxType + 4, "ftyp", 4) ? recoverTempAvi(tempName) : recoverTempMp4(tempName);
+}
+
+bool checkSDFiles() {
+  // recover recording, and any recording still being finalized, after power loss
+  if (SD_MMC.exists(SEGIDXTEMP)) SD_MMC.remove(SEGIDXTEMP); // index is rebuilt
+  if (SD_MMC.exists(EDITTEMP)) SD_MMC.remove(EDITTEMP); // incomplete edit, sources retained
+  bool recovered = recoverTempFile(SEGTEMP);
+  recovered = recoverTempMp4(MP4TEMP) || recovered;
+  // recorded without temporary name
+  recovered = recoverNamedAvi(SEGNAMETEMP) || recovered;
+  recovered = recoverNamedAvi(NAMETEMP) || recovered;
+  recovered = recoverTempFile(CRYPTTEMP) || recovered;
+  return recoverTempAvi(AVITEMP) || recovered;
+}
+
 bool prepRecording() {
   // initialisation & prep for AVI capture
   readSemaphore = xSemaphoreCreateBinary();
   playbackSemaphore = xSemaphoreCreateBinary();
   aviMutex = xSemaphoreCreateMutex();
+  poolMutex = xSemaphoreCreateMutex();
   motionMutex = xSemaphoreCreateMutex();  
 #ifdef USE_WEBSOCKET_SERVER
   frameMutex = xSemaphoreCreateMutex();
 #endif
+  prepAviCrypt();
+  checkSDFiles();
+  fillFilePool();
   camera_fb_t* fb = esp_camera_fb_get();
   if (fb == NULL) LOG_WRN("failed to get camera frame");
   else {
@@ -684,6 +2043,7 @@ static void deleteTask(TaskHandle_t thisTaskHandle) {
 void endTasks() {
   deleteTask(captureHandle);
   deleteTask(playbackHandle);
+  deleteTask(writerHandle);
   deleteTask(DS18B20handle);
   deleteTask(servoHandle);
   deleteTask(emailHandle);
@@ -31,10 +31,14 @@ int detectEndBand = 8; // inclusive
 int detectChangeThreshold = 15; // min difference in pixel comparison to indicate a change
 
 uint8_t lightLevel; // Current ambient light level 
+bool sceneChanged = true; // whether last motion check found change above threshold
 uint8_t nightSwitch = 20; // initial white level % for night/day switching
 float motionVal = 8.0; // initial motion sensitivity setting
 static uint8_t* jpgImg = NULL;
 static size_t jpgImgSize = 0;
+static uint8_t* thumbImg = NULL;
+static size_t thumbSize = 0;
+static uint32_t thumbTime = 0;
 
 /**********************************************************************************/
 
@@ -104,7 +108,9 @@ bool checkMotion(camera_fb_t* fb, bool motionStatus) {
   static uint8_t* changeMap = (uint8_t*)ps_malloc(maxSize);
   static uint8_t* prev_buf = (uint8_t*)ps_malloc(maxSize);
   static uint8_t* _jpgImg = (uint8_t*)ps_malloc(maxSize);
+  static uint8_t* _thumbImg = (uint8_t*)ps_malloc(maxSize);
   jpgImg = _jpgImg;
+  thumbImg = _thumbImg;
 
   // compare each pixel in current frame with previous frame 
   int changeCount = 0;
@@ -129,7 +135,8 @@ bool checkMotion(camera_fb_t* fb, bool motionStatus) {
   LOG_DBG("Detected %u changes, threshold %u, light level %u, in %lums", changeCount, moveThreshold, lightLevel, millis() - dTime);
   dTime = millis();
 
-  if (changeCount > moveThreshold) {
+  sceneChanged = changeCount > moveThreshold;
+  if (sceneChanged) {
     LOG_DBG("### Change detected");
     motionCnt++; // number of consecutive changes
     // need minimum sequence of changes to signal valid movement
@@ -157,6 +164,21 @@ bool checkMotion(camera_fb_t* fb, bool motionStatus) {
   }
   if (motionStatus) LOG_DBG("*** Motion - ongoing %u frames", motionCnt);
 
+  if (thumbSecs && (motionStatus || isCapturing) && (!isCapturing || millis() - thumbTime >= thumbSecs * 1000)) {
+    // build thumbnail jpeg for avi from grayscale image, at start of capture then every thumbSecs
+    dTime = millis();
+    if (fmt2jpg(prev_buf, num_pixels, sampleWidth, sampleHeight, PIXFORMAT_GRAYSCALE, 60, &jpg_buf, &jpg_len)) {
+      if (jpg_len < maxSize - 4) {
+        memcpy(thumbImg, jpg_buf, jpg_len);
+        thumbSize = jpg_len;
+        thumbTime = millis();
+      }
+    } else LOG_ERR("motionDetect: thumbnail fmt2jpg() failed");
+    free(jpg_buf);
+    jpg_buf = NULL;
+    LOG_DBG("Created thumbnail JPEG %d bytes in %lums", jpg_len, millis() - dTime);
+  }
+
   if (dbgMotion) { 
     // build jpeg of changeMap for debug streaming
     dTime = millis();
@@ -195,6 +217,14 @@ bool fetchMoveMap(uint8_t **out, size_t *out_len) {
   }
 }
 
+bool fetchThumb(uint8_t **out, size_t *out_len) {
+  // return thumbnail jpeg for avi if not already collected and still current
+  *out = thumbImg;
+  *out_len = (millis() - thumbTime < thumbSecs * 1000) ? thumbSize : 0;
+  thumbSize = 0;
+  return *out_len > 0;
+}
+
 /************* copied and modified from esp32-camera/to_bmp.c to access jpg_scale_t *****************/
 
 typedef struct {
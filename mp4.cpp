@@ -0,0 +1,475 @@
+/*
+Generate fragmented MP4 format for recorded videos, as alternative to AVI
+Frames are stored as MJPEG, which desktop media players decode but browser <video> elements do not,
+so MP4 recordings are for download only, not app playback
+
+s60sc 2020, 2022
+*/
+
+/* fragmented MP4 file format:
+init segment:
+ ftyp
+ moov with video track (MJPEG as mp4v), audio track (PCM as sowt) if mic in use,
+ and mvex so that sample tables are in fragments
+ free box holding JENC encryption details if Enc_Pass set, as for AVI, with rest of file encrypted
+per fragment (up to MP4_FRAG_SECS or MP4_FRAG_FRAMES):
+ moof (mfhd, video traf, audio traf) followed by free box to fill reserved space
+ mdat header
+ jpeg frames, as received
+ pcm for duration of fragment
+Space for fragment header is reserved before its frames are written,
+and completed when the fragment is finished, so file is always playable
+up to last completed fragment, and no index is required at end of file.
+Video timescale is milliseconds, from actual frame capture times.
+*/
+
+#include "appGlobals.h"
+
+#define MP4_FRAG_SECS 2 // target duration of each fragment
+#define MP4_FRAG_FRAMES 128 // max frames per fragment
+#define MP4_AUD_LEN ((MP4_FRAG_SECS + 2) * SAMPLE_RATE * 2) // fragment audio buffer
+#define MP4_FRAG_HDR 1536 // space reserved for moof, free & mdat header, for up to MP4_FRAG_FRAMES
+#define MP4_INIT_MAX 1024 // max init segment length
+#define MP4_BOX_DEPTH 8
+#define VID_TRACK 1
+#define AUD_TRACK 2
+
+static uint8_t* mp4Buf; // buffer currently being composed
+static size_t mp4Pos;
+static size_t boxStack[MP4_BOX_DEPTH]; // start of each open box
+static int boxDepth;
+
+static uint8_t* initBuf = NULL; // ftyp & moov
+static uint8_t* fragBuf = NULL; // moof, free & mdat header
+static uint8_t* fragAud = NULL; // pcm for current fragment
+static uint32_t fragSizes[MP4_FRAG_FRAMES];
+static uint32_t fragDurations[MP4_FRAG_FRAMES];
+static uint32_t fragFrames; // frames in current fragment
+static size_t fragVidLen;
+static size_t fragAudLen;
+static uint32_t fragSeq; // fragment sequence number
+static uint32_t fragStart; // millis of first frame in fragment
+static uint32_t lastFrameTime;
+static uint64_t vidTime; // video decode time of current fragment, in ms
+static uint64_t audTime; // audio decode time of current fragment, in samples
+static bool withAudio;
+
+/************** box composition ***************/
+
+static void put8(uint8_t val) {
+  mp4Buf[mp4Pos++] = val;
+}
+
+static void put16(uint16_t val) {
+  put8(val >> 8);
+  put8(val);
+}
+
+static void put32(uint32_t val) {
+  put16(val >> 16);
+  put16(val);
+}
+
+static void put64(uint64_t val) {
+  put32(val >> 32);
+  put32(val);
+}
+
+static void putStr(const char* str, size_t len) {
+  // fixed length field, zero padded
+  for (size_t i = 0; i < len; i++) put8(i < strlen(str) ? str[i] : 0);
+}
+
+static void putZeros(size_t len) {
+  memset(mp4Buf + mp4Pos, 0, len);
+  mp4Pos += len;
+}
+
+static void openBox(const char* boxType) {
+  boxStack[boxDepth++] = mp4Pos;
+  put32(0); // size set by closeBox()
+  putStr(boxType, 4);
+}
+
+static void openFullBox(const char* boxType, uint8_t version, uint32_t flags) {
+  openBox(boxType);
+  put32((version << 24) | flags);
+}
+
+static void closeBox() {
+  size_t boxStart = boxStack[--boxDepth];
+  size_t savePos = mp4Pos;
+  mp4Pos = boxStart;
+  put32(savePos - boxStart);
+  mp4Pos = savePos;
+}
+
+static void putMatrix() {
+  // unity matrix
+  const uint32_t matrix[9] = {0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000};
+  for (int i = 0; i < 9; i++) put32(matrix[i]);
+}
+
+/************** init segment ***************/
+
+static void buildDinf() {
+  openBox("dinf");
+  openFullBox("dref", 0, 0);
+  put32(1); // entry count
+  openFullBox("url ", 0, 1); // media in same file
+  closeBox();
+  closeBox();
+  closeBox();
+}
+
+static void buildEmptyTables() {
+  // sample tables are empty as samples are described in fragments
+  openFullBox("stts", 0, 0);
+  put32(0);
+  closeBox();
+  openFullBox("stsc", 0, 0);
+  put32(0);
+  closeBox();
+  openFullBox("stsz", 0, 0);
+  put32(0);
+  put32(0);
+  closeBox();
+  openFullBox("stco", 0, 0);
+  put32(0);
+  closeBox();
+}
+
+static void buildTkhd(uint32_t trackId, uint16_t volume, uint16_t width, uint16_t height) {
+  openFullBox("tkhd", 0, 3); // enabled, in movie
+  put32(0); // creation time
+  put32(0); // modification time
+  put32(trackId);
+  put32(0);
+  put32(0); // duration given by fragments
+  putZeros(8);
+  put16(0); // layer
+  put16(0); // alternate group
+  put16(volume);
+  put16(0);
+  putMatrix();
+  put32(width << 16);
+  put32(height << 16);
+  closeBox();
+}
+
+static void buildMdhdHdlr(uint32_t timescale, const char* handler, const char* name) {
+  openFullBox("mdhd", 0, 0);
+  put32(0);
+  put32(0);
+  put32(timescale);
+  put32(0);
+  put16(0x55C4); // und
+  put16(0);
+  closeBox();
+  openFullBox("hdlr", 0, 0);
+  put32(0);
+  putStr(handler, 4);
+  putZeros(12);
+  putStr(name, strlen(name) + 1);
+  closeBox();
+}
+
+static void buildVideoTrak(uint16_t width, uint16_t height) {
+  openBox("trak");
+  buildTkhd(VID_TRACK, 0, width, height);
+  openBox("mdia");
+  buildMdhdHdlr(1000, "vide", "VideoHandler");
+  openBox("minf");
+  openFullBox("vmhd", 0, 1);
+  putZeros(8); // graphics mode & opcolor
+  closeBox();
+  buildDinf();
+  openBox("stbl");
+  openFullBox("stsd", 0, 0);
+  put32(1); // entry count
+  openBox("mp4v");
+  putZeros(6);
+  put16(1); // data reference index
+  putZeros(16);
+  put16(width);
+  put16(height);
+  put32(0x00480000); // 72 dpi
+  put32(0x00480000);
+  put32(0);
+  put16(1); // frame count
+  putZeros(32); // compressor name
+  put16(0x0018); // depth
+  put16(0xFFFF);
+  openFullBox("esds", 0, 0);
+  put8(0x03); // ES descriptor
+  put8(21);
+  put16(VID_TRACK);
+  put8(0);
+  put8(0x04); // decoder config descriptor
+  put8(13);
+  put8(0x6C); // JPEG
+  put8(0x11); // visual stream
+  put8(0); // buffer size
+  put16(0);
+  put32(0); // max bitrate
+  put32(0); // avg bitrate
+  put8(0x06); // SL config descriptor
+  put8(1);
+  put8(0x02);
+  closeBox(); // esds
+  closeBox(); // mp4v
+  closeBox(); // stsd
+  buildEmptyTables();
+  closeBox(); // stbl
+  closeBox(); // minf
+  closeBox(); // mdia
+  closeBox(); // trak
+}
+
+static void buildAudioTrak() {
+  openBox("trak");
+  buildTkhd(AUD_TRACK, 0x0100, 0, 0);
+  openBox("mdia");
+  buildMdhdHdlr(SAMPLE_RATE, "soun", "SoundHandler");
+  openBox("minf");
+  openFullBox("smhd", 0, 0);
+  put32(0); // balance
+  closeBox();
+  buildDinf();
+  openBox("stbl");
+  openFullBox("stsd", 0, 0);
+  put32(1);
+  openBox("sowt"); // 16 bit little endian pcm
+  putZeros(6);
+  put16(1); // data reference index
+  putZeros(8);
+  put16(1); // mono
+  put16(16); // bits per sample
+  put32(0);
+  put32(SAMPLE_RATE << 16);
+  closeBox(); // sowt
+  closeBox(); // stsd
+  buildEmptyTables();
+  closeBox(); // stbl
+  closeBox(); // minf
+  closeBox(); // mdia
+  closeBox(); // trak
+}
+
+static void buildTrex(uint32_t trackId) {
+  openFullBox("trex", 0, 0);
+  put32(trackId);
+  put32(1); // sample description index
+  put32(0); // default duration
+  put32(0); // default size
+  put32(0); // default flags, each sample is sync sample
+  closeBox();
+}
+
+size_t prepMp4(uint8_t** initPtr, uint8_t frameType, bool hasAudio) {
+  // prep for new recording, and provide init segment to be written at start of file
+  if (initBuf == NULL) initBuf = (uint8_t*)ps_malloc(MP4_INIT_MAX);
+  if (fragBuf == NULL) fragBuf = (uint8_t*)ps_malloc(MP4_FRAG_HDR);
+  if (fragAud == NULL) fragAud = (uint8_t*)ps_malloc(MP4_AUD_LEN);
+  if (initBuf == NULL || fragBuf == NULL || fragAud == NULL) {
+    LOG_ERR("Insufficient memory for MP4, using AVI");
+    return 0;
+  }
+  withAudio = hasAudio;
+  fragFrames = fragVidLen = fragAudLen = fragSeq = 0;
+  vidTime = audTime = 0;
+  memset(fragBuf, 0, MP4_FRAG_HDR);
+  mp4Buf = initBuf;
+  mp4Pos = boxDepth = 0;
+  openBox("ftyp");
+  putStr("isom", 4);
+  put32(0x200);
+  putStr("isom", 4);
+  putStr("iso6", 4);
+  putStr("mp41", 4);
+  closeBox();
+  openBox("moov");
+  openFullBox("mvhd", 0, 0);
+  put32(0);
+  put32(0);
+  put32(1000); // timescale
+  put32(0); // duration given by fragments
+  put32(0x00010000); // rate
+  put16(0x0100); // volume
+  putZeros(10);
+  putMatrix();
+  putZeros(24);
+  put32(AUD_TRACK + 1); // next track id
+  closeBox();
+  buildVideoTrak(frameData[frameType].frameWidth, frameData[frameType].frameHeight);
+  if (withAudio) buildAudioTrak();
+  openBox("mvex");
+  buildTrex(VID_TRACK);
+  if (withAudio) buildTrex(AUD_TRACK);
+  closeBox();
+  closeBox(); // moov
+  *initPtr = initBuf;
+  return mp4Pos;
+}
+
+/************** fragments ***************/
+
+bool mp4FragDue(uint32_t frameTime) {
+  // set duration of previous frame from time of this frame,
+  // then check if current fragment should be completed before this frame
+  if (!fragFrames) return false;
+  fragDurations[fragFrames - 1] = frameTime - lastFrameTime;
+  return fragFrames >= MP4_FRAG_FRAMES || frameTime - fragStart >= MP4_FRAG_SECS * 1000
+    || fragAudLen > MP4_AUD_LEN - (SAMPLE_RATE * 2);
+}
+
+void mp4AddFrame(size_t jpegSize, uint32_t frameTime) {
+  // add frame to current fragment, frame content written directly after fragment header
+  if (!fragFrames) fragStart = frameTime;
+  fragSizes[fragFrames] = jpegSize;
+  fragDurations[fragFrames] = 1000 / FPS; // until next frame received
+  fragVidLen += jpegSize;
+  fragFrames++;
+  lastFrameTime = frameTime;
+}
+
+void mp4AddAudio(const uint8_t* pcmData, size_t pcmLen) {
+  // pcm is held until fragment completed, so that it is contiguous in mdat
+  if (!withAudio) return;
+  if (fragAudLen + pcmLen > MP4_AUD_LEN) {
+    LOG_WRN("MP4 fragment audio buffer full");
+    return;
+  }
+  memcpy(fragAud + fragAudLen, pcmData, pcmLen);
+  fragAudLen += pcmLen;
+  haveSound = true;
+}
+
+size_t mp4FragAudio(uint8_t** audPtr) {
+  // provide audio to be written after frames in fragment
+  *audPtr = fragAud;
+  return fragAudLen;
+}
+
+size_t mp4FragHdr(uint8_t** hdrPtr) {
+  // complete header of current fragment, to be written to space reserved before its frames
+  // returns 0 if fragment has no frames
+  if (!fragFrames) return 0;
+  uint32_t audSamples = fragAudLen / 2;
+  mp4Buf = fragBuf;
+  mp4Pos = boxDepth = 0;
+  openBox("moof");
+  openFullBox("mfhd", 0, 0);
+  put32(++fragSeq);
+  closeBox();
+  openBox("traf");
+  openFullBox("tfhd", 0, 0x020000); // default base is moof
+  put32(VID_TRACK);
+  closeBox();
+  openFullBox("tfdt", 1, 0);
+  put64(vidTime);
+  closeBox();
+  openFullBox("trun", 0, 0x000301); // data offset, sample durations & sizes
+  put32(fragFrames);
+  put32(MP4_FRAG_HDR); // frames start after fragment header
+  for (uint32_t i = 0; i < fragFrames; i++) {
+    put32(fragDurations[i]);
+    put32(fragSizes[i]);
+    vidTime += fragDurations[i];
+  }
+  closeBox();
+  closeBox(); // traf
+  if (withAudio && audSamples) {
+    openBox("traf");
+    openFullBox("tfhd", 0, 0x020018); // default base is moof, default duration & size
+    put32(AUD_TRACK);
+    put32(1); // 1 sample duration
+    put32(2); // 16 bit sample
+    closeBox();
+    openFullBox("tfdt", 1, 0);
+    put64(audTime);
+    closeBox();
+    openFullBox("trun", 0, 0x000001); // data offset
+    put32(audSamples);
+    put32(MP4_FRAG_HDR + fragVidLen); // audio follows frames
+    closeBox();
+    closeBox(); // traf
+    audTime += audSamples;
+  }
+  closeBox(); // moof
+  // fill remaining reserved space, then mdat header
+  size_t freeLen = MP4_FRAG_HDR - CHUNK_HDR - mp4Pos;
+  put32(freeLen);
+  putStr("free", 4);
+  putZeros(freeLen - CHUNK_HDR);
+  put32(CHUNK_HDR + fragVidLen + fragAudLen);
+  putStr("mdat", 4);
+  fragFrames = fragVidLen = fragAudLen = 0;
+  *hdrPtr = fragBuf;
+  return mp4Pos;
+}
+
+size_t mp4FragSpace(uint8_t** spacePtr) {
+  // space to reserve for fragment header, before its frames
+  memset(fragBuf, 0, MP4_FRAG_HDR);
+  *spacePtr = fragBuf;
+  return MP4_FRAG_HDR;
+}
+
+/************** recovery ***************/
+
+static bool readMp4(File& df, size_t filePos, uint8_t* buff, size_t buffLen, aviCryptStruct* crypt) {
+  // read from file position, decrypting if crypt provided
+  df.seek(filePos, SeekSet);
+  if (df.read(buff, buffLen) != buffLen) return false;
+  if (crypt != NULL) cryptAvi(*crypt, buff, buffLen, filePos);
+  return true;
+}
+
+size_t recoverMp4(File& df, uint32_t& frameCnt, bool& noKey) {
+  // find end of last complete fragment in mp4 left unfinished by power loss
+  // fragment header is only written when fragment complete, so is zero if incomplete
+  // noKey set if recording is encrypted but cannot be decrypted
+  uint32_t boxHdr[3];
+  uint8_t trunHdr[16];
+  size_t fileSize = df.size();
+  size_t boxPos = 0, validLen = 0, moofPos = 0;
+  uint32_t mfhdSeq, nextSeq = 1;
+  aviCryptStruct crypt;
+  aviCryptStruct* cryptPtr = NULL;
+  frameCnt = 0;
+  noKey = false;
+  while (boxPos + CHUNK_HDR <= fileSize) {
+    if (!readMp4(df, boxPos, (uint8_t*)boxHdr, CHUNK_HDR, cryptPtr)) break;
+    uint32_t boxLen = __builtin_bswap32(boxHdr[0]);
+    if (boxLen < CHUNK_HDR || boxPos + boxLen > fileSize) break; // incomplete
+    if (!memcmp(boxHdr + 1, "moov", 4)) validLen = boxPos + boxLen;
+    if (!memcmp(boxHdr + 1, "free", 4) && !moofPos && cryptPtr == NULL) {
+      // encrypted recording has plaintext JENC details in free box after init segment
+      if (readMp4(df, boxPos, (uint8_t*)boxHdr, sizeof(boxHdr), NULL) && !memcmp(boxHdr + 2, "JENC", 4)) {
+        if (!getMp4Crypt(df, crypt)) {
+          noKey = true;
+          return 0;
+        }
+        cryptPtr = &crypt;
+      }
+      validLen = boxPos + boxLen;
+    }
+    if (!memcmp(boxHdr + 1, "moof", 4)) {
+      // pool file may hold stale fragments of earlier recording beyond those written
+      if (!readMp4(df, boxPos + CHUNK_HDR + 12, (uint8_t*)&mfhdSeq, 4, cryptPtr) || __builtin_bswap32(mfhdSeq) != nextSeq++) break;
+      moofPos = boxPos;
+    }
+    if (!memcmp(boxHdr + 1, "mdat", 4) && moofPos) {
+      // first traf in moof is video, with trun after tfhd and tfdt
+      size_t trunPos = moofPos + CHUNK_HDR + 16 + CHUNK_HDR + 16 + 20;
+      if (readMp4(df, trunPos, trunHdr, sizeof(trunHdr), cryptPtr) && !memcmp(trunHdr + 4, "trun", 4))
+        frameCnt += (trunHdr[12] << 24) | (trunHdr[13] << 16) | (trunHdr[14] << 8) | trunHdr[15];
+      validLen = boxPos + boxLen;
+      moofPos = 0;
+    }
+    boxPos += boxLen;
+  }
+  if (cryptPtr != NULL) freeAviCrypt(crypt);
+  return validLen;
+}
@@ -174,6 +174,7 @@ static bool savePrefs(bool retain = true) {
   prefs.putString("ST_Pass", ST_Pass);
   prefs.putString("AP_Pass", AP_Pass); 
   prefs.putString("Auth_Pass", Auth_Pass); 
+  prefs.putString("Enc_Pass", Enc_Pass); 
 #ifdef INCLUDE_FTP          
   prefs.putString("FTP_Pass", FTP_Pass);
 #endif
@@ -201,6 +202,7 @@ static bool loadPrefs() {
   prefs.getString("ST_Pass", ST_Pass, MAX_PWD_LEN);
   prefs.getString("AP_Pass", AP_Pass, MAX_PWD_LEN);
   prefs.getString("Auth_Pass", Auth_Pass, MAX_PWD_LEN); 
+  prefs.getString("Enc_Pass", Enc_Pass, MAX_PWD_LEN); 
 #ifdef INCLUDE_FTP
   prefs.getString("FTP_Pass", FTP_Pass, MAX_PWD_LEN);
 #endif
@@ -235,6 +237,7 @@ void updateStatus(const char* variable, const char* _value) {
   else if(!strcmp(variable, "AP_gw")) strcpy(AP_gw, value);
   else if(!strcmp(variable, "AP_sn")) strcpy(AP_sn, value);
   else if(!strcmp(variable, "AP_Pass") && strchr(value, '*') == NULL) strcpy(AP_Pass, value); 
+  else if(!strcmp(variable, "Enc_Pass") && strchr(value, '*') == NULL) strcpy(Enc_Pass, value); 
   else if(!strcmp(variable, "allowAP")) allowAP = (bool)intVal;
   else if(!strcmp(variable, "allowSpaces")) allowSpaces = (bool)intVal;
 #ifdef INCLUDE_FTP
@@ -308,6 +311,7 @@ void buildJsonString(uint8_t filter) {
       p += sprintf(p, "\"ST_Pass\":\"%.*s\",", strlen(ST_Pass), FILLSTAR);
       p += sprintf(p, "\"AP_Pass\":\"%.*s\",", strlen(AP_Pass), FILLSTAR);
       p += sprintf(p, "\"Auth_Pass\":\"%.*s\",", strlen(Auth_Pass), FILLSTAR);
+      p += sprintf(p, "\"Enc_Pass\":\"%.*s\",", strlen(Enc_Pass), FILLSTAR);
   #ifdef INCLUDE_FTP 
       p += sprintf(p, "\"FTP_Pass\":\"%.*s\",", strlen(FTP_Pass), FILLSTAR);
   #endif
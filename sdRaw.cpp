@@ -0,0 +1,105 @@
+/*
+Direct sector access to contiguous files on the SD card, bypassing the file system,
+for raw sector recording into pool files.
+
+A file is allocated as a single extent with FatFs f_expand(), which is only
+available if FatFs is built with FF_USE_EXPAND. Its first sector is located from
+its start cluster, and verified by comparing that sector read direct from the card
+with the file content read via FatFs, before anything is written to it.
+The FatFs drive number of the SD card is assigned when mounted by SD_MMC,
+so it is found by opening the file on each drive.
+
+Only uses FatFs and File, so is also built and tested on a host, see test/host.
+
+s60sc 2022
+*/
+
+#include "appGlobals.h"
+#include "ff.h"
+#include "diskio_impl.h"
+
+#define RAW_SIG_LEN 16 // signature in first sector of new file
+static const char rawTag[] = "XTNT"; // as empty header of pooled recording, with zero extent
+static uint8_t fileSector[SECTOR_SIZE] __attribute__((aligned(4)));
+static uint8_t diskSector[SECTOR_SIZE] __attribute__((aligned(4))); // word aligned for SD DMA
+
+bool checkRawSectors(bool useRaw) {
+  // whether raw sector recording can be used when requested
+#if FF_USE_EXPAND
+  return useRaw;
+#else
+  if (useRaw) LOG_ERR("Raw sector recording unavailable, as FatFs built without FF_USE_EXPAND");
+  return false;
+#endif
+}
+
+static bool openRawFile(FIL& fil, const char* fileName, BYTE mode) {
+  // open SD_MMC file via FatFs, on the drive where it has the same size
+  File df = SD_MMC.open(fileName, FILE_READ);
+  if (!df) return false;
+  size_t fileLen = df.size();
+  df.close();
+  char ffName[FILE_NAME_LEN + 4];
+  for (int drv = 0; drv < FF_VOLUMES; drv++) {
+    snprintf(ffName, sizeof(ffName), "%d:%s", drv, fileName);
+    if (f_open(&fil, ffName, mode) != FR_OK) continue;
+    if (f_size(&fil) == fileLen) return true;
+    f_close(&fil);
+  }
+  LOG_ERR("Failed to open %s via FatFs", fileName);
+  return false;
+}
+
+bool createRawFile(const char* fileName, size_t fileLen) {
+  // allocate file as a single contiguous extent, with signature in first sector
+#if FF_USE_EXPAND
+  File df = SD_MMC.open(fileName, FILE_WRITE); // empty file to locate its drive
+  bool res = (bool)df;
+  df.close();
+  FIL fil;
+  if (!res || !openRawFile(fil, fileName, FA_WRITE)) {
+    SD_MMC.remove(fileName);
+    return false;
+  }
+  res = f_expand(&fil, (FSIZE_t)fileLen, 1) == FR_OK;
+  if (res) {
+    uint8_t rawSig[RAW_SIG_LEN] = {0};
+    memcpy(rawSig, rawTag, 4);
+    esp_fill_random(rawSig + 8, RAW_SIG_LEN - 8);
+    UINT written = 0;
+    res = f_write(&fil, rawSig, RAW_SIG_LEN, &written) == FR_OK && written == RAW_SIG_LEN;
+  }
+  f_close(&fil);
+  if (!res) SD_MMC.remove(fileName);
+  return res;
+#else
+  return false;
+#endif
+}
+
+uint32_t getRawExtent(const char* fileName, size_t& extentLen, uint8_t& drv) {
+  // locate first sector of contiguous file, so that it can be written without the file system,
+  // returns 0 if not contiguous or its sector could not be verified
+  FIL fil;
+  if (!openRawFile(fil, fileName, FA_READ)) return 0;
+  // cluster to sector as FatFs clst2sect(), as data area starts with cluster 2
+  FATFS* fs = fil.obj.fs;
+  LBA_t startSector = fil.obj.sclust >= 2 ? fs->database + (LBA_t)(fil.obj.sclust - 2) * fs->csize : 0;
+  extentLen = f_size(&fil);
+  drv = fs->pdrv;
+  UINT readLen = 0;
+  bool res = startSector && extentLen >= SECTOR_SIZE
+    && f_read(&fil, fileSector, SECTOR_SIZE, &readLen) == FR_OK && readLen == SECTOR_SIZE;
+  f_close(&fil);
+  if (!res) return 0;
+  if (ff_disk_read(drv, diskSector, startSector, 1) != RES_OK || memcmp(diskSector, fileSector, SECTOR_SIZE)) {
+    LOG_ERR("Sector %u does not hold start of %s, not recording to raw sectors", startSector, fileName);
+    return 0;
+  }
+  return startSector;
+}
+
+bool writeRawSectors(uint8_t drv, uint32_t sector, const uint8_t* data, size_t dataLen) {
+  // write whole sectors direct to card
+  return ff_disk_write(drv, data, sector, dataLen / SECTOR_SIZE) == RES_OK;
+}
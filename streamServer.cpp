@@ -12,18 +12,21 @@
 #define JPEG_BOUNDARY "\r\n--" BOUNDARY_VAL "\r\n"
 #define JPEG_TYPE "Content-Type: image/jpeg\r\nContent-Length: %10u\r\n\r\n"
 #define HDR_BUF_LEN 64
+#define MAX_THUMB (32 * 1024) // max size of avi thumbnail
 static const size_t boundaryLen = strlen(JPEG_BOUNDARY);
 static char hdrBuf[HDR_BUF_LEN];
 static fs::FS fpv = STORAGE;
 
 static httpd_handle_t streamServer = NULL; // streamer listens on port 81
+static uint8_t frameStart[JPEG_TABLES_MAX]; // start of frame held while checking for stripped tables
 
 esp_err_t webAppSpecificHandler(httpd_req_t *req, const char* variable, const char* value) {
   // update handling specific to mjpeg2sd
   if (!strcmp(variable, "sfile")) {
     // get folders / files on SD, save received filename if has required extension
     strcpy(inFileName, value);
-    if (!forceRecord) doPlayback = listDir(inFileName, jsonBuff, JSON_BUFF_LEN, FILE_EXT); // browser control
+    // MP4 recordings are listed for download, but not played back
+    if (!forceRecord) doPlayback = listDir(inFileName, jsonBuff, JSON_BUFF_LEN, FILE_EXT, MP4_EXT); // browser control
     else strcpy(jsonBuff, "{}");                      
     httpd_resp_set_type(req, "application/json");
     httpd_resp_send(req, jsonBuff, HTTPD_RESP_USE_STRLEN);
@@ -39,6 +42,35 @@ esp_err_t webAppSpecificHandler(httpd_req_t *req, const char* variable, const ch
   return ESP_OK;
 }
 
+static esp_err_t thumbHandler(httpd_req_t* req, const char* aviName) {
+  // send first thumbnail in given avi file, only reads start of file
+  size_t thumbLen = 0;
+  uint8_t* thumbBuf = (uint8_t*)ps_malloc(MAX_THUMB);
+  File df = fpv.open(aviName);
+  if (df && thumbBuf != NULL) thumbLen = getAviThumb(df, thumbBuf, MAX_THUMB);
+  df.close();
+  esp_err_t res;
+  if (thumbLen) {
+    httpd_resp_set_type(req, "image/jpeg");
+    httpd_resp_set_hdr(req, "Content-Disposition", "inline; filename=thumb.jpg");
+    res = httpd_resp_send(req, (const char*)thumbBuf, thumbLen);
+  } else {
+    LOG_WRN("No thumbnail in %s", aviName);
+    httpd_resp_set_status(req, HTTPD_400);
+    res = httpd_resp_send(req, "No thumbnail available", HTTPD_RESP_USE_STRLEN);
+  }
+  free(thumbBuf);
+  return res;
+}
+
+static esp_err_t sendFrameHdr(httpd_req_t* req, size_t jpegSize) {
+  // send mjpeg header for next frame
+  esp_err_t res = httpd_resp_send_chunk(req, JPEG_BOUNDARY, boundaryLen);
+  size_t hdrLen = snprintf(hdrBuf, HDR_BUF_LEN-1, JPEG_TYPE, jpegSize);
+  if (res == ESP_OK) res = httpd_resp_send_chunk(req, hdrBuf, hdrLen);
+  return res;
+}
+
 static esp_err_t streamHandler(httpd_req_t* req) {
   // send mjpeg stream or single frame
   esp_err_t res = ESP_OK;
@@ -57,6 +89,7 @@ static esp_err_t streamHandler(httpd_req_t* req) {
   strcpy(value, variable + strlen(variable) + 1); // value is now second part of string
   httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
 
+  if (!strcmp(variable, "thumb")) return thumbHandler(req, value);
   if (!strcmp(variable, "random")) singleFrame = true;
   if (!strcmp(variable, "source") && !strcmp(value, "file")) {
     if (fpv.exists(inFileName)) {
@@ -74,6 +107,12 @@ static esp_err_t streamHandler(httpd_req_t* req) {
   if (doPlayback) {
     // playback mjpeg from SD
     openSDfile(inFileName);
+    // Huffman tables to reinsert in frames stored without them, located from start of frame
+    uint8_t* tablesPtr;
+    size_t tablesPos;
+    size_t tablesLen = getJpegTables(&tablesPtr, tablesPos);
+    if (tablesPos + 2 > sizeof(frameStart)) tablesLen = 0;
+    size_t startLen = 0, startNeed = 0, jpegSize = 0;
     mjpegData = getNextFrame(true);
     while (doPlayback) {
       jpgLen = mjpegData.buffLen;
@@ -84,15 +123,37 @@ static esp_err_t streamHandler(httpd_req_t* req) {
         doPlayback = false; 
       } else {
         if (jpgLen) {
+          const uint8_t* sendPtr = iSDbuffer + buffOffset;
           if (mjpegData.jpegSize) { // start of frame
-            // send mjpeg header 
-            res = httpd_resp_send_chunk(req, JPEG_BOUNDARY, boundaryLen);
-            size_t hdrLen = snprintf(hdrBuf, HDR_BUF_LEN-1, JPEG_TYPE, mjpegData.jpegSize);
-            res = httpd_resp_send_chunk(req, hdrBuf, hdrLen);   
             frameCnt++;
+            if (tablesLen) {
+              // hold start of frame until known whether tables are present
+              startNeed = min(tablesPos + 2, mjpegData.jpegSize);
+              startLen = 0;
+              jpegSize = mjpegData.jpegSize;
+            } else res = sendFrameHdr(req, mjpegData.jpegSize);
           } 
+          if (startNeed) {
+            size_t copyLen = min(startNeed - startLen, jpgLen);
+            memcpy(frameStart + startLen, sendPtr, copyLen);
+            startLen += copyLen;
+            sendPtr += copyLen;
+            jpgLen -= copyLen;
+            if (startLen == startNeed) {
+              // frame stripped if DHT marker not at tables position
+              bool isStripped = startLen == tablesPos + 2 
+                && !(frameStart[tablesPos] == 0xFF && frameStart[tablesPos+1] == 0xC4);
+              res = sendFrameHdr(req, jpegSize + (isStripped ? tablesLen : 0));
+              if (isStripped) {
+                res = httpd_resp_send_chunk(req, (const char*)frameStart, tablesPos);
+                res = httpd_resp_send_chunk(req, (const char*)tablesPtr, tablesLen);
+                res = httpd_resp_send_chunk(req, (const char*)frameStart+tablesPos, 2);
+              } else res = httpd_resp_send_chunk(req, (const char*)frameStart, startLen);
+              startNeed = 0;
+            }
+          }
           // send buffer 
-          res = httpd_resp_send_chunk(req, (const char*)iSDbuffer+buffOffset, jpgLen);
+          if (jpgLen) res = httpd_resp_send_chunk(req, (const char*)sendPtr, jpgLen);
         }
         mjpegData = getNextFrame(); 
       }
@@ -0,0 +1,560 @@
+// Host (Linux) test of AVI generation in avi.cpp, without a device or camera
+// - records synthetic JPEG streams through the same calls as mjpeg2sd.cpp
+// - checks each AVI against structural rules, as a player such as ffprobe would parse it
+// - merges consecutive recordings with aviEdit.cpp and checks the merged AVI
+// - trims a recording with capture times by its time range and checks the trimmed AVI
+// - records direct to the sectors of a contiguous file with sdRaw.cpp, which must give the same AVI
+// - records encrypted AVIs, which must decrypt to a valid AVI
+// - compares each AVI against its golden size and checksum in golden/avi.txt
+// - benchmarks the per frame index build, the index finalization, and AES-CTR encryption
+//
+// usage: aviTest check | golden | bench
+//
+// s60sc 2020, 2022
+
+#include "appGlobals.h"
+#include <chrono>
+#include <map>
+#include <sys/stat.h>
+
+// app settings referenced by avi.cpp, set per scenario
+int thumbSecs = 0;
+int segmentMins = 0;
+bool useOpenDML = false;
+bool alignFrames = false;
+bool compactJpeg = false;
+bool useMotion = false;
+const uint32_t SAMPLE_RATE = 16000;
+bool statsInName = false;
+bool isCapturing = false;
+bool timeLapseOn = false;
+bool tlIndexBusy = false;
+int tlPlaybackFPS = 1;
+SemaphoreHandle_t aviMutex = NULL;
+
+#define GOLDEN_FILE "golden/avi.txt"
+#define RECORD_START 1700000000 // 20231114_221320 UTC
+
+struct scenarioStruct {
+  const char* name;
+  uint8_t frameType; // index to frameSize[]
+  uint8_t FPS;
+  uint16_t secs;
+  size_t jpegLen; // average synthetic jpeg length, varied by up to 1/8
+  bool withAudio; // 16 bit mono PCM chunk interleaved before each frame
+  bool isTL; // timelapse index and header
+  bool withTimes; // capture time chunk before each frame, with 2 sec gap half way
+};
+
+static const scenarioStruct scenarios[] = {
+  {"vga20", 8, 20, 10, 30000, false, false},
+  {"vga20aud", 8, 20, 10, 30000, true, false},
+  {"uxga5", 13, 5, 20, 150000, false, false},
+  {"qvgaTL", 5, 1, 100, 10000, false, true},
+};
+
+// width, height, indexed by frame type as in avi.cpp
+static const uint16_t frameSize[][2] = {
+  {96, 96}, {160, 120}, {176, 144}, {240, 176}, {240, 240}, {320, 240}, {400, 296},
+  {480, 320}, {640, 480}, {800, 600}, {1024, 768}, {1280, 720}, {1280, 1024}, {1600, 1200}
+};
+
+static uint32_t testFailures = 0;
+static uint8_t ioBuf[RAMSIZE];
+
+#define CHECK(cond, format, ...) if (!(cond)) { \
+  testFailures++; \
+  fprintf(stderr, "FAIL %s: " format "\n", aviName, ##__VA_ARGS__); \
+  return false; }
+
+/************** synthetic content ***************/
+
+static uint32_t randState;
+
+static uint32_t nextRand() {
+  // deterministic LCG, so that output matches golden files
+  randState = randState * 1664525 + 1013904223;
+  return randState >> 8;
+}
+
+static size_t putMarker(uint8_t* buf, uint8_t marker, uint16_t segLen) {
+  buf[0] = 0xFF;
+  buf[1] = marker;
+  buf[2] = segLen >> 8;
+  buf[3] = segLen & 0xFF;
+  return 4;
+}
+
+static size_t genJpeg(uint8_t* jpeg, size_t avgLen, uint16_t width, uint16_t height) {
+  // jpeg with the marker segments of a camera frame, but entropy data is random so not decodable
+  size_t targetLen = avgLen - avgLen / 8 + nextRand() % (avgLen / 4);
+  size_t pos = 0;
+  jpeg[pos++] = 0xFF;
+  jpeg[pos++] = 0xD8; // SOI
+  pos += putMarker(jpeg + pos, 0xDB, 67); // DQT
+  jpeg[pos++] = 0;
+  for (int i = 0; i < 64; i++) jpeg[pos++] = 1 + i / 4;
+  pos += putMarker(jpeg + pos, 0xC0, 17); // SOF0
+  const uint8_t sof[] = {8, (uint8_t)(height >> 8), (uint8_t)height, (uint8_t)(width >> 8), (uint8_t)width,
+    3, 1, 0x21, 0, 2, 0x11, 1, 3, 0x11, 1};
+  memcpy(jpeg + pos, sof, sizeof(sof));
+  pos += sizeof(sof);
+  pos += putMarker(jpeg + pos, 0xC4, 418); // DHT, same length as camera tables
+  for (int i = 0; i < 416; i++) jpeg[pos++] = i & 0x7F; // same for every frame
+  pos += putMarker(jpeg + pos, 0xDA, 12); // SOS
+  const uint8_t sos[] = {3, 1, 0, 2, 0x11, 3, 0x11, 0, 0x3F, 0};
+  memcpy(jpeg + pos, sos, sizeof(sos));
+  pos += sizeof(sos);
+  while (pos < targetLen - 2) {
+    // byte stuffed entropy data
+    uint8_t b = nextRand() & 0xFF;
+    jpeg[pos++] = b;
+    if (b == 0xFF) jpeg[pos++] = 0;
+  }
+  jpeg[pos++] = 0xFF;
+  jpeg[pos++] = 0xD9; // EOI
+  return pos;
+}
+
+/************** recording ***************/
+
+// recording file written in RAMSIZE blocks as by mjpeg2sd.cpp, direct to its sectors if raw,
+// and encrypted as copied if isCrypt
+static File aviFile;
+static uint8_t outBuf[RAMSIZE];
+static size_t outLen, outPos; // content of outBuf, and its file position
+static uint32_t rawSector;
+static uint8_t rawDrv;
+static size_t rawLen, rawPos;
+static bool isCrypt, isCryptTL;
+
+static void outWrite(const uint8_t* data, size_t dataLen) {
+  while (dataLen) {
+    size_t copyLen = std::min(dataLen, (size_t)RAMSIZE - outLen);
+    memcpy(outBuf + outLen, data, copyLen);
+    if (isCrypt) encryptAvi(outBuf + outLen, copyLen, outPos + outLen, isCryptTL);
+    outLen += copyLen;
+    data += copyLen;
+    dataLen -= copyLen;
+    if (outLen < RAMSIZE) break;
+    if (rawSector && rawPos + RAMSIZE <= rawLen && writeRawSectors(rawDrv, rawSector + rawPos / SECTOR_SIZE, outBuf, RAMSIZE)) 
+      rawPos += RAMSIZE;
+    else {
+      if (rawSector) aviFile.seek(rawPos, SeekSet);
+      rawSector = 0;
+      aviFile.write(outBuf, RAMSIZE);
+    }
+    outLen = 0;
+    outPos += RAMSIZE;
+  }
+}
+
+static size_t writeChunk(const uint8_t* chunkId, const uint8_t* data, size_t dataLen) {
+  // chunk header and content, filled to DWORD boundary, returns padded content length
+  static const uint8_t filler[4] = {0, 0, 0, 0};
+  uint32_t chunkSize = (dataLen + 3) & ~3;
+  outWrite(chunkId, 4);
+  outWrite((uint8_t*)&chunkSize, 4);
+  outWrite(data, dataLen);
+  outWrite(filler, chunkSize - dataLen);
+  return chunkSize;
+}
+
+static uint32_t recordAvi(const char* aviName, const scenarioStruct& sc, time_t startTime, bool isRaw = false, bool withCrypt = false) {
+  // record synthetic stream in same order of calls as mjpeg2sd.cpp, returns number of frames
+  // if isRaw, aviName is contiguous file to be written direct to its sectors
+  // if withCrypt, encrypted with Enc_Pass
+  static uint8_t jpeg[300 * 1024];
+  static uint8_t pcm[SAMPLE_RATE * 2];
+  randState = 1;
+  uint32_t frameCnt = sc.FPS * sc.secs;
+  size_t pcmLen = SAMPLE_RATE * 2 / sc.FPS;
+  prepAviIndex(sc.isTL);
+  uint8_t* hdrPtr;
+  size_t hdrLen = getAviHdr(&hdrPtr, sc.isTL);
+  aviFile = SD_MMC.open(aviName, isRaw ? "r+" : FILE_WRITE);
+  rawPos = outLen = outPos = 0;
+  rawSector = isRaw ? getRawExtent(aviName, rawLen, rawDrv) : 0;
+  isCrypt = false;
+  memset(ioBuf, 0, hdrLen);
+  outWrite(ioBuf, hdrLen); // placeholder for header
+  if (withCrypt) {
+    // as openAvi() and timeLapse()
+    uint8_t* cryptPtr;
+    size_t cryptChunkLen = startAviCrypt(&cryptPtr, hdrLen, sc.isTL);
+    outWrite(cryptPtr, cryptChunkLen);
+    isCrypt = cryptChunkLen > 0;
+    isCryptTL = sc.isTL;
+  }
+  for (uint32_t i = 0; i < frameCnt; i++) {
+    if (sc.withTimes) {
+      uint8_t* timePtr;
+      int64_t capUs = (int64_t)i * 1000000 / sc.FPS + (i >= frameCnt / 2 ? 2000000 : 0);
+      outWrite(timePtr, getTimeChunk(&timePtr, i, capUs));
+    }
+    if (sc.withAudio) {
+      for (size_t j = 0; j < pcmLen; j++) pcm[j] = nextRand() & 0xFF;
+      buildAviIdx(writeChunk(wbBuf, pcm, pcmLen), false);
+    }
+    size_t jpegLen = genJpeg(jpeg, sc.jpegLen, frameSize[sc.frameType][0], frameSize[sc.frameType][1]);
+    buildAviIdx(writeChunk(dcBuf, jpeg, jpegLen), true, sc.isTL);
+  }
+  // file system used to complete recording, from end of raw content
+  if (rawSector) aviFile.seek(rawPos, SeekSet);
+  rawSector = 0;
+  aviFile.write(outBuf, outLen);
+  isCrypt = false;
+  size_t idxLen;
+  if (sc.isTL) {
+    // as timeLapse()
+    buildAviHdr(sc.FPS, sc.frameType, frameCnt, true);
+    finalizeAviIndex(true);
+    while ((idxLen = writeAviIndex(ioBuf, RAMSIZE, true))) aviFile.write(ioBuf, idxLen);
+  } else {
+    // as handOverAvi() and finalizeAvi()
+    setAviMeta(startTime, sc.secs * 1000, 0, 0);
+    buildAviHdr(sc.FPS, sc.frameType, frameCnt);
+    segmentAviIndex();
+    while ((idxLen = writeSegIndex(ioBuf, RAMSIZE))) aviFile.write(ioBuf, idxLen);
+  }
+  size_t aviLen = aviFile.position();
+  hdrLen = getAviHdr(&hdrPtr, sc.isTL);
+  aviFile.seek(0, SeekSet);
+  aviFile.write(hdrPtr, hdrLen);
+  aviFile.close();
+  if (isRaw) truncate((hostRoot + aviName).c_str(), aviLen); // release unused clusters
+  return frameCnt;
+}
+
+/************** checks ***************/
+
+static uint32_t crc32(const uint8_t* data, size_t len) {
+  // as esp_rom_crc32_le() from 0
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (int k = 0; k < 8; k++) crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+  }
+  return ~crc;
+}
+
+static uint32_t get32(const std::vector<uint8_t>& avi, size_t pos) {
+  uint32_t val;
+  memcpy(&val, avi.data() + pos, 4);
+  return val;
+}
+
+static bool isId(const std::vector<uint8_t>& avi, size_t pos, const char* id) {
+  return !memcmp(avi.data() + pos, id, 4);
+}
+
+static bool checkAvi(const char* aviName, const scenarioStruct& sc, uint32_t frameCnt, const std::vector<uint8_t>& avi) {
+  // structure as parsed by a player, with index entries matching movi chunks
+  size_t aviLen = avi.size();
+  CHECK(aviLen > AVI_HEADER_LEN, "file too short, %zu bytes", aviLen);
+  CHECK(isId(avi, 0, "RIFF") && isId(avi, 8, "AVI "), "no RIFF AVI header");
+  CHECK(get32(avi, 4) == aviLen - 8, "RIFF size %u, expected %zu", get32(avi, 4), aviLen - 8);
+  CHECK(isId(avi, 12, "LIST") && isId(avi, 20, "hdrl") && isId(avi, 24, "avih"), "no hdrl list");
+  uint32_t usecs = (uint32_t)round(1000000.0f / sc.FPS);
+  CHECK(get32(avi, 0x20) == usecs, "avih %u usecs per frame, expected %u", get32(avi, 0x20), usecs);
+  CHECK(get32(avi, 0x30) == frameCnt, "avih %u total frames, expected %u", get32(avi, 0x30), frameCnt);
+  uint32_t streams = sc.withAudio && !sc.isTL ? 2 : 1;
+  CHECK(get32(avi, 0x38) == streams, "avih %u streams, expected %u", get32(avi, 0x38), streams);
+  CHECK(get32(avi, 0x40) == frameSize[sc.frameType][0] && get32(avi, 0x44) == frameSize[sc.frameType][1],
+    "avih frame size %ux%u", get32(avi, 0x40), get32(avi, 0x44));
+  CHECK(isId(avi, 0x64, "strh") && isId(avi, 0x6C, "vids") && isId(avi, 0x70, "MJPG"), "no MJPG video stream header");
+  CHECK(get32(avi, 0x84) == sc.FPS && get32(avi, 0x8C) == frameCnt, "strh rate %u length %u", get32(avi, 0x84), get32(avi, 0x8C));
+  // top level lists following hdrl
+  size_t pos = 20 + get32(avi, 16);
+  size_t moviStart = 0, moviEnd = 0;
+  while (pos + 12 <= aviLen && !moviStart) {
+    CHECK(isId(avi, pos, "LIST"), "expected LIST at %zu", pos);
+    if (isId(avi, pos + 8, "movi")) {
+      moviStart = pos + 12;
+      moviEnd = pos + 8 + get32(avi, pos + 4);
+    } else pos += 8 + get32(avi, pos + 4);
+  }
+  CHECK(moviStart, "no movi list");
+  CHECK(moviEnd + 8 <= aviLen && isId(avi, moviEnd, "idx1"), "no idx1 after movi list ending at %zu", moviEnd);
+  size_t idxLen = get32(avi, moviEnd + 4);
+  CHECK(moviEnd + 8 + idxLen == aviLen, "idx1 of %zu bytes does not end at file end", idxLen);
+  // movi chunks, keyed by offset from start of movi data
+  std::map<size_t, size_t> chunks;
+  uint32_t vidChunks = 0, audChunks = 0;
+  for (pos = moviStart; pos < moviEnd; ) {
+    size_t chunkSize = get32(avi, pos + 4);
+    CHECK(pos + 8 + chunkSize <= moviEnd, "chunk at %zu of %zu bytes overruns movi list", pos, chunkSize);
+    if (isId(avi, pos, "00dc")) {
+      const uint8_t* jpeg = avi.data() + pos + 8;
+      size_t eoi = chunkSize;
+      while (eoi > chunkSize - 4 && jpeg[eoi - 1] == 0) eoi--;
+      CHECK(jpeg[0] == 0xFF && jpeg[1] == 0xD8 && jpeg[eoi - 2] == 0xFF && jpeg[eoi - 1] == 0xD9, "frame at %zu not a jpeg", pos);
+      vidChunks++;
+    } else if (isId(avi, pos, "01wb")) audChunks++;
+    else CHECK(isId(avi, pos, "JUNK"), "unexpected chunk at %zu", pos);
+    if (!isId(avi, pos, "JUNK")) chunks[pos - moviStart] = chunkSize;
+    pos += 8 + chunkSize;
+  }
+  CHECK(vidChunks == frameCnt, "%u video chunks, expected %u", vidChunks, frameCnt);
+  CHECK(!sc.withAudio || audChunks == frameCnt, "%u audio chunks, expected %u", audChunks, frameCnt);
+  // every index entry locates a movi chunk of the same type and size, in file order
+  CHECK(idxLen == chunks.size() * 16, "idx1 has %zu entries for %zu chunks", idxLen / 16, chunks.size());
+  size_t prevOffset = 0;
+  for (size_t i = 0; i < idxLen / 16; i++) {
+    size_t entry = moviEnd + 8 + i * 16;
+    size_t offset = get32(avi, entry + 8);
+    CHECK(!i || offset > prevOffset, "idx1 entry %zu out of order", i);
+    CHECK(chunks.count(offset) && chunks[offset] == get32(avi, entry + 12), "idx1 entry %zu does not match chunk", i);
+    CHECK(!memcmp(avi.data() + entry, avi.data() + moviStart + offset, 4), "idx1 entry %zu has wrong chunk id", i);
+    prevOffset = offset;
+  }
+  return true;
+}
+
+static std::vector<uint8_t> loadFile(const char* aviName) {
+  std::vector<uint8_t> avi;
+  File df = SD_MMC.open(aviName, FILE_READ);
+  avi.resize(df.size());
+  df.read(avi.data(), avi.size());
+  df.close();
+  return avi;
+}
+
+static std::map<std::string, std::string> golden; // size and crc of each test avi
+
+static void loadGolden() {
+  char line[128], name[32], result[64];
+  FILE* gf = fopen(GOLDEN_FILE, "r");
+  while (gf != NULL && fgets(line, sizeof(line), gf) != NULL) {
+    if (line[0] != '#' && sscanf(line, "%31s %63[^\n]", name, result) == 2) golden[name] = result;
+  }
+  if (gf != NULL) fclose(gf);
+}
+
+static void saveGolden() {
+  if (testFailures) return;
+  FILE* gf = fopen(GOLDEN_FILE, "w");
+  fprintf(gf, "# test, avi size, crc32, regenerate with: make golden\n");
+  for (auto& g : golden) fprintf(gf, "%s %s\n", g.first.c_str(), g.second.c_str());
+  fclose(gf);
+  printf("Updated %s\n", GOLDEN_FILE);
+}
+
+static void checkResult(const char* testName, const char* aviName, const scenarioStruct& sc, uint32_t frameCnt, 
+  uint32_t errors, bool makeGolden) {
+  // check avi structure, then compare with or update its golden size and crc
+  char result[64];
+  std::vector<uint8_t> avi = loadFile(aviName);
+  if (hostErrors != errors) {
+    testFailures++;
+    fprintf(stderr, "FAIL %s: errors logged\n", aviName);
+  }
+  if (!checkAvi(aviName, sc, frameCnt, avi)) return;
+  snprintf(result, sizeof(result), "%zu %08x", avi.size(), crc32(avi.data(), avi.size()));
+  if (makeGolden) golden[testName] = result;
+  else if (golden[testName] != result) {
+    testFailures++;
+    fprintf(stderr, "FAIL %s: size and crc %s, golden %s\n", aviName, result, golden[testName].c_str());
+  } else printf("PASS %s: %u frames, %s\n", aviName, frameCnt, result);
+}
+
+static void runScenarios(bool makeGolden) {
+  // record and check each scenario
+  for (auto& sc : scenarios) {
+    char aviName[FILE_NAME_LEN];
+    snprintf(aviName, sizeof(aviName), "/%s.avi", sc.name);
+    uint32_t errors = hostErrors;
+    uint32_t frameCnt = recordAvi(aviName, sc, RECORD_START);
+    checkResult(sc.name, aviName, sc, frameCnt, errors, makeGolden);
+  }
+}
+
+static void mergeTest(bool makeGolden) {
+  // merge first three consecutive recordings in day folder with aviEdit.cpp, but not fourth which follows a gap
+  const scenarioStruct sc = {"merge", 5, 10, 5, 8000, true, false};
+  const char* dayFolder = "/20231114";
+  const char* mergedName = "/20231114/20231114_221320_QVGA_S.avi"; // named from first recording
+  std::vector<std::string> recordings;
+  File root = SD_MMC.open(dayFolder);
+  for (File file = root.openNextFile(); file; file = root.openNextFile()) recordings.push_back(file.path());
+  root.close();
+  for (auto& recording : recordings) SD_MMC.remove(recording.c_str());
+  SD_MMC.mkdir(dayFolder);
+  uint32_t errors = hostErrors;
+  time_t startTime[] = {RECORD_START, RECORD_START + 5, RECORD_START + 11, RECORD_START + 60};
+  for (auto recStart : startTime) {
+    char aviName[FILE_NAME_LEN];
+    strftime(aviName, sizeof(aviName), "/%Y%m%d/%Y%m%d_%H%M%S_QVGA_S.avi", gmtime(&recStart));
+    recordAvi(aviName, sc, recStart);
+  }
+  mergeGapSecs = 2;
+  mergeRecordings(dayFolder); // host runs edit task to completion
+  size_t fileCnt = 0;
+  root = SD_MMC.open(dayFolder);
+  for (File file = root.openNextFile(); file; file = root.openNextFile()) fileCnt++;
+  root.close();
+  if (fileCnt != 2) {
+    testFailures++;
+    fprintf(stderr, "FAIL %s: %zu files after merge, expected 2\n", mergedName, fileCnt);
+  } else checkResult(sc.name, mergedName, sc, 3 * sc.FPS * sc.secs, errors, makeGolden);
+}
+static void trimTest(bool makeGolden) {
+  // trim recording by capture time, which differs from frame rate time after gap half way
+  const scenarioStruct sc = {"trim", 5, 10, 10, 8000, true, false, true};
+  const char* srcName = "/20231115/20231115_221320_QVGA_S.avi";
+  const char* trimName = "/20231115/20231115_221326_QVGA_S.avi"; // named from start of range
+  time_t recStart = RECORD_START + 86400;
+  SD_MMC.remove(srcName);
+  SD_MMC.remove(trimName);
+  SD_MMC.mkdir("/20231115");
+  uint32_t errors = hostErrors;
+  recordAvi(srcName, sc, recStart);
+  // frames 50 to 69 captured from 7 to 8.9 secs, whereas 60 to 89 by frame rate
+  trimRecording("/20231115/20231115_221320_QVGA_S.avi&from=6&to=9");
+  uint32_t frameCnt = 20;
+  std::vector<uint8_t> avi = loadFile(trimName);
+  const uint8_t timeHdr[] = {'J', 'U', 'N', 'K', TIME_CHUNK_LEN - CHUNK_HDR, 0, 0, 0, 'F', 'T', 'I', 'M'};
+  uint32_t timeCnt = 0;
+  for (size_t pos = 0; pos + sizeof(timeHdr) <= avi.size(); pos++)
+    if (!memcmp(avi.data() + pos, timeHdr, sizeof(timeHdr))) timeCnt++;
+  if (timeCnt != frameCnt) {
+    testFailures++;
+    fprintf(stderr, "FAIL %s: %u capture times, expected %u\n", trimName, timeCnt, frameCnt);
+  } else checkResult(sc.name, trimName, sc, frameCnt, errors, makeGolden);
+}
+
+static void rawTest(bool makeGolden) {
+  // record to sectors of contiguous file via FatFs block device stand-in, must give same avi as via file system
+  const scenarioStruct& sc = scenarios[0];
+  const char* aviName = "/raw.avi";
+  size_t extentLen;
+  uint8_t drv;
+  uint32_t errors = hostErrors;
+  if (getRawExtent("/vga20.avi", extentLen, drv)) {
+    testFailures++;
+    fprintf(stderr, "FAIL %s: file not allocated as one extent used for raw sectors\n", aviName);
+  }
+  if (!createRawFile(aviName, 16 * ONEMEG)) {
+    testFailures++;
+    fprintf(stderr, "FAIL %s: contiguous file not created\n", aviName);
+    return;
+  }
+  uint32_t frameCnt = recordAvi(aviName, sc, RECORD_START, true);
+  if (rawPos < sc.FPS * sc.secs * sc.jpegLen / 2) {
+    testFailures++;
+    fprintf(stderr, "FAIL %s: only %zu bytes written direct to sectors\n", aviName, rawPos);
+  }
+  checkResult(sc.name, aviName, sc, frameCnt, errors, makeGolden);
+}
+
+static void cryptTest(bool makeGolden) {
+  // record encrypted motion and time lapse avis, which must decrypt to valid avis,
+  // golden result is of decrypted avi with its random salt and nonce cleared, 
+  // as output by extras/decryptRecording.py
+  strcpy(Enc_Pass, "host test passphrase");
+  prepAviCrypt();
+  for (auto& sc : {scenarios[0], scenarios[3]}) {
+    char aviName[FILE_NAME_LEN];
+    char decName[FILE_NAME_LEN];
+    char testName[32];
+    snprintf(aviName, sizeof(aviName), "/%senc.avi", sc.name);
+    snprintf(decName, sizeof(decName), "/%sdec.avi", sc.name);
+    snprintf(testName, sizeof(testName), "%senc", sc.name);
+    uint32_t errors = hostErrors;
+    uint32_t frameCnt = recordAvi(aviName, sc, RECORD_START, false, true);
+    aviCryptStruct crypt;
+    File df = SD_MMC.open(aviName, FILE_READ);
+    bool isEnc = getAviCrypt(df, crypt);
+    df.close();
+    std::vector<uint8_t> avi = loadFile(aviName);
+    size_t frameTags = 0;
+    for (size_t pos = crypt.cryptStart; isEnc && pos + 4 <= std::min(avi.size(), crypt.cryptEnd); pos += 4) 
+      frameTags += isId(avi, pos, "00dc");
+    if (!isEnc || frameTags) {
+      testFailures++;
+      fprintf(stderr, "FAIL %s: %s\n", aviName, isEnc ? "frames stored in plaintext" : "not encrypted");
+      continue;
+    }
+    cryptAvi(crypt, avi.data(), avi.size(), 0);
+    freeAviCrypt(crypt);
+    memset(avi.data() + crypt.cryptStart - 24, 0, 24); // salt and nonce ending JENC chunk
+    df = SD_MMC.open(decName, FILE_WRITE);
+    df.write(avi.data(), avi.size());
+    df.close();
+    checkResult(testName, decName, sc, frameCnt, errors, makeGolden);
+  }
+  *Enc_Pass = 0;
+}
+
+/************** benchmarks ***************/
+
+static double elapsedNs(std::chrono::steady_clock::time_point startTime) {
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+static void benchIndex(uint32_t entries, bool isTL) {
+  // per frame index entry, including page appends to index file, then finalization of index
+  prepAviIndex(isTL);
+  auto startTime = std::chrono::steady_clock::now();
+  for (uint32_t i = 0; i < entries; i++) buildAviIdx(30000 + (i & 0xFFC), true, isTL);
+  double buildNs = elapsedNs(startTime);
+  buildAviHdr(20, 8, entries, isTL);
+  File idxOut = SD_MMC.open("/bench.idx", FILE_WRITE);
+  size_t idxLen, idxTotal = 0;
+  startTime = std::chrono::steady_clock::now();
+  if (isTL) {
+    finalizeAviIndex(true);
+    while ((idxLen = writeAviIndex(ioBuf, RAMSIZE, true))) idxTotal += idxOut.write(ioBuf, idxLen);
+  } else {
+    segmentAviIndex();
+    while ((idxLen = writeSegIndex(ioBuf, RAMSIZE))) idxTotal += idxOut.write(ioBuf, idxLen);
+  }
+  idxOut.close();
+  double finalNs = elapsedNs(startTime);
+  SD_MMC.remove("/bench.idx");
+  printf("%s index: buildAviIdx %.1f ns per call over %u calls, finalization %.1f MB/s for %zu kB\n",
+    isTL ? "Timelapse" : "Recording", buildNs / entries, entries, (idxTotal / (double)ONEMEG) / (finalNs / 1e9), idxTotal / 1024);
+}
+
+static void benchCrypt(size_t totalLen) {
+  // AES-CTR encryption of buffered content, as by bufferWrite() in mjpeg2sd.cpp
+  strcpy(Enc_Pass, "host test passphrase");
+  prepAviCrypt();
+  uint8_t* cryptPtr;
+  prepAviIndex();
+  startAviCrypt(&cryptPtr, AVI_HEADER_LEN);
+  memset(ioBuf, 0x5A, RAMSIZE);
+  auto startTime = std::chrono::steady_clock::now();
+  for (size_t done = 0; done < totalLen; done += RAMSIZE) encryptAvi(ioBuf, RAMSIZE, SECTOR_SIZE + done);
+  double cryptNs = elapsedNs(startTime);
+  printf("Encryption: AES-256-CTR %.1f MB/s for %zu MB\n", (totalLen / (double)ONEMEG) / (cryptNs / 1e9), totalLen / ONEMEG);
+  *Enc_Pass = 0;
+}
+
+int main(int argc, char** argv) {
+  const char* cmd = argc > 1 ? argv[1] : "check";
+  mkdir(hostRoot.c_str(), 0755);
+  setenv("TZ", "UTC", 1); // for names of edited recordings
+  tzset();
+  if (!strcmp(cmd, "check") || !strcmp(cmd, "golden")) {
+    bool makeGolden = !strcmp(cmd, "golden");
+    loadGolden();
+    runScenarios(makeGolden);
+    mergeTest(makeGolden);
+    trimTest(makeGolden);
+    rawTest(makeGolden);
+    cryptTest(makeGolden);
+    if (makeGolden) saveGolden();
+  }
+  else if (!strcmp(cmd, "bench")) {
+    // 20 fps for 12 hours
+    benchIndex(20 * 3600 * 12, false);
+    benchIndex(20 * 3600 * 12, true);
+    benchCrypt(64 * ONEMEG);
+  } else {
+    fprintf(stderr, "usage: aviTest check | golden | bench\n");
+    return 2;
+  }
+  if (testFailures) fprintf(stderr, "%u failures\n", testFailures);
+  return testFailures ? 1 : 0;
+}
@@ -0,0 +1,167 @@
+// Host (Linux) test of the capture governor policy in governor.cpp
+// - drives govDecide() with synthetic load samples for overload, lost frames and recovery
+// - checks each decision against the policy rules, eg jpeg quality lowered before frame rate,
+//   frame rate restored before jpeg quality, and limits of frame size policy and user settings
+// - compares each trace against its golden trace in golden/gov.txt
+// - replays load samples recorded on device, from log lines "Governor sample busy x%, ring y%, lost z"
+//
+// usage: govTest check | golden | replay <frameType> <fps> <quality> < log
+//
+// s60sc 2020, 2022
+
+#include "governor.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#define GOLDEN_FILE "golden/gov.txt"
+
+struct sampleRun {
+  uint16_t windows; // number of windows with this sample
+  govSample sample;
+};
+
+struct scenarioStruct {
+  const char* name;
+  uint8_t frameType; // index to policy table
+  uint8_t userFPS;
+  uint8_t userQuality;
+  std::vector<sampleRun> runs;
+};
+
+static const scenarioStruct scenarios[] = {
+  // writer saturated, then recovers
+  {"vga20Overload", 8, 20, 12, {{3, {40, 0, 0}}, {20, {95, 60, 0}}, {50, {30, 0, 0}}}},
+  // frames lost with writer apparently idle, as during an SD stall
+  {"vga20Lost", 8, 20, 12, {{2, {30, 0, 0}}, {4, {20, 5, 6}}, {30, {20, 0, 0}}}},
+  // load on the threshold between pressure and headroom, no change expected
+  {"svga25Steady", 9, 25, 10, {{30, {70, 30, 0}}}},
+  // user settings already beyond policy limits
+  {"uxgaUser", 13, 1, 40, {{10, {100, 90, 2}}, {20, {10, 0, 0}}}},
+  // intermittent pressure, calm windows reset
+  {"qvgaBursty", 5, 30, 10, {{4, {90, 0, 0}}, {3, {20, 0, 0}}, {1, {85, 0, 0}}, {4, {20, 0, 0}},
+    {1, {20, 55, 0}}, {30, {20, 0, 0}}}},
+};
+
+static uint32_t testFailures = 0;
+
+#define CHECK(cond, format, ...) if (!(cond)) { \
+  testFailures++; \
+  fprintf(stderr, "FAIL %s window %u: " format "\n", name, window, ##__VA_ARGS__); }
+
+static std::string traceLine(uint32_t window, const govSample& sample, const govState& gs, bool changed) {
+  char line[80];
+  snprintf(line, sizeof(line), "%4u busy %3u%% ring %3u%% lost %2u -> fps %2u quality %2u%s\n", 
+    window, sample.loadPct, sample.ringPct, sample.lost, gs.fps, gs.quality, changed ? " *" : "");
+  return line;
+}
+
+static void checkDecision(const char* name, uint32_t window, const govSample& sample, const govState& prev, 
+  const govState& gs, bool changed, const govPolicy& policy) {
+  // check decision against policy rules
+  int minFPS = std::min(policy.minFPS, gs.userFPS);
+  int maxQuality = std::max(policy.maxQuality, gs.userQuality);
+  CHECK(gs.fps >= minFPS && gs.fps <= gs.userFPS, "fps %u outside %u to %u", gs.fps, minFPS, gs.userFPS);
+  CHECK(gs.quality >= gs.userQuality && gs.quality <= maxQuality, "quality %u outside %u to %u", 
+    gs.quality, gs.userQuality, maxQuality);
+  CHECK(changed == (gs.fps != prev.fps || gs.quality != prev.quality), "change not reported");
+  CHECK(gs.fps == prev.fps || gs.quality == prev.quality, "fps and quality changed together");
+  if (!changed) return;
+  CHECK(!prev.settle || sample.lost, "changed while settling");
+  // lower jpeg quality before frame rate, restore frame rate before jpeg quality
+  if (gs.fps < prev.fps) CHECK(prev.quality == maxQuality, "fps reduced before quality %u", prev.quality);
+  if (gs.quality < prev.quality) CHECK(prev.fps == gs.userFPS, "quality restored before fps %u", prev.fps);
+}
+
+static std::string runTrace(const char* name, uint8_t frameType, uint8_t userFPS, uint8_t userQuality,
+  const std::vector<govSample>& samples) {
+  // decide each window in turn from its sample, as govern() in mjpeg2sd.cpp
+  const govPolicy& policy = getGovPolicy(frameType);
+  govState gs = {userFPS, userQuality, userFPS, userQuality, 0, 0};
+  std::string trace;
+  uint32_t window = 0;
+  for (auto& sample : samples) {
+    govState prev = gs;
+    bool changed = govDecide(gs, sample, policy);
+    checkDecision(name, window, sample, prev, gs, changed, policy);
+    trace += traceLine(window++, sample, gs, changed);
+  }
+  return trace;
+}
+
+/************** golden traces ***************/
+
+static std::map<std::string, std::string> golden; // trace of each scenario
+
+static void loadGolden() {
+  // each trace preceded by line "# <scenario>"
+  char line[128];
+  std::string name;
+  FILE* gf = fopen(GOLDEN_FILE, "r");
+  while (gf != NULL && fgets(line, sizeof(line), gf) != NULL) {
+    if (line[0] == '#') {
+      line[strcspn(line, "\r\n")] = 0;
+      name = line + 2;
+    } else if (!name.empty()) golden[name] += line;
+  }
+  if (gf != NULL) fclose(gf);
+}
+
+static void saveGolden() {
+  if (testFailures) return;
+  FILE* gf = fopen(GOLDEN_FILE, "w");
+  for (auto& g : golden) fprintf(gf, "# %s\n%s", g.first.c_str(), g.second.c_str());
+  fclose(gf);
+  printf("Updated %s\n", GOLDEN_FILE);
+}
+
+static void runScenarios(bool makeGolden) {
+  for (auto& sc : scenarios) {
+    std::vector<govSample> samples;
+    for (auto& run : sc.runs) samples.insert(samples.end(), run.windows, run.sample);
+    uint32_t failures = testFailures;
+    std::string trace = runTrace(sc.name, sc.frameType, sc.userFPS, sc.userQuality, samples);
+    if (makeGolden) golden[sc.name] = trace;
+    else if (golden[sc.name] != trace) {
+      testFailures++;
+      fprintf(stderr, "FAIL %s: trace differs from golden:\n%s", sc.name, trace.c_str());
+    } else if (testFailures == failures) printf("PASS %s: %zu windows\n", sc.name, samples.size());
+  }
+}
+
+/************** replay ***************/
+
+static int replay(uint8_t frameType, uint8_t userFPS, uint8_t userQuality) {
+  // trace decisions for samples logged by govern() on device
+  char line[256];
+  unsigned busy, ring, lost;
+  std::vector<govSample> samples;
+  while (fgets(line, sizeof(line), stdin) != NULL) {
+    const char* p = strstr(line, "Governor sample ");
+    if (p != NULL && sscanf(p, "Governor sample busy %u%%, ring %u%%, lost %u", &busy, &ring, &lost) == 3)
+      samples.push_back({(uint8_t)busy, (uint8_t)ring, lost});
+  }
+  printf("%s", runTrace("replay", frameType, userFPS, userQuality, samples).c_str());
+  return testFailures ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+  const char* cmd = argc > 1 ? argv[1] : "check";
+  if (!strcmp(cmd, "check") || !strcmp(cmd, "golden")) {
+    bool makeGolden = !strcmp(cmd, "golden");
+    loadGolden();
+    runScenarios(makeGolden);
+    if (makeGolden) saveGolden();
+  } else if (!strcmp(cmd, "replay") && argc == 5) {
+    return replay(atoi(argv[2]), atoi(argv[3]), atoi(argv[4]));
+  } else {
+    fprintf(stderr, "usage: govTest check | golden | replay <frameType> <fps> <quality> < log\n");
+    return 2;
+  }
+  if (testFailures) fprintf(stderr, "%u failures\n", testFailures);
+  return testFailures ? 1 : 0;
+}
@@ -0,0 +1,204 @@
+// Host (Linux) implementation of the Arduino and ESP-IDF functions used by avi.cpp and aviEdit.cpp,
+// with SD_MMC backed by a local folder
+//
+// s60sc 2020, 2022
+
+#include "hostCore.h"
+#include <chrono>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+std::string hostRoot = "out";
+uint32_t hostErrors = 0;
+fs::SDMMCFS SD_MMC;
+fs::LittleFSFS LittleFS;
+
+struct hostFile {
+  FILE* fp = NULL;
+  DIR* dir = NULL;
+  std::string path; // as given to open
+  ~hostFile() {
+    if (fp != NULL) fclose(fp);
+    if (dir != NULL) closedir(dir);
+  }
+};
+
+static std::string localPath(const char* path) {
+  return hostRoot + (path[0] == '/' ? "" : "/") + path;
+}
+
+/************** time, memory, tasks ***************/
+
+static const auto hostStart = std::chrono::steady_clock::now();
+
+int64_t esp_timer_get_time() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - hostStart).count();
+}
+
+unsigned long micros() { return (unsigned long)esp_timer_get_time(); }
+unsigned long millis() { return (unsigned long)(esp_timer_get_time() / 1000); }
+void delay(uint32_t ms) { usleep(ms * 1000); }
+void* ps_malloc(size_t size) { return malloc(size); }
+bool psramFound() { return true; }
+
+void esp_fill_random(void* buf, size_t len) {
+  for (size_t i = 0; i < len; i++) ((uint8_t*)buf)[i] = rand() & 0xFF;
+}
+
+// single threaded, so mutexes always available
+SemaphoreHandle_t xSemaphoreCreateMutex() { return (SemaphoreHandle_t)&hostStart; }
+BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t) { return pdTRUE; }
+BaseType_t xSemaphoreGive(SemaphoreHandle_t) { return pdTRUE; }
+
+BaseType_t xTaskCreate(TaskFunction_t pvTaskCode, const char*, uint32_t, void* pvParameters, UBaseType_t, TaskHandle_t*) {
+  // task runs to completion before returning
+  pvTaskCode(pvParameters);
+  return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t) {}
+
+/************** logging ***************/
+
+const char* esp_log_system_timestamp() {
+  static char ts[16];
+  snprintf(ts, sizeof(ts), "%lu", millis());
+  return ts;
+}
+
+const char* pathToFileName(const char* path) {
+  const char* fileName = strrchr(path, '/');
+  return fileName == NULL ? path : fileName + 1;
+}
+
+void logPrint(const char *fmtStr, ...) {
+  // errors counted so that tests fail on them
+  if (strstr(fmtStr, " ERROR @ ") != NULL) hostErrors++;
+  va_list arglist;
+  va_start(arglist, fmtStr);
+  vfprintf(stderr, fmtStr, arglist);
+  va_end(arglist);
+}
+
+/************** File ***************/
+
+File::operator bool() const {
+  return hf && (hf->fp != NULL || hf->dir != NULL);
+}
+
+size_t File::write(const uint8_t* buf, size_t len) {
+  return *this && hf->fp != NULL ? fwrite(buf, 1, len, hf->fp) : 0;
+}
+
+size_t File::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t File::read(uint8_t* buf, size_t len) {
+  return *this && hf->fp != NULL ? fread(buf, 1, len, hf->fp) : 0;
+}
+
+int File::read() {
+  uint8_t c;
+  return read(&c, 1) ? c : -1;
+}
+
+bool File::seek(uint32_t pos, SeekMode mode) {
+  if (!*this || hf->fp == NULL) return false;
+  int whence = mode == SeekSet ? SEEK_SET : (mode == SeekCur ? SEEK_CUR : SEEK_END);
+  return fseek(hf->fp, pos, whence) == 0;
+}
+
+size_t File::position() {
+  return *this && hf->fp != NULL ? ftell(hf->fp) : 0;
+}
+
+size_t File::size() {
+  if (!*this || hf->fp == NULL) return 0;
+  fflush(hf->fp);
+  struct stat st;
+  return fstat(fileno(hf->fp), &st) == 0 ? st.st_size : 0;
+}
+
+int File::available() {
+  return size() - position();
+}
+
+void File::close() {
+  // as for arduino, closes file for all copies of this handle
+  if (hf) {
+    if (hf->fp != NULL) fclose(hf->fp);
+    if (hf->dir != NULL) closedir(hf->dir);
+    hf->fp = NULL;
+    hf->dir = NULL;
+  }
+  hf.reset();
+}
+
+void File::flush() {
+  if (*this && hf->fp != NULL) fflush(hf->fp);
+}
+
+const char* File::name() {
+  return hf ? pathToFileName(hf->path.c_str()) : "";
+}
+
+const char* File::path() {
+  return hf ? hf->path.c_str() : "";
+}
+
+bool File::isDirectory() {
+  return hf && hf->dir != NULL;
+}
+
+File File::openNextFile() {
+  if (!isDirectory()) return File();
+  struct dirent* entry;
+  while ((entry = readdir(hf->dir)) != NULL) {
+    if (strcmp(entry->d_name, ".") && strcmp(entry->d_name, ".."))
+      return SD_MMC.open((hf->path + "/" + entry->d_name).c_str(), FILE_READ);
+  }
+  return File();
+}
+
+time_t File::getLastWrite() {
+  struct stat st;
+  return hf && stat(localPath(hf->path.c_str()).c_str(), &st) == 0 ? st.st_mtime : 0;
+}
+
+/************** SD_MMC ***************/
+
+File fs::FS::open(const char* path, const char* mode, bool create) {
+  auto hf = std::make_shared<hostFile>();
+  hf->path = path;
+  std::string lpath = localPath(path);
+  struct stat st;
+  if (stat(lpath.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) hf->dir = opendir(lpath.c_str());
+  else {
+    std::string fmode = std::string(mode) + "b";
+    if (!strcmp(mode, "r+")) fmode = "r+b";
+    hf->fp = fopen(lpath.c_str(), fmode.c_str());
+  }
+  return File(hf);
+}
+
+bool fs::FS::exists(const char* path) {
+  return access(localPath(path).c_str(), F_OK) == 0;
+}
+
+bool fs::FS::remove(const char* path) {
+  return ::remove(localPath(path).c_str()) == 0;
+}
+
+bool fs::FS::rename(const char* pathFrom, const char* pathTo) {
+  return ::rename(localPath(pathFrom).c_str(), localPath(pathTo).c_str()) == 0;
+}
+
+bool fs::FS::mkdir(const char* path) {
+  return ::mkdir(localPath(path).c_str(), 0755) == 0;
+}
+
+bool fs::FS::rmdir(const char* path) {
+  return ::rmdir(localPath(path).c_str()) == 0;
+}
@@ -0,0 +1,74 @@
+// Host (Linux) implementation of the mbedtls functions used by avi.cpp, using OpenSSL
+//
+// s60sc 2020, 2022
+
+#include "mbedtls/aes.h"
+#include "mbedtls/pkcs5.h"
+#include <string.h>
+#include <openssl/evp.h>
+
+static const mbedtls_md_info_t sha256Info = {MBEDTLS_MD_SHA256};
+
+void mbedtls_aes_init(mbedtls_aes_context* ctx) {
+  ctx->evpCtx = NULL;
+}
+
+int mbedtls_aes_setkey_enc(mbedtls_aes_context* ctx, const unsigned char* key, unsigned int keybits) {
+  // ECB block encryption only, as used to generate CTR keystream
+  if (keybits != 256) return -1;
+  if (ctx->evpCtx == NULL) ctx->evpCtx = EVP_CIPHER_CTX_new();
+  EVP_CIPHER_CTX* evp = (EVP_CIPHER_CTX*)ctx->evpCtx;
+  if (!EVP_EncryptInit_ex(evp, EVP_aes_256_ecb(), NULL, key, NULL)) return -1;
+  EVP_CIPHER_CTX_set_padding(evp, 0);
+  return 0;
+}
+
+int mbedtls_aes_crypt_ecb(mbedtls_aes_context* ctx, int mode, const unsigned char input[16], unsigned char output[16]) {
+  int outLen = 0;
+  if (ctx->evpCtx == NULL || mode != MBEDTLS_AES_ENCRYPT) return -1;
+  return EVP_EncryptUpdate((EVP_CIPHER_CTX*)ctx->evpCtx, output, &outLen, input, 16) ? 0 : -1;
+}
+
+int mbedtls_aes_crypt_ctr(mbedtls_aes_context* ctx, size_t length, size_t* nc_off, unsigned char nonce_counter[16],
+  unsigned char stream_block[16], const unsigned char* input, unsigned char* output) {
+  // same semantics as mbedtls, counter incremented as 128 bit big endian value
+  size_t n = *nc_off;
+  for (size_t i = 0; i < length; i++) {
+    if (!n) {
+      if (mbedtls_aes_crypt_ecb(ctx, MBEDTLS_AES_ENCRYPT, nonce_counter, stream_block)) return -1;
+      for (int j = 15; j >= 0 && !++nonce_counter[j]; j--);
+    }
+    output[i] = input[i] ^ stream_block[n];
+    n = (n + 1) & 0x0F;
+  }
+  *nc_off = n;
+  return 0;
+}
+
+void mbedtls_aes_free(mbedtls_aes_context* ctx) {
+  if (ctx->evpCtx != NULL) EVP_CIPHER_CTX_free((EVP_CIPHER_CTX*)ctx->evpCtx);
+  ctx->evpCtx = NULL;
+}
+
+const mbedtls_md_info_t* mbedtls_md_info_from_type(mbedtls_md_type_t md_type) {
+  return md_type == MBEDTLS_MD_SHA256 ? &sha256Info : NULL;
+}
+
+void mbedtls_md_init(mbedtls_md_context_t* ctx) {
+  ctx->info = NULL;
+}
+
+void mbedtls_md_free(mbedtls_md_context_t* ctx) {
+  ctx->info = NULL;
+}
+
+int mbedtls_md_setup(mbedtls_md_context_t* ctx, const mbedtls_md_info_t* md_info, int hmac) {
+  ctx->info = md_info;
+  return md_info == NULL ? -1 : 0;
+}
+
+int mbedtls_pkcs5_pbkdf2_hmac(mbedtls_md_context_t* ctx, const unsigned char* password, size_t plen,
+  const unsigned char* salt, size_t slen, unsigned int iteration_count, uint32_t key_length, unsigned char* output) {
+  if (ctx->info == NULL) return -1;
+  return PKCS5_PBKDF2_HMAC((const char*)password, plen, salt, slen, iteration_count, EVP_sha256(), key_length, output) ? 0 : -1;
+}
@@ -0,0 +1,105 @@
+// Host (Linux) stand-in for FatFs and its SD card block device, as used by sdRaw.cpp.
+// Files are those of SD_MMC in hostRoot. The card is FatFs drive 1, so that drive lookup is exercised.
+// Each file allocated by f_expand() is given a contiguous range of clusters in a virtual data area,
+// and sector reads and writes within that range are made to the file, so that content written
+// direct to sectors reads back via File. Sector access outside an allocated file is an error,
+// as on a card it would corrupt other content.
+//
+// s60sc 2020, 2022
+
+#include "hostCore.h"
+#include "diskio_impl.h"
+#include <map>
+#include <sys/stat.h>
+
+#define HOST_DRV 1 // FatFs logical drive of SD card
+#define HOST_PDRV 0 // physical drive of SD card
+#define HOST_CSIZE 64 // sectors per cluster
+#define HOST_DATABASE 8192 // first sector of data area
+#define HOST_SECTOR 512
+
+static FATFS hostFs = {HOST_PDRV, HOST_CSIZE, HOST_DATABASE};
+
+struct hostExtent {
+  DWORD sclust; // first cluster
+  DWORD clusters;
+  int fd; // kept open so that extent follows file when renamed
+};
+static std::map<ino_t, hostExtent> extents; // allocated files, by inode
+static DWORD nextCluster = 2;
+
+FRESULT f_open(FIL* fp, const char* path, BYTE mode) {
+  // path is "<drive>:<SD_MMC path>"
+  if (path[0] - '0' != HOST_DRV || path[1] != ':') return FR_INVALID_DRIVE;
+  std::string hostPath = hostRoot + (path + 2);
+  const char* fmode = (mode & FA_CREATE_ALWAYS) ? "w+b" : ((mode & FA_WRITE) ? "r+b" : "rb");
+  FILE* hostFp = fopen(hostPath.c_str(), fmode);
+  if (hostFp == NULL) return FR_NO_FILE;
+  struct stat st;
+  fstat(fileno(hostFp), &st);
+  fp->hostFp = hostFp;
+  fp->obj.fs = &hostFs;
+  fp->obj.objsize = st.st_size;
+  fp->obj.sclust = extents.count(st.st_ino) ? extents[st.st_ino].sclust : 0;
+  return FR_OK;
+}
+
+FRESULT f_close(FIL* fp) {
+  if (fp->hostFp != NULL) fclose((FILE*)fp->hostFp);
+  fp->hostFp = NULL;
+  return FR_OK;
+}
+
+FRESULT f_read(FIL* fp, void* buff, UINT btr, UINT* br) {
+  *br = fread(buff, 1, btr, (FILE*)fp->hostFp);
+  return FR_OK;
+}
+
+FRESULT f_write(FIL* fp, const void* buff, UINT btw, UINT* bw) {
+  *bw = fwrite(buff, 1, btw, (FILE*)fp->hostFp);
+  return *bw == btw ? FR_OK : FR_DISK_ERR;
+}
+
+FRESULT f_expand(FIL* fp, FSIZE_t fsz, BYTE opt) {
+  // as FatFs, only for empty file, allocating next free clusters
+  FILE* hostFp = (FILE*)fp->hostFp;
+  if (!fsz || fp->obj.objsize || !opt) return FR_DENIED;
+  if (ftruncate(fileno(hostFp), fsz)) return FR_DISK_ERR;
+  struct stat st;
+  fstat(fileno(hostFp), &st);
+  DWORD clusters = (fsz + HOST_CSIZE * HOST_SECTOR - 1) / (HOST_CSIZE * HOST_SECTOR);
+  extents[st.st_ino] = {nextCluster, clusters, dup(fileno(hostFp))};
+  fp->obj.sclust = nextCluster;
+  fp->obj.objsize = fsz;
+  nextCluster += clusters;
+  return FR_OK;
+}
+
+static const hostExtent* findExtent(BYTE pdrv, LBA_t sector, UINT count, off_t& offset) {
+  // allocated file holding sectors, with offset of first sector in file
+  for (auto& ext : extents) {
+    LBA_t firstSector = HOST_DATABASE + (ext.second.sclust - 2) * HOST_CSIZE;
+    LBA_t endSector = firstSector + ext.second.clusters * HOST_CSIZE;
+    if (pdrv == HOST_PDRV && sector >= firstSector && sector + count <= endSector) {
+      offset = (off_t)(sector - firstSector) * HOST_SECTOR;
+      return &ext.second;
+    }
+  }
+  hostErrors++;
+  fprintf(stderr, "Sector access %u to %u is outside any allocated file\n", sector, sector + count - 1);
+  return NULL;
+}
+
+DRESULT ff_disk_read(BYTE pdrv, BYTE* buff, LBA_t sector, UINT count) {
+  off_t offset;
+  const hostExtent* ext = findExtent(pdrv, sector, count, offset);
+  if (ext == NULL) return RES_PARERR;
+  return pread(ext->fd, buff, count * HOST_SECTOR, offset) == count * HOST_SECTOR ? RES_OK : RES_ERROR;
+}
+
+DRESULT ff_disk_write(BYTE pdrv, const BYTE* buff, LBA_t sector, UINT count) {
+  off_t offset;
+  const hostExtent* ext = findExtent(pdrv, sector, count, offset);
+  if (ext == NULL) return RES_PARERR;
+  return pwrite(ext->fd, buff, count * HOST_SECTOR, offset) == count * HOST_SECTOR ? RES_OK : RES_ERROR;
+}
@@ -0,0 +1,9 @@
+// Host stand-in for FatFs disk access, implemented in hostFatfs.cpp
+
+#pragma once
+#include "ff.h"
+
+typedef enum { RES_OK = 0, RES_ERROR, RES_WRPRT, RES_NOTRDY, RES_PARERR } DRESULT;
+
+DRESULT ff_disk_read(BYTE pdrv, BYTE* buff, LBA_t sector, UINT count);
+DRESULT ff_disk_write(BYTE pdrv, const BYTE* buff, LBA_t sector, UINT count);
@@ -0,0 +1,35 @@
+// Host stand-in for FatFs, implemented in hostFatfs.cpp
+
+#pragma once
+#include <stdint.h>
+
+#define FF_USE_EXPAND 1
+#define FF_VOLUMES 2
+
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef unsigned int UINT;
+typedef DWORD LBA_t;
+typedef DWORD FSIZE_t;
+
+typedef enum {
+  FR_OK = 0, FR_DISK_ERR, FR_INT_ERR, FR_NOT_READY, FR_NO_FILE, FR_NO_PATH, FR_INVALID_NAME, 
+  FR_DENIED, FR_EXIST, FR_INVALID_OBJECT, FR_WRITE_PROTECTED, FR_INVALID_DRIVE, FR_NOT_ENABLED
+} FRESULT;
+
+typedef struct { BYTE pdrv; WORD csize; LBA_t database; } FATFS;
+typedef struct { FATFS* fs; DWORD sclust; FSIZE_t objsize; } FFOBJID;
+typedef struct { FFOBJID obj; void* hostFp; } FIL;
+
+#define FA_READ 0x01
+#define FA_WRITE 0x02
+#define FA_OPEN_EXISTING 0x00
+#define FA_CREATE_ALWAYS 0x08
+#define f_size(fp) ((fp)->obj.objsize)
+
+FRESULT f_open(FIL* fp, const char* path, BYTE mode);
+FRESULT f_close(FIL* fp);
+FRESULT f_read(FIL* fp, void* buff, UINT btr, UINT* br);
+FRESULT f_write(FIL* fp, const void* buff, UINT btw, UINT* bw);
+FRESULT f_expand(FIL* fp, FSIZE_t fsz, BYTE opt);
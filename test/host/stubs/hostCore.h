@@ -0,0 +1,191 @@
+// Host (Linux) stand-ins for the Arduino and ESP-IDF declarations used by the app,
+// so that its byte handling code can be built and tested without a device.
+// Only what is defined in hostCore.cpp can be linked, the rest just lets headers compile.
+//
+// s60sc 2020, 2022
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <math.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/time.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <functional>
+#include <sstream>
+#include <regex>
+#include <memory>
+#include <unistd.h>
+using std::min; using std::max;
+#define timezone app_timezone
+typedef uint8_t byte;
+typedef bool boolean;
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define portMAX_DELAY 0xffffffff
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(x) (x)
+#define portYIELD_FROM_ISR()
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define OUTPUT 1
+#define INPUT 0
+#define INPUT_PULLUP 2
+#define HIGH 1
+#define LOW 0
+#define constrain(a,b,c) ((a)<(b)?(b):((a)>(c)?(c):(a)))
+#define MALLOC_CAP_INTERNAL 1
+#define MALLOC_CAP_DMA 2
+#define MALLOC_CAP_SPIRAM 4
+#define MALLOC_CAP_8BIT 8
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+#define CARD_NONE 0
+#define CARD_MMC 1
+#define CARD_SD 2
+#define CARD_SDHC 3
+#define HTTPD_400 "400"
+#define HTTPD_RESP_USE_STRLEN -1
+#define HTTPD_SOCK_ERR_TIMEOUT -3
+#define HTTP_GET 1
+#define HTTP_POST 2
+#define UPDATE_SIZE_UNKNOWN 0
+#define U_SPIFFS 100
+#define U_FLASH 0
+#define FRAMESIZE_UXGA 13
+#define FRAMESIZE_SVGA 9
+typedef int esp_err_t;
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef void* TaskHandle_t;
+typedef void* SemaphoreHandle_t;
+typedef void* QueueHandle_t;
+typedef void* httpd_handle_t;
+typedef void (*TaskFunction_t)(void*);
+unsigned long millis(); unsigned long micros(); void delay(uint32_t); int64_t esp_timer_get_time();
+void* ps_malloc(size_t); void* heap_caps_malloc(size_t, uint32_t); void heap_caps_free(void*);
+size_t heap_caps_get_largest_free_block(uint32_t); void heap_caps_malloc_extmem_enable(size_t);
+bool psramFound(); void pinMode(int,int); void digitalWrite(int,int); int digitalRead(int);
+const char* esp_log_system_timestamp(); const char* pathToFileName(const char*);
+void log_print_buf(const uint8_t*, size_t); const char* esp_err_to_name(esp_err_t);
+BaseType_t xTaskCreate(TaskFunction_t, const char*, uint32_t, void*, UBaseType_t, TaskHandle_t*);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t, const char*, uint32_t, void*, UBaseType_t, TaskHandle_t*, int);
+void vTaskDelete(TaskHandle_t); void vTaskDelay(TickType_t); uint32_t ulTaskNotifyTake(BaseType_t, TickType_t);
+void xTaskNotifyGive(TaskHandle_t); void vTaskNotifyGiveFromISR(TaskHandle_t, BaseType_t*);
+SemaphoreHandle_t xSemaphoreCreateBinary(); SemaphoreHandle_t xSemaphoreCreateMutex(); SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t, UBaseType_t);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t, TickType_t); BaseType_t xSemaphoreGive(SemaphoreHandle_t);
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t, BaseType_t*);
+QueueHandle_t xQueueCreate(UBaseType_t, UBaseType_t); BaseType_t xQueueReceive(QueueHandle_t, void*, TickType_t);
+BaseType_t xQueueSend(QueueHandle_t, const void*, TickType_t); UBaseType_t uxQueueMessagesWaiting(QueueHandle_t);
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t);
+struct hw_timer_t; hw_timer_t* timerBegin(int, int, bool); void timerAlarmDisable(hw_timer_t*); void timerDetachInterrupt(hw_timer_t*);
+void timerEnd(hw_timer_t*); void timerAlarmWrite(hw_timer_t*, uint64_t, bool); void timerAlarmEnable(hw_timer_t*); void timerAttachInterrupt(hw_timer_t*, void(*)(), bool);
+class String { public: String(const char* s = ""); String(int); const char* c_str() const; size_t length() const; };
+String operator+(const String&, const char*);
+struct SerialC { void print(const char*); void println(const char* s = ""); void flush(); void setDebugOutput(bool); };
+extern SerialC Serial;
+struct EspC { uint32_t getFreeHeap(); uint32_t getFreePsram(); void restart(); uint64_t getEfuseMac(); uint32_t getSketchSize(); };
+extern EspC ESP;
+
+// File and SD_MMC backed by a local folder, see hostRoot
+enum SeekMode { SeekSet, SeekCur, SeekEnd };
+struct hostFile;
+class File { 
+ public: 
+  File() {}
+  File(std::shared_ptr<hostFile> p) : hf(p) {}
+  operator bool() const; 
+  size_t write(const uint8_t* buf, size_t len); 
+  size_t write(uint8_t c); 
+  size_t read(uint8_t* buf, size_t len); 
+  int read();
+  bool seek(uint32_t pos, SeekMode mode = SeekSet); 
+  size_t position(); 
+  size_t size(); 
+  void close(); 
+  void flush(); 
+  const char* name(); 
+  const char* path();
+  bool isDirectory(); 
+  File openNextFile(); 
+  time_t getLastWrite(); 
+  String readStringUntil(char); 
+  int available(); 
+ private:
+  std::shared_ptr<hostFile> hf;
+};
+namespace fs { 
+  class FS { 
+   public: 
+    File open(const char* path, const char* mode = FILE_READ, bool create = false); 
+    File open(const String& path, const char* mode = FILE_READ);
+    bool exists(const char* path); 
+    bool remove(const char* path); 
+    bool rename(const char* pathFrom, const char* pathTo); 
+    bool mkdir(const char* path); 
+    bool rmdir(const char* path); 
+  };
+  class SDMMCFS : public FS { public: bool begin(const char*, bool, bool); uint8_t cardType(); uint64_t cardSize(); uint64_t totalBytes(); uint64_t usedBytes(); void end(); void setPins(int,int,int); };
+  class LittleFSFS : public FS { public: bool begin(bool); uint64_t totalBytes(); uint64_t usedBytes(); void end(); }; 
+}
+extern fs::SDMMCFS SD_MMC; extern fs::LittleFSFS LittleFS;
+extern std::string hostRoot; // local folder standing in for SD card root
+extern uint32_t hostErrors; // count of LOG_ERR messages
+#define _LITTLEFS_H_
+struct httpd_req_t { size_t content_len; int method; };
+typedef struct { bool final; int type; uint8_t* payload; size_t len; } httpd_ws_frame_t;
+esp_err_t httpd_resp_send(httpd_req_t*, const char*, int); esp_err_t httpd_resp_send_chunk(httpd_req_t*, const char*, int);
+esp_err_t httpd_resp_set_type(httpd_req_t*, const char*); esp_err_t httpd_resp_set_hdr(httpd_req_t*, const char*, const char*);
+esp_err_t httpd_resp_set_status(httpd_req_t*, const char*); size_t httpd_req_get_url_query_len(httpd_req_t*);
+esp_err_t httpd_req_get_url_query_str(httpd_req_t*, char*, size_t);
+typedef struct { uint8_t* buf; size_t len; size_t width; size_t height; int format; struct timeval timestamp; } camera_fb_t;
+typedef enum { PIXFORMAT_JPEG, PIXFORMAT_GRAYSCALE } pixformat_t;
+typedef int framesize_t; typedef int gainceiling_t;
+struct sensor_t; struct camera_status_t { int framesize; int quality; };
+struct sensor_id_t { int PID; };
+struct sensor_t { camera_status_t status; sensor_id_t id; int (*set_framesize)(sensor_t*, int); int (*set_quality)(sensor_t*, int); int (*set_contrast)(sensor_t*, int); int (*set_brightness)(sensor_t*, int); int (*set_saturation)(sensor_t*, int); int (*set_gainceiling)(sensor_t*, int); int (*set_colorbar)(sensor_t*, int); int (*set_whitebal)(sensor_t*, int); int (*set_gain_ctrl)(sensor_t*, int); int (*set_exposure_ctrl)(sensor_t*, int); int (*set_hmirror)(sensor_t*, int); int (*set_vflip)(sensor_t*, int); int (*set_awb_gain)(sensor_t*, int); int (*set_agc_gain)(sensor_t*, int); int (*set_aec_value)(sensor_t*, int); int (*set_aec2)(sensor_t*, int); int (*set_dcw)(sensor_t*, int); int (*set_bpc)(sensor_t*, int); int (*set_wpc)(sensor_t*, int); int (*set_raw_gma)(sensor_t*, int); int (*set_lenc)(sensor_t*, int); int (*set_special_effect)(sensor_t*, int); int (*set_wb_mode)(sensor_t*, int); int (*set_ae_level)(sensor_t*, int); };
+camera_fb_t* esp_camera_fb_get(); void esp_camera_fb_return(camera_fb_t*); sensor_t* esp_camera_sensor_get(); int esp_camera_deinit();
+bool fmt2jpg(uint8_t*, size_t, uint16_t, uint16_t, pixformat_t, uint8_t, uint8_t**, size_t*);
+typedef int jpg_scale_t;
+typedef uint32_t (*jpg_reader_cb)(void*, size_t, uint8_t*, size_t);
+typedef bool (*jpg_writer_cb)(void*, uint16_t, uint16_t, uint16_t, uint16_t, uint8_t*);
+esp_err_t esp_jpg_decode(size_t, jpg_scale_t, jpg_reader_cb, jpg_writer_cb, void*);
+typedef int i2s_port_t; typedef int i2s_mode_t;
+#define I2S_NUM_1 1
+#define I2S_MODE_MASTER 1
+#define I2S_MODE_RX 2
+#define I2S_BITS_PER_SAMPLE_32BIT 32
+#define I2S_CHANNEL_FMT_ONLY_LEFT 1
+#define I2S_COMM_FORMAT_STAND_I2S 1
+#define ESP_INTR_FLAG_LEVEL1 1
+#define I2S_EVENT_RX_DONE 1
+typedef struct { i2s_mode_t mode; uint32_t sample_rate; int bits_per_sample; int channel_format; int communication_format; int intr_alloc_flags; int dma_buf_count; int dma_buf_len; bool use_apll; bool tx_desc_auto_clear; int fixed_mclk; } i2s_config_t;
+typedef struct { int bck_io_num; int ws_io_num; int data_out_num; int data_in_num; } i2s_pin_config_t;
+typedef struct { int type; size_t size; } i2s_event_t;
+esp_err_t i2s_driver_install(int, const i2s_config_t*, int, QueueHandle_t*); esp_err_t i2s_set_pin(int, const i2s_pin_config_t*);
+esp_err_t i2s_zero_dma_buffer(int); esp_err_t i2s_stop(int); esp_err_t i2s_driver_uninstall(int); esp_err_t i2s_read(int, void*, size_t, size_t*, TickType_t);
+class WiFiClient { public: int connect(const char*, uint16_t); size_t write(const uint8_t*, size_t); void print(const char*); void println(const char* s = ""); int available(); int read(uint8_t*, size_t); int read(); void stop(); };
+class WiFiClientSecure : public WiFiClient { public: void setInsecure(); };
+#define OV2640_PID 0x26
+#define OV3660_PID 0x3660
+#define OV5640_PID 0x5640
+typedef struct { int stack_size; int max_open_sockets; int server_port; int ctrl_port; } httpd_config_t;
+#define HTTPD_DEFAULT_CONFIG() httpd_config_t{}
+typedef struct { const char* uri; int method; esp_err_t (*handler)(httpd_req_t*); void* user_ctx; bool is_websocket; } httpd_uri_t;
+esp_err_t httpd_start(httpd_handle_t*, httpd_config_t*); esp_err_t httpd_register_uri_handler(httpd_handle_t, httpd_uri_t*);
+struct WiFiC { int RSSI(); int status(); }; extern WiFiC WiFi;
+#define WL_CONNECTED 3
+uint32_t esp_random(); void esp_fill_random(void*, size_t);
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t);
@@ -0,0 +1,18 @@
+// Host stand-in for mbedtls AES, implemented with OpenSSL in hostCrypto.cpp
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+#define MBEDTLS_AES_ENCRYPT 1
+
+typedef struct { 
+  void* evpCtx; // OpenSSL cipher context for key
+} mbedtls_aes_context;
+
+void mbedtls_aes_init(mbedtls_aes_context* ctx);
+int mbedtls_aes_setkey_enc(mbedtls_aes_context* ctx, const unsigned char* key, unsigned int keybits);
+int mbedtls_aes_crypt_ecb(mbedtls_aes_context* ctx, int mode, const unsigned char input[16], unsigned char output[16]);
+int mbedtls_aes_crypt_ctr(mbedtls_aes_context* ctx, size_t length, size_t* nc_off, unsigned char nonce_counter[16], 
+  unsigned char stream_block[16], const unsigned char* input, unsigned char* output);
+void mbedtls_aes_free(mbedtls_aes_context* ctx);
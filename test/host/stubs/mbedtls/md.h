@@ -0,0 +1,13 @@
+// Host stand-in for mbedtls message digest, implemented with OpenSSL in hostCrypto.cpp
+
+#pragma once
+#include <stddef.h>
+
+typedef enum { MBEDTLS_MD_SHA256 = 6 } mbedtls_md_type_t;
+typedef struct { mbedtls_md_type_t type; } mbedtls_md_info_t;
+typedef struct { const mbedtls_md_info_t* info; } mbedtls_md_context_t;
+
+const mbedtls_md_info_t* mbedtls_md_info_from_type(mbedtls_md_type_t md_type);
+void mbedtls_md_init(mbedtls_md_context_t* ctx);
+void mbedtls_md_free(mbedtls_md_context_t* ctx);
+int mbedtls_md_setup(mbedtls_md_context_t* ctx, const mbedtls_md_info_t* md_info, int hmac);
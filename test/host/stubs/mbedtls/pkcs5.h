@@ -0,0 +1,8 @@
+// Host stand-in for mbedtls PBKDF2, implemented with OpenSSL in hostCrypto.cpp
+
+#pragma once
+#include <stdint.h>
+#include "mbedtls/md.h"
+
+int mbedtls_pkcs5_pbkdf2_hmac(mbedtls_md_context_t* ctx, const unsigned char* password, size_t plen, 
+  const unsigned char* salt, size_t slen, unsigned int iteration_count, uint32_t key_length, unsigned char* output);
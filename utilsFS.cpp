@@ -121,6 +121,7 @@ void getOldestDir(char* oldestDir) {
   if (file) strcpy(oldestDir, file.path()); // initialise oldestDir
   while (file) {
     if (file.isDirectory() && strstr(file.name(), "System") == NULL // ignore Sys Vol Info
+        && file.name()[0] != '.' // ignore hidden folders
         && strstr(DATA_DIR, file.name()) == NULL) { // ignore data folder
       if (strcmp(oldestDir, file.path()) > 0) {
       strcpy(oldestDir, file.path()); 
@@ -159,9 +160,11 @@ bool checkFreeSpace() {
   return false;
 } 
 
-bool listDir(const char* fname, char* jsonBuff, size_t jsonBuffLen, const char* extension) {
+bool listDir(const char* fname, char* jsonBuff, size_t jsonBuffLen, const char* extension, const char* altExtension) {
   // either list day folders in root, or files in a day folder
+  // files with altExtension are also listed, but are not selected as having required extension
   bool hasExtension = false;
+  bool hasAltExtension = false;
   char partJson[200]; // used to build SD page json buffer
   char partName[FILE_NAME_LEN];
   char fileName[FILE_NAME_LEN];
@@ -191,6 +194,10 @@ bool listDir(const char* fname, char* jsonBuff, size_t jsonBuffLen, const char*
     hasExtension = true;
     noEntries = true; 
     strcpy(jsonBuff, "{}");     
+  } else if (altExtension != NULL && strstr(fileName, altExtension) != NULL) {
+    // other listed file type selected
+    hasAltExtension = true;
+    strcpy(jsonBuff, "{}");
   } else {
     // ignore leading '/' if not the only character
     bool returnDirs = strlen(fileName) > 1 ? (strchr(fileName+1, '/') == NULL ? false : true) : true; 
@@ -202,11 +209,14 @@ bool listDir(const char* fname, char* jsonBuff, size_t jsonBuffLen, const char*
     
     // build relevant option list
     strcpy(jsonBuff, returnDirs ? "{" : "{\"/\":\".. [ Up ]\",");            
+    char* crcBuff = returnDirs ? NULL : loadChecksums(fileName);
+    char crcStr[9];
     File file = root.openNextFile();
     if (psramFound()) heap_caps_malloc_extmem_enable(5); // small number to force vector into psram
     while (file) {
       if (returnDirs && file.isDirectory() 
           && strstr(file.name(), "System") == NULL // ignore Sys Vol Info
+          && file.name()[0] != '.' // ignore hidden folders
           && strstr(DATA_DIR, file.name()) == NULL) { // ignore data folder
         // build folder list
         sprintf(partJson, "\"%s\":\"%s\",", file.path(), file.name());
@@ -215,18 +225,21 @@ bool listDir(const char* fname, char* jsonBuff, size_t jsonBuffLen, const char*
       }
       if (!returnDirs && !file.isDirectory()) {
         // build file list
-        if (strstr(file.name(), extension) != NULL) {
-          sprintf(partJson, "\"%s\":\"%s %0.1fMB\",", file.path(), file.name(), (float)file.size() / ONEMEG);
+        if (strstr(file.name(), extension) != NULL || (altExtension != NULL && strstr(file.name(), altExtension) != NULL)) {
+          if (findChecksum(crcBuff, file.name(), file.size(), crcStr)) 
+            sprintf(partJson, "\"%s\":\"%s %0.1fMB crc32:%s\",", file.path(), file.name(), (float)file.size() / ONEMEG, crcStr);
+          else sprintf(partJson, "\"%s\":\"%s %0.1fMB\",", file.path(), file.name(), (float)file.size() / ONEMEG);
           fileVec.push_back(std::string(partJson));
           noEntries = false;
         }
       }
       file = root.openNextFile();
     }
+    free(crcBuff);
     if (psramFound()) heap_caps_malloc_extmem_enable(4096);
   }
   
-  if (noEntries && !hasExtension) strcpy(jsonBuff, "{\"/\":\"List folders\",\"/#current\":\"Go to current (today)\",\"/#previous\":\"Go to previous (yesterday)\"}");
+  if (noEntries && !hasExtension && !hasAltExtension) strcpy(jsonBuff, "{\"/\":\"List folders\",\"/#current\":\"Go to current (today)\",\"/#previous\":\"Go to previous (yesterday)\"}");
   else {
     // build json string content
     sort(fileVec.begin(), fileVec.end(), std::greater<std::string>());
@@ -27,11 +27,13 @@ static httpd_ws_frame_t wsPkt;
 static fs::FS fp = STORAGE;
 byte chunk[CHUNKSIZE];
 
-static bool sendChunks(File df, httpd_req_t *req) {   
-  // use chunked encoding to send large content to browser
+static bool sendChunks(File df, httpd_req_t *req, aviCryptStruct* crypt = NULL) {   
+  // use chunked encoding to send large content to browser, encrypted content decrypted if crypt provided
   size_t chunksize;
   do {
+    size_t chunkPos = df.position();
     chunksize = df.read(chunk, CHUNKSIZE); 
+    if (crypt != NULL) cryptAvi(*crypt, chunk, chunksize, chunkPos);
     if (httpd_resp_send_chunk(req, (char*)chunk, chunksize) != ESP_OK) {
       df.close();
       return false;
@@ -66,8 +68,16 @@ static esp_err_t fileHandler(httpd_req_t* req, bool download) {
     sprintf(contentLength, "%i", df.size());
     httpd_resp_set_hdr(req, "Content-Length", contentLength);
   }
-  
-  if (sendChunks(df, req)) LOG_INF("Sent %s to browser", inFileName);
+  // encrypted recording is downloaded as playable avi or mp4
+  aviCryptStruct crypt;
+  bool isAvi = download && !strcmp(inFileName + strlen(inFileName) - strlen(FILE_EXT), FILE_EXT);
+  bool isMp4 = download && !strcmp(inFileName + strlen(inFileName) - strlen(MP4_EXT), MP4_EXT);
+  if (isAvi && isCompactAvi(df)) LOG_WRN("%s stored with compactJpeg, only plays in app", inFileName);
+  bool isCrypt = (isAvi && getAviCrypt(df, crypt)) || (isMp4 && getMp4Crypt(df, crypt));
+  df.seek(0, SeekSet);
+  bool sent = sendChunks(df, req, isCrypt ? &crypt : NULL);
+  if (isCrypt) freeAviCrypt(crypt);
+  if (sent) LOG_INF("Sent %s to browser", inFileName);
   else {
     LOG_ERR("Failed to send %s to browser", inFileName);
     httpd_resp_set_status(req, HTTPD_400);